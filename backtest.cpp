@@ -1,6 +1,10 @@
 #include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -9,80 +13,129 @@
 #include <tuple>
 #include <vector>
 
+#include "bootstrap.h"
+#include "coordinator.h"
+#include "daemon.h"
+#include "fan_out.h"
 #include "feed.h"
+#include "fixed_point.h"
+#include "job.h"
+#include "journal.h"
 #include "market_data.pb.h"
+#include "pipeline.h"
+#include "placement.h"
+#include "range_index.h"
+#include "sharded_feed.h"
+#include "shared_segment.h"
 #include "strategy.h"
+#include "sweep.h"
+#include "symbols.h"
+#include "trace.h"
+#include "universe.h"
 #include "util.h"
 
 using DynamicHistogram =
     dhist::DynamicHistogram</*kUseDecay=*/false, /*kThreadsafe=*/true>;
 
-std::tuple<double, double>
-job(std::unique_ptr<Feed> feed, double cash, double rebalance_threshold,
-    WelfordRunningStatistics *bh_stats, WelfordRunningStatistics *wave_stats,
-    DynamicHistogram *bh_hist, DynamicHistogram *wave_hist) {
-  BuyAndHold bh(cash, feed->symbols(), feed->prices());
-  WaveArbitrage wave(cash, feed->symbols(), feed->prices(),
-                     rebalance_threshold);
-
-  Duration dur;
-  dur.set_seconds(365 * 24 * 60 * 60);
-  Duration cooldown;
-  cooldown.set_seconds(60);
-
-  StreamIntervalStatistics bh_si_stats(dur, cooldown, bh_stats, bh_hist);
-  StreamIntervalStatistics wave_si_stats(dur, cooldown, wave_stats, wave_hist);
-
-  int64_t last_hist_seconds = 0;
-
-  while (true) {
-    FeedStatus fs = feed->adjust_prices();
-
-    if (fs & FEED_DIVIDEND) {
-      for (size_t i = 0; i < feed->dividends().size(); i++) {
-        if (feed->dividends()[i] != 0.0) {
-          bh.pay_dividend(feed->symbols()[i], feed->dividends()[i]);
-          wave.pay_dividend(feed->symbols()[i], feed->dividends()[i]);
-        }
-      }
-    }
-
-    if (fs & FEED_SPLIT) {
-      for (size_t i = 0; i < feed->splits().size(); i++) {
-        if (feed->splits()[i] != 0.0) {
-          bh.stock_split(feed->symbols()[i], 1.0 / feed->splits()[i]);
-          wave.stock_split(feed->symbols()[i], 1.0 / feed->splits()[i]);
-        }
-      }
+std::vector<string> get_backtest_symbols() {
+  std::set<std::string> split_set = {
+      "AFL", "AIV",  "BF-B", "BLL", "CHK",  "CMCSA", "CNX", "CTXS",
+      "DD",  "DOV",  "EQT",  "EW",  "FAST", "FMC",   "FTI", "GE",
+      "HON", "HSIC", "ISRG", "LEN", "MET",  "MKC",   "NEE", "PFE",
+      "PNR", "TGNA", "VAR",  "VFC", "VNO",  "XRX"};
+  std::set<std::string> blacklist_set = {
+      "FTR", "GNW",
+  };
+  std::vector<string> symbols;
+  for (const auto &symbol : get_available_symbols()) {
+    if (split_set.find(symbol) == split_set.end() &&
+        blacklist_set.find(symbol) == blacklist_set.end()) {
+      symbols.push_back(symbol);
     }
+  }
+  return symbols;
+}
 
-    if (fs & FEED_END) {
-      break;
-    }
+// Runs a pair's feed through job() with whatever options main() picked.
+typedef std::function<std::tuple<double, double>(
+    std::unique_ptr<Feed> feed, WelfordRunningStatistics *bh_stats,
+    WelfordRunningStatistics *wave_stats, DynamicHistogram *bh_hist,
+    DynamicHistogram *wave_hist)>
+    FeedJob;
+
+// Runs every pair with one worker thread per CPU, pinned if pin is set. The
+// pairs are dealt to the nodes in contiguous runs, so that the day files of a
+// symbol tend to be read, and cached, by a single node. Each node looks the
+// symbols up in its own copy of the manifest and gathers its own statistics,
+// which are merged into the given ones at the end. Returns the delta return
+// of each pair.
+std::vector<std::tuple<double, string, string>>
+numa_sweep(const NumaTopology &topology, bool pin,
+           const std::vector<string> &symbols,
+           const std::vector<std::tuple<size_t, size_t>> &pairs, double cash,
+           FeedJob feed_job, WelfordRunningStatistics *bh_stats,
+           WelfordRunningStatistics *wave_stats, DynamicHistogram *bh_hist,
+           DynamicHistogram *wave_hist) {
+  static constexpr size_t kMaxNumBuckets = 200;
+  struct NodeResults {
+    NodeResults() : bh_hist(kMaxNumBuckets), wave_hist(kMaxNumBuckets) {}
+
+    WelfordRunningStatistics bh_stats;
+    WelfordRunningStatistics wave_stats;
+    DynamicHistogram bh_hist;
+    DynamicHistogram wave_hist;
+    std::mutex mu;
+    std::vector<std::tuple<double, string, string>> delta_returns;
+  };
 
-    bool price_threshold = true;
-    for (auto price : feed->prices()) {
-      if (price < 5.0) {
-        price_threshold = false;
-      }
-    }
-    if (!price_threshold) {
-      break;
-    }
+  const IEXManifest manifest = IEXManifest::load(symbols);
+  NodeReplicas<IEXManifest> manifests(
+      topology, [&]() { return std::make_unique<IEXManifest>(manifest); });
+  NodeReplicas<NodeResults> node_results(
+      topology, []() { return std::make_unique<NodeResults>(); });
 
-    bh.price_event(feed->prices());
-    wave.price_event(feed->prices());
+  NodeQueues<std::tuple<size_t, size_t>> queues(topology.num_nodes());
+  for (size_t p = 0; p < pairs.size(); p++) {
+    queues.push(p * topology.num_nodes() / pairs.size(), pairs[p]);
+  }
 
-    if (feed->timestamp().seconds() - 60 > last_hist_seconds) {
-      last_hist_seconds = feed->timestamp().seconds();
-      bh_si_stats.update(bh.portfolio().value(feed->prices()), feed->timestamp());
-      wave_si_stats.update(wave.portfolio().value(feed->prices()),
-                           feed->timestamp());
+  run_on_nodes(topology, pin, [&](size_t node, size_t index) {
+    NodeResults *results = node_results.mutable_get(node);
+    std::tuple<size_t, size_t> pair;
+    while (queues.next(node, &pair)) {
+      const string &first = symbols[std::get<0>(pair)];
+      const string &second = symbols[std::get<1>(pair)];
+      auto returns = feed_job(
+          /*feed=*/std::make_unique<IEXFeed>(
+              /*symbols=*/std::vector<string>{first, second},
+              /*manifest=*/&manifests.get(node)),
+          /*bh_stats=*/&results->bh_stats,
+          /*wave_stats=*/&results->wave_stats,
+          /*bh_hist=*/&results->bh_hist, /*wave_hist=*/&results->wave_hist);
+
+      std::scoped_lock<std::mutex> lock(results->mu);
+      results->delta_returns.push_back(std::make_tuple(
+          (std::get<0>(returns) - std::get<1>(returns)) / cash, first,
+          second));
     }
+  });
+
+  std::vector<std::tuple<double, string, string>> delta_returns;
+  for (size_t node = 0; node < node_results.size(); node++) {
+    NodeResults *results = node_results.mutable_get(node);
+    bh_stats->merge(results->bh_stats.count(), results->bh_stats.mean(),
+                    results->bh_stats.m2());
+    wave_stats->merge(results->wave_stats.count(), results->wave_stats.mean(),
+                      results->wave_stats.m2());
+    add_quantiles(histogram_quantiles(&results->bh_hist),
+                  results->bh_stats.count(), bh_hist);
+    add_quantiles(histogram_quantiles(&results->wave_hist),
+                  results->wave_stats.count(), wave_hist);
+    delta_returns.insert(delta_returns.end(), results->delta_returns.begin(),
+                         results->delta_returns.end());
   }
-
-  return std::make_tuple(bh.portfolio().value(feed->prices()),
-                         wave.portfolio().value(feed->prices()));
+  std::sort(delta_returns.begin(), delta_returns.end());
+  return delta_returns;
 }
 
 int main(int argc, char **argv) {
@@ -91,6 +144,82 @@ int main(int argc, char **argv) {
 
   static constexpr double cash = 100000.0;
   static constexpr double rebalance_threshold = 1.001;
+  // Writes every pair's equity curve and fills to a journal file.
+  static constexpr bool write_journal = false;
+  // Decodes each pair a window of adjustments ahead and skips the stretches
+  // where neither strategy trades. The results are the same either way.
+  static constexpr bool skip_idle_ranges = true;
+  // Runs the strategies with integer accounting so that the results are
+  // bit-identical on every machine.
+  static constexpr bool fixed_point = false;
+  // Replays the sweep from decoded trades in a shared memory segment, which
+  // is published by the first backtest to run and reused by later ones. Run
+  // SharedTradeSegment::unlink() on the name to pick up new data.
+  static constexpr bool use_shared_segment = false;
+  static const string shared_segment_name = "/wave_arbitrage_iex";
+  // Records where the sweep's threads spend their time, and writes it as a
+  // Chrome trace that chrome://tracing or ui.perfetto.dev can open.
+  static constexpr bool write_trace = false;
+  // Also measures the sweep's returns over a month, a quarter and three
+  // years. All horizons come out of the same replay.
+  static constexpr bool extra_horizons = false;
+  if (write_trace) {
+    Tracer::enable();
+    Tracer::set_thread_name("main");
+  }
+
+  auto feed_job = [&](std::unique_ptr<Feed> feed,
+                      WelfordRunningStatistics *bh_stats,
+                      WelfordRunningStatistics *wave_stats,
+                      DynamicHistogram *bh_hist, DynamicHistogram *wave_hist) {
+    if (skip_idle_ranges) {
+      feed = std::make_unique<RangeSkipFeed>(std::move(feed),
+                                             /*sample_interval_seconds=*/60);
+    }
+    auto run_job = fixed_point ? job<FixedBuyAndHold, FixedWaveArbitrage>
+                               : job<BuyAndHold, WaveArbitrage>;
+    return run_job(/*feed=*/std::move(feed), /*cash=*/cash,
+                   /*rebalance_threshold=*/rebalance_threshold,
+                   /*bh_stats=*/bh_stats, /*wave_stats=*/wave_stats,
+                   /*bh_hist=*/bh_hist, /*wave_hist=*/wave_hist,
+                   /*journal_writer=*/nullptr, /*bh_horizons=*/{},
+                   /*wave_horizons=*/{});
+  };
+  auto pair_job = [&](const string &first, const string &second,
+                      WelfordRunningStatistics *bh_stats,
+                      WelfordRunningStatistics *wave_stats,
+                      DynamicHistogram *bh_hist, DynamicHistogram *wave_hist) {
+    return feed_job(/*feed=*/std::make_unique<IEXFeed>(
+                        /*symbols=*/std::vector<string>{first, second}),
+                    /*bh_stats=*/bh_stats, /*wave_stats=*/wave_stats,
+                    /*bh_hist=*/bh_hist, /*wave_hist=*/wave_hist);
+  };
+
+  // `backtest --worker=<socket>` runs pairs for a coordinator in another
+  // process instead of running a backtest of its own.
+  const string worker_flag = "--worker=";
+  if (argc > 1 && string(argv[1]).rfind(worker_flag, 0) == 0) {
+    const string socket_path = string(argv[1]).substr(worker_flag.size());
+    return run_worker(socket_path, pair_job) ? 0 : 1;
+  }
+
+  // `backtest --daemon=<socket>` decodes the backtest's symbols once, keeps
+  // them in the shared segment, and runs the jobs that backtest_client sends
+  // until one asks it to shut down. See daemon.h.
+  const string daemon_flag = "--daemon=";
+  if (argc > 1 && string(argv[1]).rfind(daemon_flag, 0) == 0) {
+    const string socket_path = string(argv[1]).substr(daemon_flag.size());
+    const std::vector<string> symbols = get_backtest_symbols();
+    BacktestDaemon daemon(socket_path,
+                          SharedTradeSegment::attach_or_publish(
+                              shared_segment_name, symbols,
+                              IEXManifest::load(symbols)));
+    printf("serving %zu symbols on %s\n", daemon.num_symbols(),
+           socket_path.c_str());
+    fflush(stdout);
+    daemon.serve();
+    return 0;
+  }
 
   WelfordRunningStatistics bh_stats;
   WelfordRunningStatistics wave_stats;
@@ -110,8 +239,11 @@ int main(int argc, char **argv) {
         /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
         /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist);
   } else if (false) {
-    std::unique_ptr<Feed> feed = std::make_unique<IEXFeed>(IEXFeed(
-        /*symbols=*/{"AIV", "XRX"}));
+    // Decode on a separate thread so that parsing overlaps with the
+    // strategies.
+    std::unique_ptr<Feed> feed = std::make_unique<PipelinedFeed>(
+        std::make_unique<IEXFeed>(
+            /*symbols=*/std::vector<string>{"AIV", "XRX"}));
     ///*symbols=*/{"F", "ZION"}));
     ///*symbols=*/{"AMZN", "WMT"}));
     ///*symbols=*/{"GOOG", "FB"}));
@@ -120,84 +252,287 @@ int main(int argc, char **argv) {
         /*rebalance_threshold=*/rebalance_threshold,
         /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
         /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist);
-  } else {
-    std::set<std::string> split_set = {
-        "AFL", "AIV",  "BF-B", "BLL", "CHK",  "CMCSA", "CNX", "CTXS",
-        "DD",  "DOV",  "EQT",  "EW",  "FAST", "FMC",   "FTI", "GE",
-        "HON", "HSIC", "ISRG", "LEN", "MET",  "MKC",   "NEE", "PFE",
-        "PNR", "TGNA", "VAR",  "VFC", "VNO",  "XRX"};
-    std::set<std::string> blacklist_set = {
-        "FTR", "GNW",
-    };
-    std::vector<string> symbols;
-    for (const auto &symbol : get_available_symbols()) {
-      if (split_set.find(symbol) == split_set.end() &&
-          blacklist_set.find(symbol) == blacklist_set.end()) {
-        symbols.push_back(symbol);
+  } else if (false) {
+    // One long pair on every core. The days are decoded in shards on all of
+    // them, and the strategies run over the ticks in order, so the results
+    // are the same as with a plain IEXFeed.
+    std::unique_ptr<Feed> feed = std::make_unique<ShardedIEXFeed>(
+        /*symbols=*/std::vector<string>{"AIV", "XRX"});
+    printf("%s\n", feed->to_string().c_str());
+    const auto values =
+        job(/*feed=*/std::move(feed), /*cash=*/cash,
+            /*rebalance_threshold=*/rebalance_threshold,
+            /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
+            /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist);
+    printf("bh: %lf, wave: %lf\n", std::get<0>(values), std::get<1>(values));
+  } else if (false) {
+    // Several strategy variants over one pass of a pair's data. Each one's
+    // returns are kept apart, and any registered strategy can be added.
+    const std::vector<string> specs = {"BuyAndHold", "WaveArbitrage:1.001",
+                                       "WaveArbitrage:1.005",
+                                       "WaveArbitrage:1.01"};
+    std::deque<ReturnStats> stats;
+    std::vector<FanOutEntry> entries;
+    for (const string &spec : specs) {
+      stats.emplace_back(kMaxNumBuckets);
+      entries.push_back(
+          FanOutEntry{spec, &stats.back().stats, &stats.back().hist});
+    }
+    const std::vector<double> values = fan_out_job(
+        /*feed=*/std::make_unique<IEXFeed>(
+            /*symbols=*/std::vector<string>{"AIV", "XRX"}),
+        /*cash=*/cash, /*entries=*/entries);
+    for (size_t s = 0; s < specs.size(); s++) {
+      const string label =
+          specs[s] + " -- value: " + std::to_string(values[s]) +
+          " mean: " + std::to_string(stats[s].stats.mean()) +
+          " var: " + std::to_string(stats[s].stats.sample_variance());
+      printf("%s\n",
+             stats[s].hist.json(/*title=*/"", /*label=*/label).c_str());
+    }
+  } else if (false) {
+    // Monte Carlo over paths resampled from the pair's own minute returns.
+    IEXFeed feed(/*symbols=*/{"AIV", "XRX"});
+    ReturnSeries series =
+        ReturnSeries::from_feed(&feed, /*interval_seconds=*/60);
+    printf("%s: %zu minute returns\n", feed.feed_name().c_str(),
+           series.size());
+    run_bootstrap(/*series=*/series, /*block_length=*/390,
+                  /*path_length=*/252 * 390, /*num_paths=*/1000000,
+                  /*cash=*/cash, /*rebalance_threshold=*/rebalance_threshold,
+                  /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
+                  /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist);
+  } else if (false) {
+    // Every pair, with one pinned worker per CPU and per-node copies of the
+    // manifest and the statistics.
+    std::vector<string> symbols = get_backtest_symbols();
+    std::vector<std::tuple<size_t, size_t>> pairs;
+    for (size_t i = 0; i < symbols.size(); i++) {
+      for (size_t j = i + 1; j < symbols.size(); j++) {
+        pairs.push_back(std::make_tuple(i, j));
       }
     }
+    const auto delta_returns = numa_sweep(
+        /*topology=*/NumaTopology::detect(), /*pin=*/true,
+        /*symbols=*/symbols, /*pairs=*/pairs, /*cash=*/cash,
+        /*feed_job=*/feed_job, /*bh_stats=*/&bh_stats,
+        /*wave_stats=*/&wave_stats, /*bh_hist=*/&bh_hist,
+        /*wave_hist=*/&wave_hist);
 
-    std::uniform_int_distribution<int> uniform_dist(0, symbols.size() - 1);
-    std::default_random_engine generator;
+    printf("delta returns:\n");
+    for (const auto &bh_return : delta_returns) {
+      printf("%4.4s, %4.4s, %lf\n", std::get<1>(bh_return).c_str(),
+             std::get<2>(bh_return).c_str(), std::get<0>(bh_return));
+    }
+  } else if (false) {
+    // Times the same pairs on one node, then two, and so on, pinned and
+    // unpinned, to show how the sweep scales across sockets.
+    static constexpr size_t kPairsPerCpu = 4;
+    const NumaTopology topology = NumaTopology::detect();
+    std::vector<string> symbols = get_backtest_symbols();
+    std::vector<std::tuple<size_t, size_t>> pairs;
+    for (size_t i = 0; i < symbols.size(); i++) {
+      for (size_t j = i + 1; j < symbols.size(); j++) {
+        pairs.push_back(std::make_tuple(i, j));
+      }
+    }
+    size_t num_cpus = 0;
+    for (size_t node = 0; node < topology.num_nodes(); node++) {
+      num_cpus += topology.cpus(node).size();
+    }
+    pairs.resize(std::min(pairs.size(), kPairsPerCpu * num_cpus));
+
+    printf("nodes, threads, pinned, pairs/s\n");
+    for (size_t num_nodes = 1; num_nodes <= topology.num_nodes();
+         num_nodes++) {
+      const NumaTopology nodes = topology.first_nodes(num_nodes);
+      size_t num_threads = 0;
+      for (size_t node = 0; node < num_nodes; node++) {
+        num_threads += nodes.cpus(node).size();
+      }
+      for (bool pin : {false, true}) {
+        WelfordRunningStatistics unused_bh_stats;
+        WelfordRunningStatistics unused_wave_stats;
+        DynamicHistogram unused_bh_hist(kMaxNumBuckets);
+        DynamicHistogram unused_wave_hist(kMaxNumBuckets);
+        const auto start = std::chrono::steady_clock::now();
+        numa_sweep(/*topology=*/nodes, /*pin=*/pin, /*symbols=*/symbols,
+                   /*pairs=*/pairs, /*cash=*/cash, /*feed_job=*/feed_job,
+                   /*bh_stats=*/&unused_bh_stats,
+                   /*wave_stats=*/&unused_wave_stats,
+                   /*bh_hist=*/&unused_bh_hist,
+                   /*wave_hist=*/&unused_wave_hist);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        printf("%zu, %zu, %d, %lf\n", num_nodes, num_threads, pin,
+               pairs.size() / elapsed.count());
+      }
+    }
+  } else if (false) {
+    // Hands the pairs out in units to worker processes over a Unix socket.
+    // One worker per CPU is forked here, and more can be started with
+    // `backtest --worker=<socket>`. A unit whose worker dies is handed out
+    // again.
+    static constexpr size_t kPairsPerUnit = 16;
+    const string socket_path =
+        "/tmp/backtest." + std::to_string(getpid()) + ".sock";
+    std::vector<string> symbols = get_backtest_symbols();
+    std::vector<std::vector<std::tuple<string, string>>> units;
+    for (size_t i = 0; i < symbols.size(); i++) {
+      for (size_t j = i + 1; j < symbols.size(); j++) {
+        if (units.empty() || units.back().size() >= kPairsPerUnit) {
+          units.emplace_back();
+        }
+        units.back().push_back(std::make_tuple(symbols[i], symbols[j]));
+      }
+    }
 
-    const auto num_cpus = std::thread::hardware_concurrency();
-    std::thread threads[num_cpus];
-    std::atomic<int> jobs_completed = 0;
+    Coordinator coord(socket_path, std::move(units), &bh_stats, &wave_stats,
+                      &bh_hist, &wave_hist);
+    std::vector<pid_t> workers;
+    for (unsigned w = 0; w < std::thread::hardware_concurrency(); w++) {
+      const pid_t pid = fork();
+      CHECK_GE(pid, 0);
+      if (pid == 0) {
+        _exit(run_worker(socket_path, pair_job) ? 0 : 1);
+      }
+      workers.push_back(pid);
+      coord.add_worker_process(pid);
+    }
+    const bool served = coord.serve();
+    for (pid_t pid : workers) {
+      waitpid(pid, nullptr, 0);
+    }
+    CHECK(served) << "The workers all exited before the backtest was done";
+    printf("requeued units: %zu\n", coord.num_requeued());
 
-    std::mutex indeces_mu;
-    size_t first_stock_idx = 0;
-    size_t second_stock_idx = first_stock_idx;
-    bool is_running = true;
-    auto get_next = [&]() -> std::tuple<size_t, size_t, bool> {
-      std::scoped_lock<std::mutex> lock(indeces_mu);
+    std::vector<std::tuple<double, string, string>> delta_returns;
+    for (const auto &result : coord.results()) {
+      delta_returns.push_back(
+          std::make_tuple((result.bh_value - result.wave_value) / cash,
+                          result.first, result.second));
+    }
+    std::sort(delta_returns.begin(), delta_returns.end());
 
-      if (second_stock_idx + 1 >= symbols.size()) {
-        first_stock_idx += 1;
-        second_stock_idx = first_stock_idx + 1;
+    printf("delta returns:\n");
+    for (const auto &bh_return : delta_returns) {
+      printf("%4.4s, %4.4s, %lf\n", std::get<1>(bh_return).c_str(),
+             std::get<2>(bh_return).c_str(), std::get<0>(bh_return));
+    }
+  } else if (false) {
+    // Replay every symbol once per pass instead of once per pair. Each pair
+    // holds a year of per-minute samples for its interval statistics, so the
+    // pairs are split into passes that fit in half of the machine's memory.
+    const size_t memory_bytes =
+        static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE);
+    const size_t max_pairs_per_pass = std::max(
+        static_cast<size_t>(1),
+        memory_bytes / 2 / UniverseReplay::bytes_per_pair());
+    std::vector<string> symbols = get_backtest_symbols();
+    std::vector<std::tuple<size_t, size_t>> all_pairs;
+    for (size_t i = 0; i < symbols.size(); i++) {
+      for (size_t j = i + 1; j < symbols.size(); j++) {
+        all_pairs.push_back(std::make_tuple(i, j));
+      }
+    }
 
-        if (second_stock_idx >= symbols.size()) {
-          is_running = false;
-        }
-      } else {
-        second_stock_idx += 1;
+    std::vector<std::tuple<double, string, string>> delta_returns;
+    for (size_t start = 0; start < all_pairs.size();
+         start += max_pairs_per_pass) {
+      const size_t end =
+          std::min(all_pairs.size(), start + max_pairs_per_pass);
+
+      // Only the symbols used by this pass are read. They keep their order,
+      // so the first symbol of every pair still comes first.
+      std::set<size_t> used;
+      for (size_t p = start; p < end; p++) {
+        used.insert(std::get<0>(all_pairs[p]));
+        used.insert(std::get<1>(all_pairs[p]));
+      }
+      std::map<size_t, size_t> stream_idxs;
+      std::vector<string> pass_symbols;
+      for (size_t idx : used) {
+        stream_idxs[idx] = pass_symbols.size();
+        pass_symbols.push_back(symbols[idx]);
+      }
+      std::vector<std::tuple<size_t, size_t>> pass_pairs;
+      for (size_t p = start; p < end; p++) {
+        pass_pairs.push_back(
+            std::make_tuple(stream_idxs[std::get<0>(all_pairs[p])],
+                            stream_idxs[std::get<1>(all_pairs[p])]));
       }
-      return std::make_tuple(first_stock_idx, second_stock_idx, is_running);
-    };
-
-    std::mutex pair_returns_mu;
-    std::map<std::tuple<string, string>, double> bh_means;
-    std::map<std::tuple<string, string>, double> wave_means;
-    auto add_mean = [&](std::tuple<string, string> s, double bh_mean,
-                        double wave_mean) {
-      std::scoped_lock<std::mutex> lock(pair_returns_mu);
-      bh_means[s] = bh_mean / cash;
-      wave_means[s] = wave_mean / cash;
-    };
-
-    for (int tx = 0; tx < num_cpus; tx++) {
-      threads[tx] = std::thread([&]() {
-        while (true) {
-          auto idxs = get_next();
-          if (!std::get<2>(idxs)) {
-            return;
-          }
-          size_t i = std::get<0>(idxs);
-          size_t j = std::get<1>(idxs);
 
-          std::unique_ptr<Feed> feed = std::make_unique<IEXFeed>(IEXFeed(
-              /*symbols=*/{symbols[i], symbols[j]}));
-          auto returns = job(/*feed=*/std::move(feed), /*cash=*/cash,
-                             /*rebalance_threshold=*/rebalance_threshold,
-                             /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
-                             /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist);
+      UniverseReplay replay(
+          /*trades=*/std::make_unique<UniverseTradeStream>(pass_symbols),
+          /*cash=*/cash, /*rebalance_threshold=*/rebalance_threshold,
+          /*pairs=*/pass_pairs,
+          /*num_shards=*/std::thread::hardware_concurrency(),
+          /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
+          /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist);
+      replay.run();
+
+      for (const auto &result : replay.results()) {
+        delta_returns.push_back(std::make_tuple(
+            (result.bh_value - result.wave_value) / cash,
+            pass_symbols[result.first], pass_symbols[result.second]));
+      }
+      printf("completed: %zu/%zu\n", end, all_pairs.size());
+    }
+    std::sort(delta_returns.begin(), delta_returns.end());
 
-          add_mean(std::make_tuple(symbols[i], symbols[j]),
-                   std::get<0>(returns), std::get<1>(returns));
+    printf("delta returns:\n");
+    for (const auto &bh_return : delta_returns) {
+      printf("%4.4s, %4.4s, %lf\n", std::get<1>(bh_return).c_str(),
+             std::get<2>(bh_return).c_str(), std::get<0>(bh_return));
+    }
+  } else {
+    std::vector<string> symbols = get_backtest_symbols();
 
-          int completed =
-              jobs_completed.fetch_add(1, std::memory_order_acq_rel);
+    std::unique_ptr<SharedTradeSegment> segment;
+    if (use_shared_segment) {
+      segment = SharedTradeSegment::attach_or_publish(
+          shared_segment_name, symbols, IEXManifest::load(symbols));
+    }
 
+    std::uniform_int_distribution<int> uniform_dist(0, symbols.size() - 1);
+    std::default_random_engine generator;
+
+    std::unique_ptr<JournalWriter> journal_writer;
+    if (write_journal) {
+      journal_writer = std::make_unique<JournalWriter>(
+          "backtest_" + std::to_string(time(nullptr)) + ".journal");
+    }
+
+    std::deque<ReturnStats> horizon_stats;
+    std::vector<IntervalHorizon> bh_horizons;
+    std::vector<IntervalHorizon> wave_horizons;
+    std::vector<string> horizon_names;
+    if (extra_horizons) {
+      for (const auto &[name, days] : std::vector<std::tuple<string, int>>{
+               {"1 month", 30}, {"1 quarter", 91}, {"3 years", 3 * 365}}) {
+        Duration duration;
+        duration.set_seconds(days * 24 * 60 * 60);
+        for (auto *horizons : {&bh_horizons, &wave_horizons}) {
+          horizon_stats.emplace_back(kMaxNumBuckets);
+          horizons->push_back(IntervalHorizon{duration,
+                                              &horizon_stats.back().stats,
+                                              &horizon_stats.back().hist});
+        }
+        horizon_names.push_back(name);
+      }
+    }
+
+    PairMatrix<double> pair_deltas = pair_sweep(
+        /*symbols=*/symbols, /*segment=*/segment.get(),
+        /*skip_idle_ranges=*/skip_idle_ranges, /*fixed_point=*/fixed_point,
+        /*cash=*/cash, /*rebalance_threshold=*/rebalance_threshold,
+        /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
+        /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist,
+        /*journal_writer=*/journal_writer.get(), /*bh_horizons=*/bh_horizons,
+        /*wave_horizons=*/wave_horizons,
+        /*on_pair=*/[&](int completed, size_t i, size_t j) {
           if (completed % 25 == 0) {
+            TraceSpan dump_span("histogram json");
             printf("%s\n",
                    bh_hist
                        .json(/*title=*/"",
@@ -219,19 +554,17 @@ int main(int argc, char **argv) {
                    bh_stats.mean(), wave_stats.mean(),
                    bh_stats.mean() - wave_stats.mean());
           }
-        }
-      });
-    }
-
-    for (int tx = 0; tx < num_cpus; tx++) {
-      threads[tx].join();
+        });
+    if (journal_writer) {
+      journal_writer->close();
     }
 
     std::vector<std::tuple<double, string, string>> delta_returns;
-    for (const auto &p : bh_means) {
-      delta_returns.push_back(
-          std::make_tuple(p.second - wave_means[p.first], std::get<0>(p.first),
-                          std::get<1>(p.first)));
+    for (size_t i = 0; i < symbols.size(); i++) {
+      for (size_t j = i + 1; j < symbols.size(); j++) {
+        delta_returns.push_back(
+            std::make_tuple(pair_deltas.at(i, j), symbols[i], symbols[j]));
+      }
     }
     std::sort(delta_returns.begin(), delta_returns.end());
 
@@ -240,6 +573,19 @@ int main(int argc, char **argv) {
       printf("%4.4s, %4.4s, %lf\n", std::get<1>(bh_return).c_str(),
              std::get<2>(bh_return).c_str(), std::get<0>(bh_return));
     }
+
+    for (size_t h = 0; h < horizon_names.size(); h++) {
+      for (const auto &[strategy, horizon] :
+           {std::make_tuple("bh", bh_horizons[h]),
+            std::make_tuple("wave", wave_horizons[h])}) {
+        const string label =
+            string(strategy) + " " + horizon_names[h] +
+            " -- mean: " + std::to_string(horizon.stats->mean()) +
+            " var: " + std::to_string(horizon.stats->sample_variance());
+        printf("%s\n",
+               horizon.hist->json(/*title=*/"", /*label=*/label).c_str());
+      }
+    }
   }
 
   printf("%s\n",
@@ -257,5 +603,9 @@ int main(int argc, char **argv) {
                   " var: " + std::to_string(wave_stats.sample_variance()))
           .c_str());
 
+  if (write_trace) {
+    Tracer::write("backtest_" + std::to_string(time(nullptr)) + ".trace.json");
+  }
+
   return 0;
 }
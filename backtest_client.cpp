@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "daemon.h"
+
+// Sends a job to a running `backtest --daemon=<socket>`, prints each pair's
+// values as they come back, and then each strategy's returns.
+//
+//   backtest_client --socket=<path> [--pairs=<a>:<b>[,...]]
+//                   [--symbols=<a>,<b>[,...]] [--strategies=<spec>[,...]]
+//                   [--cash=<n>] [--from=YYYYMMDD] [--to=YYYYMMDD]
+//                   [--no_skip] [--shutdown]
+//
+// --symbols adds every pair of the symbols. --strategies defaults to
+// BuyAndHold,WaveArbitrage:1.001, and --to is exclusive. --shutdown stops
+// the daemon after the job, or instead of one if there are no pairs.
+
+std::vector<string> split(const string &value, char separator) {
+  std::vector<string> parts;
+  std::istringstream in(value);
+  string part;
+  while (std::getline(in, part, separator)) {
+    parts.push_back(part);
+  }
+  return parts;
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+
+  string socket_path;
+  backtest_daemon::JobSpec spec;
+  spec.strategies = {"BuyAndHold", "WaveArbitrage:1.001"};
+  bool shutdown = false;
+  for (int a = 1; a < argc; a++) {
+    const string arg = argv[a];
+    const string value = arg.substr(arg.find('=') + 1);
+    if (arg.rfind("--socket=", 0) == 0) {
+      socket_path = value;
+    } else if (arg.rfind("--pairs=", 0) == 0) {
+      for (const auto &pair : split(value, ',')) {
+        const auto symbols = split(pair, ':');
+        CHECK_EQ(symbols.size(), 2) << "Bad pair " << pair;
+        spec.pairs.push_back({symbols[0], symbols[1]});
+      }
+    } else if (arg.rfind("--symbols=", 0) == 0) {
+      const auto symbols = split(value, ',');
+      for (size_t i = 0; i < symbols.size(); i++) {
+        for (size_t j = i + 1; j < symbols.size(); j++) {
+          spec.pairs.push_back({symbols[i], symbols[j]});
+        }
+      }
+    } else if (arg.rfind("--strategies=", 0) == 0) {
+      spec.strategies = split(value, ',');
+    } else if (arg.rfind("--cash=", 0) == 0) {
+      spec.cash = std::stod(value);
+    } else if (arg.rfind("--from=", 0) == 0) {
+      spec.first_date = value;
+    } else if (arg.rfind("--to=", 0) == 0) {
+      spec.end_date = value;
+    } else if (arg == "--no_skip") {
+      spec.skip_idle_ranges = false;
+    } else if (arg == "--shutdown") {
+      shutdown = true;
+    } else {
+      LOG(FATAL) << "Unknown flag " << arg;
+    }
+  }
+  CHECK(!socket_path.empty()) << "--socket is required";
+  CHECK(!spec.pairs.empty() || shutdown) << "--pairs or --symbols is required";
+
+  const int fd = backtest_daemon::connect_to_daemon(socket_path);
+  CHECK_GE(fd, 0) << "No daemon at " << socket_path;
+
+  int status = 0;
+  if (!spec.pairs.empty()) {
+    static constexpr size_t kMaxNumBuckets = 200;
+    std::deque<ReturnStats> stats;
+    std::vector<WelfordRunningStatistics *> stats_ptrs;
+    std::vector<DynamicHistogram *> hist_ptrs;
+    for (size_t s = 0; s < spec.strategies.size(); s++) {
+      stats.emplace_back(kMaxNumBuckets);
+      stats_ptrs.push_back(&stats.back().stats);
+      hist_ptrs.push_back(&stats.back().hist);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    bool first_result = true;
+    string error;
+    const bool ok = backtest_daemon::run_job(
+        fd, spec,
+        [&](const backtest_daemon::PairValues &pair) {
+          if (first_result) {
+            first_result = false;
+            const std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            printf("first result after %.3lf s\n", elapsed.count());
+          }
+          printf("%s, %s", pair.first.c_str(), pair.second.c_str());
+          for (double value : pair.values) {
+            printf(", %lf", value);
+          }
+          printf("\n");
+          fflush(stdout);
+        },
+        stats_ptrs, hist_ptrs, &error);
+    if (ok) {
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      printf("%zu pairs in %.3lf s\n", spec.pairs.size(), elapsed.count());
+      for (size_t s = 0; s < spec.strategies.size(); s++) {
+        const string label =
+            spec.strategies[s] + " -- mean: " +
+            std::to_string(stats[s].stats.mean()) +
+            " var: " + std::to_string(stats[s].stats.sample_variance());
+        printf("%s\n",
+               stats[s].hist.json(/*title=*/"", /*label=*/label).c_str());
+      }
+    } else {
+      fprintf(stderr, "%s\n", error.c_str());
+      status = 1;
+    }
+  }
+
+  if (shutdown) {
+    backtest_daemon::shutdown_daemon(fd);
+  }
+  close(fd);
+  return status;
+}
@@ -0,0 +1,197 @@
+#ifndef WAVE_ARBITRAGE_BOOTSTRAP_H
+#define WAVE_ARBITRAGE_BOOTSTRAP_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+#include "strategy.h"
+#include "util.h"
+
+// Joint log returns of a set of symbols, sampled from a feed at a fixed
+// interval. Rows are stored back to back as floats to keep whole histories
+// resident in memory.
+class ReturnSeries {
+public:
+  // Samples the feed every interval_seconds until it ends. Splits are taken
+  // out of the returns. Dividends are not, since the price drop they cause is
+  // small next to the intraday moves.
+  static ReturnSeries from_feed(Feed *feed, int64_t interval_seconds) {
+    ReturnSeries series;
+    series.num_symbols_ = feed->symbols().size();
+    series.initial_prices_ = feed->prices();
+
+    std::vector<double> prices = feed->prices();
+    std::vector<double> last_sample = prices;
+    int64_t last_sample_seconds = feed->timestamp().seconds();
+
+    std::vector<Tick> ticks(
+        std::max(static_cast<size_t>(4096), feed->max_ticks_per_adjust()));
+    size_t n;
+    while ((n = feed->next_batch(ticks.data(), ticks.size())) > 0) {
+      for (size_t t = 0; t < n; t++) {
+        const Tick &tick = ticks[t];
+        if (tick.flags & TICK_PRICE) {
+          prices[tick.symbol_index] = tick.value;
+        } else if (tick.flags & TICK_SPLIT) {
+          last_sample[tick.symbol_index] *= tick.value;
+        }
+
+        if (!(tick.flags & TICK_EVALUATE) ||
+            tick.seconds - last_sample_seconds < interval_seconds) {
+          continue;
+        }
+
+        for (size_t i = 0; i < prices.size(); i++) {
+          series.returns_.push_back(std::log(prices[i] / last_sample[i]));
+        }
+        last_sample = prices;
+        last_sample_seconds = tick.seconds;
+      }
+    }
+
+    return series;
+  }
+
+  ReturnSeries() : num_symbols_(0) {}
+
+  ReturnSeries(std::vector<double> initial_prices, std::vector<float> returns)
+      : num_symbols_(initial_prices.size()), initial_prices_(initial_prices),
+        returns_(returns) {
+    CHECK_EQ(returns_.size() % num_symbols_, 0);
+  }
+
+  size_t num_symbols() const { return num_symbols_; }
+
+  // The number of sampled intervals.
+  size_t size() const {
+    return num_symbols_ ? returns_.size() / num_symbols_ : 0;
+  }
+
+  const std::vector<double> &initial_prices() const { return initial_prices_; }
+
+  // The log returns of every symbol over the given interval.
+  const float *returns(size_t step) const {
+    return &returns_[step * num_symbols_];
+  }
+
+private:
+  size_t num_symbols_;
+  std::vector<double> initial_prices_;
+  std::vector<float> returns_;
+};
+
+// Builds price paths by gluing together randomly chosen blocks of a
+// ReturnSeries. Blocks keep the symbols' returns aligned, so the paths keep
+// the cross correlation and the short range autocorrelation of the history.
+// Blocks that run off the end of the history wrap around to the start.
+class BlockBootstrap {
+public:
+  BlockBootstrap(const ReturnSeries *series, size_t block_length, uint64_t seed)
+      : series_(series), block_length_(block_length),
+        start_dist_(0, series->size() - 1) {
+    CHECK_GT(series->size(), 0);
+    CHECK_GT(block_length, 0);
+    generator_.seed(seed);
+  }
+
+  // Advances prices by one interval of the resampled path.
+  void step(std::vector<double> *prices) {
+    if (remaining_in_block_ == 0) {
+      next_ = start_dist_(generator_);
+      remaining_in_block_ = block_length_;
+    }
+
+    const float *returns = series_->returns(next_);
+    for (size_t i = 0; i < prices->size(); i++) {
+      (*prices)[i] *= std::exp(returns[i]);
+    }
+
+    remaining_in_block_--;
+    if (++next_ == series_->size()) {
+      next_ = 0;
+    }
+  }
+
+  // Starts a new path on a fresh block.
+  void restart() { remaining_in_block_ = 0; }
+
+private:
+  const ReturnSeries *series_;
+  const size_t block_length_;
+  size_t next_ = 0;
+  size_t remaining_in_block_ = 0;
+  std::uniform_int_distribution<size_t> start_dist_;
+  std::mt19937_64 generator_;
+};
+
+// Runs BuyAndHold and WaveArbitrage over num_paths bootstrapped paths of
+// path_length intervals each. The value of each strategy at the end of each
+// path, relative to cash, goes into the stats and histograms. As in job(), a
+// path stops early if a price falls under $5.
+void run_bootstrap(const ReturnSeries &series, size_t block_length,
+                   size_t path_length, int64_t num_paths, double cash,
+                   double rebalance_threshold,
+                   WelfordRunningStatistics *bh_stats,
+                   WelfordRunningStatistics *wave_stats,
+                   DynamicHistogram *bh_hist, DynamicHistogram *wave_hist,
+                   size_t num_threads = std::thread::hardware_concurrency()) {
+  // The paths have no dividends or splits, so the strategies never look the
+  // symbols up.
+  const std::vector<SymbolId> symbol_ids(series.num_symbols());
+  const uint64_t seed =
+      std::chrono::high_resolution_clock().now().time_since_epoch().count();
+  std::atomic<int64_t> next_path = 0;
+
+  std::vector<std::thread> threads;
+  for (size_t tx = 0; tx < std::max(static_cast<size_t>(1), num_threads);
+       tx++) {
+    threads.push_back(std::thread([&, tx]() {
+      BlockBootstrap bootstrap(&series, block_length, seed + tx);
+      std::vector<double> prices;
+
+      while (next_path.fetch_add(1, std::memory_order_relaxed) < num_paths) {
+        prices = series.initial_prices();
+        bootstrap.restart();
+        BuyAndHold bh(cash, symbol_ids, prices);
+        WaveArbitrage wave(cash, symbol_ids, prices, rebalance_threshold);
+
+        for (size_t s = 0; s < path_length; s++) {
+          bootstrap.step(&prices);
+
+          bool price_threshold = true;
+          for (auto price : prices) {
+            if (price < 5.0) {
+              price_threshold = false;
+            }
+          }
+          if (!price_threshold) {
+            break;
+          }
+
+          bh.price_event(prices);
+          wave.price_event(prices);
+        }
+
+        const double bh_return = bh.portfolio().value(prices) / cash;
+        const double wave_return = wave.portfolio().value(prices) / cash;
+        bh_stats->update(bh_return);
+        bh_hist->addValue(bh_return);
+        wave_stats->update(wave_return);
+        wave_hist->addValue(wave_return);
+      }
+    }));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+#endif // WAVE_ARBITRAGE_BOOTSTRAP_H
@@ -0,0 +1,67 @@
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "bootstrap.h"
+
+TEST(BootstrapTest, FromFeed) {
+  RandomFeed feed(/*symbols=*/{"FOO", "BAR"}, {10.0, 20.0}, 1.0 / 252,
+                  1.0 / 252, /*lifespan=*/1000);
+  const std::vector<double> initial_prices = feed.prices();
+
+  // RandomFeed moves every 100 seconds, so this samples every other move.
+  ReturnSeries series =
+      ReturnSeries::from_feed(&feed, /*interval_seconds=*/200);
+  EXPECT_EQ(series.num_symbols(), 2);
+  EXPECT_EQ(series.size(), 500);
+  EXPECT_EQ(series.initial_prices(), initial_prices);
+
+  // The returns telescope back to the final prices.
+  for (size_t i = 0; i < 2; i++) {
+    double log_return = 0.0;
+    for (size_t s = 0; s < series.size(); s++) {
+      log_return += series.returns(s)[i];
+    }
+    EXPECT_NEAR(initial_prices[i] * std::exp(log_return), feed.prices()[i],
+                1e-3);
+  }
+}
+
+TEST(BootstrapTest, WholeHistoryBlock) {
+  ReturnSeries series({10.0, 10.0}, {0.1f, 0.0f, 0.0f, -0.1f, 0.2f, 0.3f});
+  BlockBootstrap bootstrap(&series, /*block_length=*/3, /*seed=*/7);
+
+  // Whatever block is chosen, three steps wrap through the whole history.
+  std::vector<double> prices = {1.0, 1.0};
+  for (int s = 0; s < 3; s++) {
+    bootstrap.step(&prices);
+  }
+  EXPECT_NEAR(prices[0], std::exp(0.3), 1e-6);
+  EXPECT_NEAR(prices[1], std::exp(0.2), 1e-6);
+}
+
+TEST(BootstrapTest, Run) {
+  ReturnSeries series({10.0, 10.0},
+                      {0.01f, -0.01f, -0.01f, 0.01f, 0.02f, 0.0f,
+                       -0.02f, 0.0f});
+  WelfordRunningStatistics bh_stats;
+  WelfordRunningStatistics wave_stats;
+  DynamicHistogram bh_hist(10);
+  DynamicHistogram wave_hist(10);
+
+  run_bootstrap(series, /*block_length=*/2, /*path_length=*/100,
+                /*num_paths=*/1000, /*cash=*/1000.0,
+                /*rebalance_threshold=*/1.001, &bh_stats, &wave_stats,
+                &bh_hist, &wave_hist, /*num_threads=*/4);
+
+  EXPECT_EQ(bh_stats.count(), 1000);
+  EXPECT_EQ(wave_stats.count(), 1000);
+  EXPECT_GT(bh_stats.mean(), 0.0);
+  EXPECT_GT(wave_stats.mean(), 0.0);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+
+#include <chrono>
+#include <string>
+
+#include "compaction.h"
+#include "feed.h"
+
+// Writes a compacted copy of the processed IEX data, and reports how much
+// smaller it is. See compaction.h.
+//
+//   compact_iex --out=<dir> [--in=<dir>] [--threads=<n>] [--keep_repeats]
+//               [--keep_bursts] [--keep_other_events]
+//
+// --in defaults to the same directory the feeds read. Run the backtest on
+// the result with IEX_DATA_ROOT=<dir>.
+
+int main(int argc, char **argv) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  google::InitGoogleLogging(argv[0]);
+
+  string in_root = iex_data_root();
+  string out_root;
+  unsigned num_threads = 0;
+  CompactionOptions options;
+  for (int a = 1; a < argc; a++) {
+    const string arg = argv[a];
+    const string value = arg.substr(arg.find('=') + 1);
+    if (arg.rfind("--in=", 0) == 0) {
+      in_root = value;
+    } else if (arg.rfind("--out=", 0) == 0) {
+      out_root = value;
+    } else if (arg.rfind("--threads=", 0) == 0) {
+      num_threads = std::stoi(value);
+    } else if (arg == "--keep_repeats") {
+      options.collapse_repeats = false;
+    } else if (arg == "--keep_bursts") {
+      options.merge_bursts = false;
+    } else if (arg == "--keep_other_events") {
+      options.drop_other_events = false;
+    } else {
+      LOG(FATAL) << "Unknown flag " << arg;
+    }
+  }
+  CHECK(!out_root.empty()) << "--out is required";
+
+  const auto start = std::chrono::steady_clock::now();
+  const CompactionStats stats =
+      compact_iex(in_root, out_root, options, num_threads);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("compacted %s into %s in %.3lf s\n%s", in_root.c_str(),
+         out_root.c_str(), elapsed.count(), stats.to_string().c_str());
+  return 0;
+}
@@ -0,0 +1,231 @@
+#ifndef WAVE_ARBITRAGE_COMPACTION_H
+#define WAVE_ARBITRAGE_COMPACTION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "market_data.pb.h"
+
+using std::string;
+
+// Rewrites processed day files so that the feeds have less to decode and
+// replay. The compacted files have the same layout, so IEXFeed reads them
+// when IEX_DATA_ROOT points at the compacted root.
+//
+// Dropping the events that aren't trades doesn't change any results, since
+// the feeds skip them anyway. Collapsing trades does: WaveArbitrage checks
+// each price event against thresholds it set on the one before, so a
+// repeated price right after a rebalance can rebalance again. Returns over a
+// compacted root are close to, but not the same as, those over the original.
+struct CompactionOptions {
+  // Keep only the trades, and the first event of each day, which the feeds
+  // never read.
+  bool drop_other_events = true;
+  // Fold trades at the same nanosecond into one at the last of their prices.
+  bool merge_bursts = true;
+  // Fold trades at the same price as the trade before into that trade.
+  bool collapse_repeats = true;
+};
+
+// How much compaction shrank the data. Shares are summed into the trades that
+// are kept, so shares_out only falls short of shares_in if a sum overflowed.
+struct CompactionStats {
+  int64_t files = 0;
+  int64_t events_in = 0;
+  int64_t events_out = 0;
+  int64_t trades_in = 0;
+  int64_t trades_out = 0;
+  int64_t bytes_in = 0;
+  int64_t bytes_out = 0;
+  int64_t shares_in = 0;
+  int64_t shares_out = 0;
+
+  void merge(const CompactionStats &other) {
+    files += other.files;
+    events_in += other.events_in;
+    events_out += other.events_out;
+    trades_in += other.trades_in;
+    trades_out += other.trades_out;
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+    shares_in += other.shares_in;
+    shares_out += other.shares_out;
+  }
+
+  string to_string() const {
+    auto line = [](const string &name, int64_t in, int64_t out) {
+      char buf[128];
+      snprintf(buf, sizeof(buf), "%s: %ld -> %ld (%.1lf%%)\n", name.c_str(),
+               in, out, in ? 100.0 * out / in : 100.0);
+      return string(buf);
+    };
+    return "files: " + std::to_string(files) + "\n" +
+           line("events", events_in, events_out) +
+           line("trades", trades_in, trades_out) +
+           line("bytes", bytes_in, bytes_out) +
+           line("shares", shares_in, shares_out);
+  }
+};
+
+// Compacts one day's events into out. Trades are folded within the day only.
+inline CompactionStats compact_events(const market_data::Events &in,
+                                      const CompactionOptions &options,
+                                      market_data::Events *out) {
+  CompactionStats stats;
+  stats.events_in = in.events_size();
+
+  auto add_shares = [](market_data::Trade *trade, int64_t shares) {
+    trade->set_shares(std::min<int64_t>(
+        static_cast<int64_t>(trade->shares()) + shares,
+        std::numeric_limits<int32_t>::max()));
+  };
+  auto same_time = [](const market_data::Trade &a,
+                      const market_data::Trade &b) {
+    return a.timestamp().seconds() == b.timestamp().seconds() &&
+           a.timestamp().nanos() == b.timestamp().nanos();
+  };
+
+  // The indexes into out of the last two trades that were kept, or -1.
+  int last = -1;
+  int before_last = -1;
+  for (int e = 0; e < in.events_size(); e++) {
+    const auto &event = in.events(e);
+    if (event.has_trade()) {
+      stats.trades_in++;
+      stats.shares_in += event.trade().shares();
+    }
+
+    if (e == 0 || !event.has_trade()) {
+      if (e == 0 || !options.drop_other_events) {
+        *out->add_events() = event;
+      }
+      continue;
+    }
+
+    const auto &trade = event.trade();
+    if (last >= 0) {
+      market_data::Trade *kept = out->mutable_events(last)->mutable_trade();
+      if (options.merge_bursts && same_time(*kept, trade)) {
+        kept->set_price(trade.price());
+        add_shares(kept, trade.shares());
+        // A burst that ends where the trade before it was is a repeat too.
+        if (options.collapse_repeats && before_last >= 0 &&
+            last == out->events_size() - 1 &&
+            out->events(before_last).trade().price() == kept->price()) {
+          add_shares(out->mutable_events(before_last)->mutable_trade(),
+                     kept->shares());
+          out->mutable_events()->RemoveLast();
+          last = before_last;
+          before_last = -1;
+        }
+        continue;
+      }
+      if (options.collapse_repeats && kept->price() == trade.price()) {
+        add_shares(kept, trade.shares());
+        continue;
+      }
+    }
+    *out->add_events() = event;
+    before_last = last;
+    last = out->events_size() - 1;
+  }
+
+  stats.events_out = out->events_size();
+  for (int e = 0; e < out->events_size(); e++) {
+    if (out->events(e).has_trade()) {
+      stats.trades_out++;
+      stats.shares_out += out->events(e).trade().shares();
+    }
+  }
+  return stats;
+}
+
+inline CompactionStats compact_day_file(const string &in_filename,
+                                        const string &out_filename,
+                                        const CompactionOptions &options) {
+  market_data::Events in;
+  {
+    std::ifstream stream(in_filename, std::ios::in | std::ios::binary);
+    CHECK(in.ParseFromIstream(&stream)) << in_filename;
+  }
+  market_data::Events out;
+  CompactionStats stats = compact_events(in, options, &out);
+  {
+    std::ofstream stream(out_filename, std::ios::out | std::ios::binary);
+    CHECK(out.SerializeToOstream(&stream)) << out_filename;
+  }
+  stats.files = 1;
+  stats.bytes_in = std::filesystem::file_size(in_filename);
+  stats.bytes_out = std::filesystem::file_size(out_filename);
+  return stats;
+}
+
+// Compacts every day file in in_root/processed into out_root/processed on
+// num_threads threads, or one per core if that's 0, and copies the dividend
+// files over. The totals are also written to out_root/compaction.txt.
+inline CompactionStats compact_iex(const string &in_root,
+                                   const string &out_root,
+                                   const CompactionOptions &options,
+                                   unsigned num_threads = 0) {
+  CHECK(std::filesystem::absolute(in_root) !=
+        std::filesystem::absolute(out_root))
+      << "Compacting " << in_root << " in place";
+  std::filesystem::create_directories(out_root + "/processed");
+  std::filesystem::create_directories(out_root + "/dividends");
+
+  std::vector<string> names;
+  for (const auto &f :
+       std::filesystem::directory_iterator(in_root + "/processed")) {
+    // Empty files are left out of the listing by the feeds anyway.
+    if (f.is_regular_file() && f.file_size()) {
+      names.push_back(f.path().filename());
+    }
+  }
+  std::sort(names.begin(), names.end());
+
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  CompactionStats stats;
+  std::mutex mu;
+  std::atomic<size_t> next = 0;
+  std::vector<std::thread> threads;
+  for (unsigned tx = 0; tx < num_threads; tx++) {
+    threads.push_back(std::thread([&]() {
+      CompactionStats thread_stats;
+      size_t n;
+      while ((n = next.fetch_add(1)) < names.size()) {
+        thread_stats.merge(
+            compact_day_file(in_root + "/processed/" + names[n],
+                             out_root + "/processed/" + names[n], options));
+      }
+      std::scoped_lock<std::mutex> lock(mu);
+      stats.merge(thread_stats);
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (std::filesystem::exists(in_root + "/dividends")) {
+    std::filesystem::copy(
+        in_root + "/dividends", out_root + "/dividends",
+        std::filesystem::copy_options::recursive |
+            std::filesystem::copy_options::overwrite_existing);
+  }
+
+  std::ofstream(out_root + "/compaction.txt") << stats.to_string();
+  return stats;
+}
+
+#endif // WAVE_ARBITRAGE_COMPACTION_H
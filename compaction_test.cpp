@@ -0,0 +1,172 @@
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+#include <glog/logging.h>
+
+#include "compaction.h"
+#include "feed.h"
+#include "gtest/gtest.h"
+#include "synthetic_data_testing.h"
+
+void add_trade(market_data::Events *events, int64_t seconds, int32_t price,
+               int32_t shares) {
+  auto *trade = events->add_events()->mutable_trade();
+  trade->set_symbol("FOO");
+  trade->mutable_timestamp()->set_seconds(seconds);
+  trade->set_price(price);
+  trade->set_shares(shares);
+}
+
+void add_quote(market_data::Events *events, int64_t seconds) {
+  auto *quote = events->add_events()->mutable_quote_update();
+  quote->set_symbol("FOO");
+  quote->mutable_timestamp()->set_seconds(seconds);
+}
+
+// (seconds, price, shares) of every trade after the first event.
+std::vector<std::tuple<int64_t, int32_t, int32_t>>
+trades(const market_data::Events &events) {
+  std::vector<std::tuple<int64_t, int32_t, int32_t>> res;
+  for (int e = 1; e < events.events_size(); e++) {
+    if (events.events(e).has_trade()) {
+      const auto &trade = events.events(e).trade();
+      res.push_back(std::make_tuple(trade.timestamp().seconds(),
+                                    trade.price(), trade.shares()));
+    }
+  }
+  return res;
+}
+
+market_data::Events example_day() {
+  market_data::Events events;
+  // The feed never reads the first event, so it stays even if it's a trade.
+  add_trade(&events, 0, 500000, 1);
+  add_trade(&events, 1, 100000, 10);
+  add_quote(&events, 1);
+  add_trade(&events, 2, 100000, 20);
+  add_trade(&events, 3, 100000, 30);
+  add_trade(&events, 4, 110000, 40);
+  // A burst that ends back at the price before it.
+  add_trade(&events, 5, 120000, 50);
+  add_trade(&events, 5, 110000, 60);
+  add_quote(&events, 5);
+  add_trade(&events, 6, 110000, 70);
+  // A burst that moves the price.
+  add_trade(&events, 7, 100000, 80);
+  add_trade(&events, 7, 130000, 90);
+  add_trade(&events, 8, 100000, 100);
+  return events;
+}
+
+TEST(CompactionTest, CompactEvents) {
+  const market_data::Events in = example_day();
+  market_data::Events out;
+  const CompactionStats stats = compact_events(in, CompactionOptions(), &out);
+
+  ASSERT_TRUE(out.events(0).has_trade());
+  EXPECT_EQ(out.events(0).trade().price(), 500000);
+  EXPECT_EQ(trades(out), (std::vector<std::tuple<int64_t, int32_t, int32_t>>{
+                             {1, 100000, 60},
+                             {4, 110000, 220},
+                             {7, 130000, 170},
+                             {8, 100000, 100}}));
+  EXPECT_EQ(stats.events_in, 13);
+  EXPECT_EQ(stats.events_out, 5);
+  EXPECT_EQ(stats.trades_in, 11);
+  EXPECT_EQ(stats.trades_out, 5);
+  EXPECT_EQ(stats.shares_in, 551);
+  EXPECT_EQ(stats.shares_out, 551);
+}
+
+TEST(CompactionTest, Options) {
+  const market_data::Events in = example_day();
+
+  CompactionOptions only_events;
+  only_events.merge_bursts = false;
+  only_events.collapse_repeats = false;
+  market_data::Events out;
+  compact_events(in, only_events, &out);
+  EXPECT_EQ(out.events_size(), 11);
+  EXPECT_EQ(trades(out), trades(in));
+
+  CompactionOptions only_repeats;
+  only_repeats.drop_other_events = false;
+  only_repeats.merge_bursts = false;
+  out.Clear();
+  compact_events(in, only_repeats, &out);
+  EXPECT_EQ(trades(out), (std::vector<std::tuple<int64_t, int32_t, int32_t>>{
+                             {1, 100000, 60},
+                             {4, 110000, 40},
+                             {5, 120000, 50},
+                             {5, 110000, 130},
+                             {7, 100000, 80},
+                             {7, 130000, 90},
+                             {8, 100000, 100}}));
+  EXPECT_EQ(out.events_size(), 10);
+
+  // Sums that don't fit are capped.
+  market_data::Events big;
+  add_trade(&big, 0, 100000, 1);
+  add_trade(&big, 1, 100000, 2000000000);
+  add_trade(&big, 2, 100000, 2000000000);
+  out.Clear();
+  const CompactionStats stats = compact_events(big, CompactionOptions(), &out);
+  EXPECT_EQ(std::get<2>(trades(out)[0]),
+            std::numeric_limits<int32_t>::max());
+  EXPECT_LT(stats.shares_out, stats.shares_in);
+}
+
+TEST(CompactionTest, CompactRoot) {
+  const string in_root = test_data_root("compaction_in");
+  const string out_root = ::testing::TempDir() + "/compaction_out";
+  std::filesystem::remove_all(out_root);
+  SyntheticIEXConfig config;
+  config.num_symbols = 2;
+  config.num_days = 5;
+  config.trades_per_day = 500.0;
+  config.dividend_probability = 0.5;
+  const auto symbols = write_test_data("compaction_in", config);
+
+  const CompactionStats stats =
+      compact_iex(in_root, out_root, CompactionOptions(), /*num_threads=*/3);
+  EXPECT_EQ(stats.files, 10);
+  EXPECT_LT(stats.bytes_out, stats.bytes_in);
+  EXPECT_LT(stats.trades_out, stats.trades_in);
+  EXPECT_EQ(stats.shares_out, stats.shares_in);
+  EXPECT_TRUE(std::filesystem::exists(out_root + "/compaction.txt"));
+  for (const auto &symbol : symbols) {
+    EXPECT_TRUE(
+        std::filesystem::exists(out_root + "/dividends/" + symbol + ".csv"));
+  }
+
+  // The feed reads the compacted files the same way, and sees the same
+  // prices in the same order, minus the repeats.
+  for (const auto &f :
+       std::filesystem::directory_iterator(in_root + "/processed")) {
+    const string name = f.path().filename();
+    TradeReader original;
+    TradeReader compacted;
+    original.open(f.path());
+    compacted.open(out_root + "/processed/" + name);
+    original.skip_event();
+    compacted.skip_event();
+    int32_t last_price = -1;
+    while (original.next_trade()) {
+      if (original.trade().price() == last_price) {
+        continue;
+      }
+      last_price = original.trade().price();
+      ASSERT_TRUE(compacted.next_trade()) << name;
+      EXPECT_EQ(compacted.trade().price(), last_price) << name;
+    }
+    EXPECT_FALSE(compacted.next_trade()) << name;
+  }
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,488 @@
+#ifndef WAVE_ARBITRAGE_COORDINATOR_H
+#define WAVE_ARBITRAGE_COORDINATOR_H
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "util.h"
+
+using std::string;
+
+// Splits a backtest into units of pairs and hands them to worker processes
+// over a Unix domain socket. Each message is framed as a uint32 payload length,
+// a uint8 message type, and the payload:
+//
+//   worker -> coordinator  kRequestWork  (empty)
+//   coordinator -> worker  kWorkUnit     id, pairs
+//   worker -> coordinator  kWorkResult   id, stats, histogram quantiles,
+//                                        per-pair values
+//   coordinator -> worker  kNoMoreWork   (empty)
+//
+// A unit whose worker disconnects before sending its result goes back on the
+// queue, and a result for a unit that is already done is dropped.
+namespace coordinator {
+
+static constexpr uint8_t kRequestWork = 1;
+static constexpr uint8_t kWorkUnit = 2;
+static constexpr uint8_t kWorkResult = 3;
+static constexpr uint8_t kNoMoreWork = 4;
+
+struct PairResult {
+  string first;
+  string second;
+  double bh_value;
+  double wave_value;
+};
+
+// Builds and parses message payloads.
+class Message {
+public:
+  Message() {}
+
+  Message(string data) : data_(std::move(data)) {}
+
+  const string &data() const { return data_; }
+
+  template <typename T> void put(T val) {
+    data_.append(reinterpret_cast<const char *>(&val), sizeof(val));
+  }
+
+  void put_string(const string &str) {
+    put<uint32_t>(str.size());
+    data_.append(str);
+  }
+
+  void put_stats(const WelfordRunningStatistics &stats) {
+    put<int64_t>(stats.count());
+    put<double>(stats.mean());
+    put<double>(stats.m2());
+  }
+
+  template <typename T> T get() {
+    T val;
+    CHECK_LE(pos_ + sizeof(val), data_.size());
+    memcpy(&val, data_.data() + pos_, sizeof(val));
+    pos_ += sizeof(val);
+    return val;
+  }
+
+  string get_string() {
+    const uint32_t size = get<uint32_t>();
+    CHECK_LE(pos_ + size, data_.size());
+    string str = data_.substr(pos_, size);
+    pos_ += size;
+    return str;
+  }
+
+  // Like get() and get_string(), but for messages from clients that can't be
+  // trusted to be well formed. Return false if the message is too short.
+  template <typename T> bool try_get(T *val) {
+    if (data_.size() - pos_ < sizeof(*val)) {
+      return false;
+    }
+    *val = get<T>();
+    return true;
+  }
+
+  bool try_get_string(string *str) {
+    const size_t start = pos_;
+    uint32_t size;
+    if (!try_get(&size) || data_.size() - pos_ < size) {
+      pos_ = start;
+      return false;
+    }
+    *str = data_.substr(pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  // Returns true once everything has been read.
+  bool done() const { return pos_ == data_.size(); }
+
+  void get_stats(WelfordRunningStatistics *stats) {
+    const int64_t count = get<int64_t>();
+    const double mean = get<double>();
+    const double m2 = get<double>();
+    stats->merge(count, mean, m2);
+  }
+
+private:
+  string data_;
+  size_t pos_ = 0;
+};
+
+// Returns false if the peer has gone away.
+inline bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool read_all(int fd, char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = read(fd, data, size);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool send_message(int fd, uint8_t type,
+                         const Message &message = Message()) {
+  const uint32_t size = message.data().size();
+  char header[5];
+  memcpy(header, &size, sizeof(size));
+  header[4] = type;
+  return write_all(fd, header, sizeof(header)) &&
+         write_all(fd, message.data().data(), size);
+}
+
+inline bool receive_message(int fd, uint8_t *type, Message *message) {
+  char header[5];
+  if (!read_all(fd, header, sizeof(header))) {
+    return false;
+  }
+  uint32_t size;
+  memcpy(&size, header, sizeof(size));
+  *type = header[4];
+  string data(size, '\0');
+  if (!read_all(fd, data.data(), size)) {
+    return false;
+  }
+  *message = Message(std::move(data));
+  return true;
+}
+
+inline sockaddr_un socket_address(const string &socket_path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  CHECK_LT(socket_path.size(), sizeof(addr.sun_path)) << socket_path;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  return addr;
+}
+
+} // namespace coordinator
+
+// Hands out work units and merges what comes back. serve() returns once every
+// unit has a result.
+class Coordinator {
+public:
+  Coordinator(const string &socket_path,
+              std::vector<std::vector<std::tuple<string, string>>> units,
+              WelfordRunningStatistics *bh_stats,
+              WelfordRunningStatistics *wave_stats,
+              DynamicHistogram *bh_hist, DynamicHistogram *wave_hist)
+      : socket_path_(socket_path), units_(std::move(units)),
+        bh_stats_(bh_stats), wave_stats_(wave_stats), bh_hist_(bh_hist),
+        wave_hist_(wave_hist) {
+    for (size_t id = 0; id < units_.size(); id++) {
+      pending_.push_back(id);
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(listen_fd_, 0);
+    unlink(socket_path_.c_str());
+    const sockaddr_un addr = coordinator::socket_address(socket_path_);
+    CHECK_EQ(bind(listen_fd_, reinterpret_cast<const sockaddr *>(&addr),
+                  sizeof(addr)),
+             0)
+        << socket_path_;
+    CHECK_EQ(listen(listen_fd_, SOMAXCONN), 0);
+  }
+
+  ~Coordinator() {
+    for (const auto &item : workers_) {
+      close(item.first);
+    }
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+
+  // Tells the coordinator about a worker process it started, so that serve()
+  // can tell when there is no worker left to do the pending units. The
+  // process is not reaped.
+  void add_worker_process(pid_t pid) {
+    worker_pids_.insert(pid);
+    has_worker_processes_ = true;
+  }
+
+  // Returns false if there are units left once every connected worker has
+  // gone away and every process from add_worker_process() has exited.
+  // Without any such processes, this waits for workers indefinitely.
+  bool serve() {
+    while (done_.size() < units_.size()) {
+      std::vector<pollfd> fds = {{listen_fd_, POLLIN, 0}};
+      for (const auto &item : workers_) {
+        fds.push_back({item.first, POLLIN, 0});
+      }
+      // Wakes up now and then to look for worker processes that exited
+      // before connecting.
+      CHECK_GE(poll(fds.data(), fds.size(), /*timeout=*/kPollMillis), 0);
+
+      if (fds[0].revents & POLLIN) {
+        const int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd >= 0) {
+          workers_[fd] = kNoUnit;
+        }
+      }
+      for (size_t i = 1; i < fds.size(); i++) {
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+          handle(fds[i].fd);
+        }
+      }
+      assign_waiting();
+
+      forget_exited_processes();
+      if (has_worker_processes_ && workers_.empty() && worker_pids_.empty()) {
+        LOG(ERROR) << "Every worker is gone with "
+                   << units_.size() - done_.size() << " units left";
+        return false;
+      }
+    }
+
+    for (const auto &item : workers_) {
+      coordinator::send_message(item.first, coordinator::kNoMoreWork);
+    }
+    return true;
+  }
+
+  const std::vector<coordinator::PairResult> &results() const {
+    return results_;
+  }
+
+  // The number of times a unit had to be handed out again.
+  size_t num_requeued() const { return num_requeued_; }
+
+private:
+  static constexpr size_t kNoUnit = static_cast<size_t>(-1);
+  static constexpr int kPollMillis = 100;
+
+  const string socket_path_;
+  const std::vector<std::vector<std::tuple<string, string>>> units_;
+  WelfordRunningStatistics *bh_stats_;
+  WelfordRunningStatistics *wave_stats_;
+  DynamicHistogram *bh_hist_;
+  DynamicHistogram *wave_hist_;
+
+  int listen_fd_;
+  // Maps each connected worker to the unit it is working on.
+  std::map<int, size_t> workers_;
+  // Workers that asked for work while none was pending.
+  std::deque<int> waiting_;
+  std::deque<size_t> pending_;
+  std::set<size_t> done_;
+  std::vector<coordinator::PairResult> results_;
+  size_t num_requeued_ = 0;
+  // The worker processes from add_worker_process() that are still running.
+  std::set<pid_t> worker_pids_;
+  bool has_worker_processes_ = false;
+
+  void handle(int fd) {
+    uint8_t type;
+    coordinator::Message message;
+    if (!coordinator::receive_message(fd, &type, &message)) {
+      drop(fd);
+      return;
+    }
+
+    if (type == coordinator::kWorkResult) {
+      merge(&message);
+      workers_[fd] = kNoUnit;
+    } else if (type == coordinator::kRequestWork) {
+      waiting_.push_back(fd);
+    } else {
+      LOG(ERROR) << "Unexpected message type " << static_cast<int>(type);
+      drop(fd);
+    }
+  }
+
+  void assign_waiting() {
+    while (!waiting_.empty() && !pending_.empty()) {
+      // A unit can be done by the time it comes up again, in which case the
+      // worker stays first in line for the next one.
+      const size_t id = pending_.front();
+      pending_.pop_front();
+      if (done_.count(id)) {
+        continue;
+      }
+      const int fd = waiting_.front();
+      waiting_.pop_front();
+
+      coordinator::Message message;
+      message.put<uint64_t>(id);
+      message.put<uint32_t>(units_[id].size());
+      for (const auto &pair : units_[id]) {
+        message.put_string(std::get<0>(pair));
+        message.put_string(std::get<1>(pair));
+      }
+      workers_[fd] = id;
+      if (!coordinator::send_message(fd, coordinator::kWorkUnit, message)) {
+        drop(fd);
+      }
+    }
+  }
+
+  // Leaves exited processes as zombies, so that whoever started them can
+  // still wait for them.
+  void forget_exited_processes() {
+    for (auto it = worker_pids_.begin(); it != worker_pids_.end();) {
+      siginfo_t info;
+      info.si_pid = 0;
+      if (waitid(P_PID, *it, &info, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+          info.si_pid != 0) {
+        it = worker_pids_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Forgets a worker and puts its unit back on the queue.
+  void drop(int fd) {
+    const size_t id = workers_[fd];
+    if (id != kNoUnit && !done_.count(id)) {
+      pending_.push_front(id);
+      num_requeued_++;
+    }
+    workers_.erase(fd);
+    waiting_.erase(std::remove(waiting_.begin(), waiting_.end(), fd),
+                   waiting_.end());
+    close(fd);
+  }
+
+  void merge(coordinator::Message *message) {
+    const size_t id = message->get<uint64_t>();
+    if (!done_.insert(id).second) {
+      return;
+    }
+
+    WelfordRunningStatistics bh_stats;
+    WelfordRunningStatistics wave_stats;
+    message->get_stats(&bh_stats);
+    message->get_stats(&wave_stats);
+    bh_stats_->merge(bh_stats.count(), bh_stats.mean(), bh_stats.m2());
+    wave_stats_->merge(wave_stats.count(), wave_stats.mean(),
+                       wave_stats.m2());
+
+    std::vector<double> quantiles(message->get<uint32_t>());
+    for (auto &q : quantiles) {
+      q = message->get<double>();
+    }
+    add_quantiles(quantiles, bh_stats.count(), bh_hist_);
+    for (auto &q : quantiles) {
+      q = message->get<double>();
+    }
+    add_quantiles(quantiles, wave_stats.count(), wave_hist_);
+
+    const uint32_t num_pairs = message->get<uint32_t>();
+    for (uint32_t p = 0; p < num_pairs; p++) {
+      coordinator::PairResult result;
+      result.first = message->get_string();
+      result.second = message->get_string();
+      result.bh_value = message->get<double>();
+      result.wave_value = message->get<double>();
+      results_.push_back(result);
+    }
+  }
+};
+
+// Runs a pair and returns the final BuyAndHold and WaveArbitrage values. The
+// interval statistics go into the given stats and histograms, like job().
+typedef std::function<std::tuple<double, double>(
+    const string &first, const string &second,
+    WelfordRunningStatistics *bh_stats, WelfordRunningStatistics *wave_stats,
+    DynamicHistogram *bh_hist, DynamicHistogram *wave_hist)>
+    PairJob;
+
+// Connects to a Coordinator and runs units until there are none left. Returns
+// false if the coordinator couldn't be reached or went away.
+inline bool run_worker(const string &socket_path, PairJob pair_job) {
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0);
+  const sockaddr_un addr = coordinator::socket_address(socket_path);
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr))) {
+    close(fd);
+    return false;
+  }
+
+  static constexpr size_t kMaxNumBuckets = 200;
+  bool ok = true;
+  while (true) {
+    uint8_t type;
+    coordinator::Message unit;
+    if (!coordinator::send_message(fd, coordinator::kRequestWork) ||
+        !coordinator::receive_message(fd, &type, &unit)) {
+      ok = false;
+      break;
+    }
+    if (type == coordinator::kNoMoreWork) {
+      break;
+    }
+    CHECK_EQ(type, coordinator::kWorkUnit);
+
+    const uint64_t id = unit.get<uint64_t>();
+    WelfordRunningStatistics bh_stats;
+    WelfordRunningStatistics wave_stats;
+    DynamicHistogram bh_hist(kMaxNumBuckets);
+    DynamicHistogram wave_hist(kMaxNumBuckets);
+    std::vector<coordinator::PairResult> results(unit.get<uint32_t>());
+    for (auto &result : results) {
+      result.first = unit.get_string();
+      result.second = unit.get_string();
+      std::tie(result.bh_value, result.wave_value) =
+          pair_job(result.first, result.second, &bh_stats, &wave_stats,
+                   &bh_hist, &wave_hist);
+    }
+
+    coordinator::Message message;
+    message.put<uint64_t>(id);
+    message.put_stats(bh_stats);
+    message.put_stats(wave_stats);
+    message.put<uint32_t>(kNumMergeQuantiles);
+    for (auto *hist : {&bh_hist, &wave_hist}) {
+      for (double quantile : histogram_quantiles(hist)) {
+        message.put<double>(quantile);
+      }
+    }
+    message.put<uint32_t>(results.size());
+    for (const auto &result : results) {
+      message.put_string(result.first);
+      message.put_string(result.second);
+      message.put<double>(result.bh_value);
+      message.put<double>(result.wave_value);
+    }
+    if (!coordinator::send_message(fd, coordinator::kWorkResult, message)) {
+      ok = false;
+      break;
+    }
+  }
+
+  close(fd);
+  return ok;
+}
+
+#endif // WAVE_ARBITRAGE_COORDINATOR_H
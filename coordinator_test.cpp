@@ -0,0 +1,216 @@
+#include <sys/wait.h>
+
+#include <glog/logging.h>
+
+#include "coordinator.h"
+#include "gtest/gtest.h"
+
+// Stands in for job(): the values are a function of the pair so that the
+// coordinator's results can be checked.
+std::tuple<double, double> fake_job(const string &first, const string &second,
+                                    WelfordRunningStatistics *bh_stats,
+                                    WelfordRunningStatistics *wave_stats,
+                                    DynamicHistogram *bh_hist,
+                                    DynamicHistogram *wave_hist) {
+  const double bh_value = first.size() + second.size();
+  const double wave_value = bh_value + 0.5;
+  for (int n = 0; n < 10; n++) {
+    bh_stats->update(bh_value + n);
+    wave_stats->update(wave_value + n);
+    bh_hist->addValue(bh_value + n);
+    wave_hist->addValue(wave_value + n);
+  }
+  return std::make_tuple(bh_value, wave_value);
+}
+
+std::vector<std::vector<std::tuple<string, string>>> make_units() {
+  std::vector<std::vector<std::tuple<string, string>>> units;
+  for (int u = 0; u < 12; u++) {
+    std::vector<std::tuple<string, string>> unit;
+    for (int p = 0; p < 3; p++) {
+      unit.push_back(std::make_tuple(string(u + 1, 'A'), string(p + 1, 'B')));
+    }
+    units.push_back(unit);
+  }
+  return units;
+}
+
+// Waits for start_fd to close before connecting.
+pid_t fork_worker(const string &socket_path, int start_fd) {
+  const pid_t pid = fork();
+  CHECK_GE(pid, 0);
+  if (pid == 0) {
+    char unused;
+    CHECK_EQ(read(start_fd, &unused, 1), 0);
+    _exit(run_worker(socket_path, fake_job) ? 0 : 1);
+  }
+  return pid;
+}
+
+// Takes a unit and then goes away without answering, which closes done_fd.
+pid_t fork_dying_worker(const string &socket_path, int done_fd) {
+  const pid_t pid = fork();
+  CHECK_GE(pid, 0);
+  if (pid == 0) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    const sockaddr_un addr = coordinator::socket_address(socket_path);
+    CHECK_EQ(
+        connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)),
+        0);
+    uint8_t type;
+    coordinator::Message unit;
+    CHECK(coordinator::send_message(fd, coordinator::kRequestWork));
+    CHECK(coordinator::receive_message(fd, &type, &unit));
+    _exit(type == coordinator::kWorkUnit ? 0 : 1);
+  }
+  return pid;
+}
+
+TEST(CoordinatorTest, MessageRoundTrip) {
+  WelfordRunningStatistics stats;
+  for (double v : {1.0, 2.0, 4.0}) {
+    stats.update(v);
+  }
+
+  coordinator::Message message;
+  message.put<uint32_t>(7);
+  message.put_string("FOO");
+  message.put_stats(stats);
+
+  coordinator::Message parsed(message.data());
+  WelfordRunningStatistics merged;
+  EXPECT_EQ(parsed.get<uint32_t>(), 7);
+  EXPECT_EQ(parsed.get_string(), "FOO");
+  parsed.get_stats(&merged);
+  EXPECT_EQ(merged.count(), 3);
+  EXPECT_DOUBLE_EQ(merged.mean(), stats.mean());
+  EXPECT_DOUBLE_EQ(merged.variance(), stats.variance());
+
+  // A string that claims to be longer than what's left.
+  coordinator::Message truncated(message.data().substr(0, 6));
+  uint32_t value;
+  string str;
+  EXPECT_TRUE(truncated.try_get(&value));
+  EXPECT_EQ(value, 7);
+  EXPECT_FALSE(truncated.try_get_string(&str));
+  uint64_t too_wide;
+  EXPECT_FALSE(truncated.try_get(&too_wide));
+  uint16_t narrow;
+  EXPECT_TRUE(truncated.try_get(&narrow));
+  EXPECT_EQ(narrow, 3);
+  EXPECT_FALSE(truncated.try_get(&narrow));
+}
+
+TEST(CoordinatorTest, WelfordMerge) {
+  WelfordRunningStatistics all;
+  WelfordRunningStatistics first;
+  WelfordRunningStatistics second;
+  for (int n = 0; n < 100; n++) {
+    const double value = (n * 37) % 11;
+    all.update(value);
+    (n < 30 ? first : second).update(value);
+  }
+  first.merge(second.count(), second.mean(), second.m2());
+  EXPECT_EQ(first.count(), all.count());
+  EXPECT_NEAR(first.mean(), all.mean(), 1e-12);
+  EXPECT_NEAR(first.variance(), all.variance(), 1e-12);
+}
+
+TEST(CoordinatorTest, MergesWorkerResults) {
+  const string socket_path =
+      "/tmp/coordinator_test." + std::to_string(getpid());
+  WelfordRunningStatistics bh_stats;
+  WelfordRunningStatistics wave_stats;
+  DynamicHistogram bh_hist(200);
+  DynamicHistogram wave_hist(200);
+  Coordinator coord(socket_path, make_units(), &bh_stats, &wave_stats,
+                    &bh_hist, &wave_hist);
+
+  // The other workers start once the dying one has taken its unit, so that
+  // there is always a unit to take.
+  int start_pipe[2];
+  ASSERT_EQ(pipe(start_pipe), 0);
+  std::vector<pid_t> pids = {fork_dying_worker(socket_path, start_pipe[1])};
+  close(start_pipe[1]);
+  for (int w = 0; w < 3; w++) {
+    pids.push_back(fork_worker(socket_path, start_pipe[0]));
+  }
+  close(start_pipe[0]);
+  for (pid_t pid : pids) {
+    coord.add_worker_process(pid);
+  }
+  EXPECT_TRUE(coord.serve());
+  for (pid_t pid : pids) {
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+  }
+
+  WelfordRunningStatistics expected_bh;
+  WelfordRunningStatistics expected_wave;
+  DynamicHistogram unused_bh(200);
+  DynamicHistogram unused_wave(200);
+  std::map<std::tuple<string, string>, std::tuple<double, double>> expected;
+  for (const auto &unit : make_units()) {
+    for (const auto &pair : unit) {
+      expected[pair] = fake_job(std::get<0>(pair), std::get<1>(pair),
+                                &expected_bh, &expected_wave, &unused_bh,
+                                &unused_wave);
+    }
+  }
+
+  EXPECT_EQ(coord.num_requeued(), 1);
+  ASSERT_EQ(coord.results().size(), expected.size());
+  for (const auto &result : coord.results()) {
+    const auto &values = expected[std::make_tuple(result.first,
+                                                  result.second)];
+    EXPECT_EQ(result.bh_value, std::get<0>(values));
+    EXPECT_EQ(result.wave_value, std::get<1>(values));
+  }
+  EXPECT_EQ(bh_stats.count(), expected_bh.count());
+  EXPECT_NEAR(bh_stats.mean(), expected_bh.mean(), 1e-9);
+  EXPECT_NEAR(bh_stats.variance(), expected_bh.variance(), 1e-9);
+  EXPECT_NEAR(wave_stats.mean(), expected_wave.mean(), 1e-9);
+}
+
+TEST(CoordinatorTest, FailsWhenEveryWorkerDies) {
+  const string socket_path =
+      "/tmp/coordinator_test_dies." + std::to_string(getpid());
+  WelfordRunningStatistics bh_stats;
+  WelfordRunningStatistics wave_stats;
+  DynamicHistogram bh_hist(200);
+  DynamicHistogram wave_hist(200);
+  Coordinator coord(socket_path, make_units(), &bh_stats, &wave_stats,
+                    &bh_hist, &wave_hist);
+
+  // One worker dies after taking a unit, and the other before connecting.
+  int unused_pipe[2];
+  ASSERT_EQ(pipe(unused_pipe), 0);
+  std::vector<pid_t> pids = {fork_dying_worker(socket_path, unused_pipe[1])};
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    _exit(1);
+  }
+  pids.push_back(pid);
+  close(unused_pipe[0]);
+  close(unused_pipe[1]);
+  for (pid_t pid : pids) {
+    coord.add_worker_process(pid);
+  }
+
+  EXPECT_FALSE(coord.serve());
+  EXPECT_TRUE(coord.results().empty());
+  // The processes are left for the caller to reap.
+  for (pid_t pid : pids) {
+    EXPECT_EQ(waitpid(pid, nullptr, 0), pid);
+  }
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
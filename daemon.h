@@ -0,0 +1,447 @@
+#ifndef WAVE_ARBITRAGE_DAEMON_H
+#define WAVE_ARBITRAGE_DAEMON_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "coordinator.h"
+#include "fan_out.h"
+#include "range_index.h"
+#include "shared_segment.h"
+#include "trace.h"
+#include "util.h"
+
+using std::string;
+
+// Runs backtests for clients over a Unix domain socket, out of decoded trades
+// that stay mapped between jobs. A job starts without listing directories,
+// reading dividend files or decoding day files. Messages are framed like the
+// coordinator's:
+//
+//   client -> daemon  kRunJob      JobSpec
+//   daemon -> client  kPairResult  first, second, one value per strategy
+//   daemon -> client  kJobResult   per strategy: stats, histogram quantiles
+//   daemon -> client  kJobError    what was wrong with the job
+//   client -> daemon  kShutdown    (empty)
+//
+// The pair results stream back as the pairs finish, in no particular order,
+// and kJobResult comes after the last of them. A client can send any number
+// of jobs on one connection.
+namespace backtest_daemon {
+
+static constexpr uint8_t kRunJob = 1;
+static constexpr uint8_t kPairResult = 2;
+static constexpr uint8_t kJobResult = 3;
+static constexpr uint8_t kJobError = 4;
+static constexpr uint8_t kShutdown = 5;
+
+struct JobSpec {
+  std::vector<std::tuple<string, string>> pairs;
+  // Registered strategy specs. See StrategyRegistry.
+  std::vector<string> strategies;
+  double cash = 100000.0;
+  // YYYYMMDD, or empty to start at the beginning of the data.
+  string first_date;
+  // YYYYMMDD, exclusive, or empty to run to the end of the data.
+  string end_date;
+  // Leaves out stretches where none of the strategies would trade. The
+  // results are the same either way.
+  bool skip_idle_ranges = true;
+
+  void put(coordinator::Message *message) const {
+    message->put<uint32_t>(pairs.size());
+    for (const auto &[first, second] : pairs) {
+      message->put_string(first);
+      message->put_string(second);
+    }
+    message->put<uint32_t>(strategies.size());
+    for (const auto &strategy : strategies) {
+      message->put_string(strategy);
+    }
+    message->put<double>(cash);
+    message->put_string(first_date);
+    message->put_string(end_date);
+    message->put<uint8_t>(skip_idle_ranges);
+  }
+
+  // Returns false if the message is too short to hold a job, or has bytes
+  // left over.
+  static bool get(coordinator::Message *message, JobSpec *spec) {
+    uint32_t num_pairs;
+    if (!message->try_get(&num_pairs)) {
+      return false;
+    }
+    // Grown as the pairs are read, since the count could be anything.
+    for (uint32_t p = 0; p < num_pairs; p++) {
+      string first;
+      string second;
+      if (!message->try_get_string(&first) ||
+          !message->try_get_string(&second)) {
+        return false;
+      }
+      spec->pairs.push_back({first, second});
+    }
+    uint32_t num_strategies;
+    if (!message->try_get(&num_strategies)) {
+      return false;
+    }
+    for (uint32_t s = 0; s < num_strategies; s++) {
+      string strategy;
+      if (!message->try_get_string(&strategy)) {
+        return false;
+      }
+      spec->strategies.push_back(strategy);
+    }
+    uint8_t skip_idle_ranges;
+    if (!message->try_get(&spec->cash) ||
+        !message->try_get_string(&spec->first_date) ||
+        !message->try_get_string(&spec->end_date) ||
+        !message->try_get(&skip_idle_ranges) || !message->done()) {
+      return false;
+    }
+    spec->skip_idle_ranges = skip_idle_ranges;
+    return true;
+  }
+};
+
+struct PairValues {
+  string first;
+  string second;
+  // In the order of the job's strategies.
+  std::vector<double> values;
+};
+
+// Midnight UTC of a YYYYMMDD date in seconds since the epoch, or -1 if it
+// isn't one.
+inline int64_t date_seconds(const string &date) {
+  tm t{};
+  if (date.size() != 8 ||
+      strptime(date.c_str(), "%Y%m%d", &t) != date.c_str() + date.size()) {
+    return -1;
+  }
+  return timegm(&t);
+}
+
+} // namespace backtest_daemon
+
+class BacktestDaemon {
+public:
+  // Serves the symbols in the segment. Jobs run their pairs on num_threads
+  // threads, or one per core if that's 0.
+  BacktestDaemon(const string &socket_path,
+                 std::unique_ptr<SharedTradeSegment> segment,
+                 unsigned num_threads = 0,
+                 const StrategyRegistry &registry = StrategyRegistry::global())
+      : socket_path_(socket_path), segment_(std::move(segment)),
+        registry_(registry) {
+    CHECK(segment_);
+    for (const auto &symbol : segment_->symbols()) {
+      symbols_.insert(symbol);
+    }
+    num_threads_ = num_threads;
+    if (num_threads_ == 0) {
+      num_threads_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(listen_fd_, 0);
+    unlink(socket_path_.c_str());
+    const sockaddr_un addr = coordinator::socket_address(socket_path_);
+    CHECK_EQ(bind(listen_fd_, reinterpret_cast<const sockaddr *>(&addr),
+                  sizeof(addr)),
+             0)
+        << socket_path_;
+    CHECK_EQ(listen(listen_fd_, SOMAXCONN), 0) << socket_path_;
+  }
+
+  ~BacktestDaemon() {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+
+  size_t num_symbols() const { return symbols_.size(); }
+
+  // Serves one client at a time until one of them sends kShutdown.
+  void serve() {
+    while (true) {
+      const int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0) {
+        PLOG(WARNING) << "accept";
+        continue;
+      }
+      const bool shutdown = handle(fd);
+      close(fd);
+      if (shutdown) {
+        return;
+      }
+    }
+  }
+
+private:
+  const string socket_path_;
+  const std::unique_ptr<SharedTradeSegment> segment_;
+  const StrategyRegistry &registry_;
+  std::set<string> symbols_;
+  unsigned num_threads_;
+  int listen_fd_;
+
+  // Returns true if the client asked the daemon to shut down.
+  bool handle(int fd) {
+    while (true) {
+      uint8_t type;
+      coordinator::Message message;
+      if (!coordinator::receive_message(fd, &type, &message)) {
+        return false;
+      }
+      if (type == backtest_daemon::kShutdown) {
+        return true;
+      }
+      if (type != backtest_daemon::kRunJob) {
+        LOG(WARNING) << "Unexpected message type " << static_cast<int>(type);
+        return false;
+      }
+      backtest_daemon::JobSpec spec;
+      if (!backtest_daemon::JobSpec::get(&message, &spec)) {
+        coordinator::Message error;
+        error.put_string("Bad job message");
+        if (!coordinator::send_message(fd, backtest_daemon::kJobError,
+                                       error)) {
+          return false;
+        }
+        continue;
+      }
+      if (!run_job(fd, spec)) {
+        return false;
+      }
+    }
+  }
+
+  // Checks the job, and returns what's wrong with it, or an empty string.
+  string check(const backtest_daemon::JobSpec &spec, int64_t first_seconds,
+               int64_t end_seconds) const {
+    if (spec.strategies.empty()) {
+      return "No strategies";
+    }
+    for (const auto &strategy : spec.strategies) {
+      if (!registry_.contains(strategy)) {
+        return "No strategy named " + strategy;
+      }
+    }
+    if (!(spec.cash > 0.0)) {
+      return "Bad cash " + std::to_string(spec.cash);
+    }
+    if (first_seconds < 0) {
+      return "Bad first date " + spec.first_date;
+    }
+    if (end_seconds < 0) {
+      return "Bad end date " + spec.end_date;
+    }
+    for (const auto &[first, second] : spec.pairs) {
+      for (const auto &symbol : {first, second}) {
+        if (!symbols_.count(symbol)) {
+          return "No data for " + symbol;
+        }
+        if (!SharedIEXFeed::has_days(segment_->symbol(symbol), first_seconds,
+                                     end_seconds)) {
+          return "No trades for " + symbol + " in the date range";
+        }
+      }
+    }
+    // Makes each strategy once, so that bad arguments are turned away here
+    // instead of failing on a worker thread.
+    if (!spec.pairs.empty()) {
+      const auto &[first, second] = spec.pairs[0];
+      const std::vector<string> symbols = {first, second};
+      std::vector<double> prices;
+      for (const auto &symbol : symbols) {
+        const auto view = segment_->symbol(symbol);
+        prices.push_back(view.prices[0] / 10000.0);
+      }
+      for (const auto &strategy : spec.strategies) {
+        try {
+          registry_.make(strategy, spec.cash, SymbolTable::intern_all(symbols),
+                         prices);
+        } catch (const std::exception &e) {
+          return "Bad strategy " + strategy + ": " + e.what();
+        }
+      }
+    }
+    return "";
+  }
+
+  // Returns false if the client went away.
+  bool run_job(int fd, const backtest_daemon::JobSpec &spec) {
+    TraceSpan job_span("daemon job");
+    using backtest_daemon::date_seconds;
+    const int64_t first_seconds =
+        spec.first_date.empty() ? 0 : date_seconds(spec.first_date);
+    const int64_t end_seconds = spec.end_date.empty()
+                                    ? std::numeric_limits<int64_t>::max()
+                                    : date_seconds(spec.end_date);
+    const string error = check(spec, first_seconds, end_seconds);
+    if (!error.empty()) {
+      coordinator::Message message;
+      message.put_string(error);
+      return coordinator::send_message(fd, backtest_daemon::kJobError,
+                                       message);
+    }
+
+    static constexpr size_t kMaxNumBuckets = 200;
+    std::deque<ReturnStats> stats;
+    std::vector<FanOutEntry> entries;
+    for (const string &strategy : spec.strategies) {
+      stats.emplace_back(kMaxNumBuckets);
+      entries.push_back(
+          FanOutEntry{strategy, &stats.back().stats, &stats.back().hist});
+    }
+
+    std::mutex send_mu;
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> connected = true;
+    std::vector<std::thread> threads;
+    const size_t num_threads =
+        std::min<size_t>(num_threads_, spec.pairs.size());
+    for (size_t tx = 0; tx < num_threads; tx++) {
+      threads.push_back(std::thread([&]() {
+        Tracer::set_thread_name("daemon worker");
+        size_t p;
+        while (connected && (p = next.fetch_add(1)) < spec.pairs.size()) {
+          const auto &[first, second] = spec.pairs[p];
+          std::unique_ptr<Feed> feed = std::make_unique<SharedIEXFeed>(
+              /*symbols=*/std::vector<string>{first, second},
+              /*segment=*/segment_.get(), /*first_seconds=*/first_seconds,
+              /*end_seconds=*/end_seconds);
+          if (spec.skip_idle_ranges) {
+            feed = std::make_unique<RangeSkipFeed>(
+                std::move(feed), /*sample_interval_seconds=*/60);
+          }
+          const std::vector<double> values =
+              fan_out_job(/*feed=*/std::move(feed), /*cash=*/spec.cash,
+                          /*entries=*/entries, /*registry=*/registry_);
+
+          coordinator::Message message;
+          message.put_string(first);
+          message.put_string(second);
+          for (double value : values) {
+            message.put<double>(value);
+          }
+          TracedLock<std::mutex> lock(send_mu, "wait for send_mu");
+          if (!coordinator::send_message(fd, backtest_daemon::kPairResult,
+                                         message)) {
+            connected = false;
+          }
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    if (!connected) {
+      return false;
+    }
+
+    coordinator::Message message;
+    message.put<uint32_t>(kNumMergeQuantiles);
+    for (size_t s = 0; s < spec.strategies.size(); s++) {
+      message.put_stats(stats[s].stats);
+      for (double quantile : histogram_quantiles(&stats[s].hist)) {
+        message.put<double>(quantile);
+      }
+    }
+    return coordinator::send_message(fd, backtest_daemon::kJobResult,
+                                     message);
+  }
+};
+
+namespace backtest_daemon {
+
+// Connects to a daemon, or returns -1 if there's none at the path.
+inline int connect_to_daemon(const string &socket_path) {
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0);
+  const sockaddr_un addr = coordinator::socket_address(socket_path);
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr))) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Runs a job on the daemon at the other end of fd. on_pair is called for
+// each pair as its result comes in. The returns of each strategy over all
+// the pairs are merged into its stats and histogram. Returns false, with
+// error set, if the daemon rejected the job or went away.
+inline bool run_job(int fd, const JobSpec &spec,
+                    std::function<void(const PairValues &)> on_pair,
+                    const std::vector<WelfordRunningStatistics *> &stats,
+                    const std::vector<DynamicHistogram *> &hists,
+                    string *error) {
+  CHECK_EQ(stats.size(), spec.strategies.size());
+  CHECK_EQ(hists.size(), spec.strategies.size());
+  coordinator::Message request;
+  spec.put(&request);
+  if (!coordinator::send_message(fd, kRunJob, request)) {
+    *error = "The daemon went away";
+    return false;
+  }
+
+  while (true) {
+    uint8_t type;
+    coordinator::Message message;
+    if (!coordinator::receive_message(fd, &type, &message)) {
+      *error = "The daemon went away";
+      return false;
+    }
+    if (type == kJobError) {
+      *error = message.get_string();
+      return false;
+    } else if (type == kPairResult) {
+      PairValues pair;
+      pair.first = message.get_string();
+      pair.second = message.get_string();
+      for (size_t s = 0; s < spec.strategies.size(); s++) {
+        pair.values.push_back(message.get<double>());
+      }
+      on_pair(pair);
+    } else {
+      CHECK_EQ(type, kJobResult);
+      const uint32_t num_quantiles = message.get<uint32_t>();
+      for (size_t s = 0; s < spec.strategies.size(); s++) {
+        WelfordRunningStatistics job_stats;
+        message.get_stats(&job_stats);
+        std::vector<double> quantiles(num_quantiles);
+        for (auto &quantile : quantiles) {
+          quantile = message.get<double>();
+        }
+        stats[s]->merge(job_stats.count(), job_stats.mean(), job_stats.m2());
+        add_quantiles(quantiles, job_stats.count(), hists[s]);
+      }
+      return true;
+    }
+  }
+}
+
+inline bool shutdown_daemon(int fd) {
+  return coordinator::send_message(fd, kShutdown);
+}
+
+} // namespace backtest_daemon
+
+#endif // WAVE_ARBITRAGE_DAEMON_H
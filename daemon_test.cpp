@@ -0,0 +1,185 @@
+#include <map>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include "daemon.h"
+#include "gtest/gtest.h"
+#include "synthetic_data_testing.h"
+
+TEST(DaemonTest, DateSeconds) {
+  EXPECT_EQ(backtest_daemon::date_seconds("20180102"), 1514851200);
+  EXPECT_EQ(backtest_daemon::date_seconds("19700101"), 0);
+  EXPECT_EQ(backtest_daemon::date_seconds("2018012"), -1);
+  EXPECT_EQ(backtest_daemon::date_seconds("2018-01-02"), -1);
+  EXPECT_EQ(backtest_daemon::date_seconds(""), -1);
+}
+
+TEST(DaemonTest, Serve) {
+  SyntheticIEXConfig config;
+  config.num_symbols = 3;
+  config.num_days = 30;
+  config.trades_per_day = 300.0;
+  config.dividend_probability = 0.2;
+  const std::vector<string> symbols = write_test_data("daemon", config);
+
+  const string name = "/daemon_test." + std::to_string(getpid());
+  SharedTradeSegment::unlink(name);
+  auto segment = SharedTradeSegment::attach_or_publish(
+      name, symbols, IEXManifest::load(symbols));
+  SharedTradeSegment::unlink(name);
+  const SharedTradeSegment *segment_ptr = segment.get();
+
+  const string socket_path = ::testing::TempDir() + "/daemon_test.sock";
+  BacktestDaemon daemon(socket_path, std::move(segment), /*num_threads=*/2);
+  EXPECT_EQ(daemon.num_symbols(), 3);
+  std::thread server([&]() { daemon.serve(); });
+
+  const int fd = backtest_daemon::connect_to_daemon(socket_path);
+  ASSERT_GE(fd, 0);
+
+  backtest_daemon::JobSpec spec;
+  spec.pairs = {{symbols[0], symbols[1]},
+                {symbols[0], symbols[2]},
+                {symbols[1], symbols[2]}};
+  spec.strategies = {"BuyAndHold", "WaveArbitrage:1.001", "WaveArbitrage:1.01"};
+
+  // Each pair's values are the same as from a fan out over its day files.
+  auto expected_values = [&](const string &first, const string &second,
+                             int64_t first_seconds, int64_t end_seconds) {
+    std::vector<WelfordRunningStatistics> stats(spec.strategies.size());
+    std::deque<DynamicHistogram> hists;
+    std::vector<FanOutEntry> entries;
+    for (size_t s = 0; s < spec.strategies.size(); s++) {
+      hists.emplace_back(/*max_num_buckets=*/50);
+      entries.push_back(FanOutEntry{spec.strategies[s], &stats[s], &hists[s]});
+    }
+    std::unique_ptr<Feed> feed;
+    if (first_seconds == 0 && end_seconds == 0) {
+      feed = std::make_unique<IEXFeed>(std::vector<string>{first, second});
+    } else {
+      feed = std::make_unique<SharedIEXFeed>(
+          std::vector<string>{first, second}, segment_ptr, first_seconds,
+          end_seconds);
+    }
+    return fan_out_job(/*feed=*/std::move(feed), /*cash=*/spec.cash,
+                       /*entries=*/entries);
+  };
+
+  auto run = [&](const backtest_daemon::JobSpec &spec,
+                 std::map<std::tuple<string, string>, std::vector<double>>
+                     *values,
+                 string *error) {
+    std::deque<WelfordRunningStatistics> stats(spec.strategies.size());
+    std::deque<DynamicHistogram> hists;
+    std::vector<WelfordRunningStatistics *> stats_ptrs;
+    std::vector<DynamicHistogram *> hist_ptrs;
+    for (size_t s = 0; s < spec.strategies.size(); s++) {
+      hists.emplace_back(/*max_num_buckets=*/50);
+      stats_ptrs.push_back(&stats[s]);
+      hist_ptrs.push_back(&hists[s]);
+    }
+    return backtest_daemon::run_job(
+        fd, spec,
+        [&](const backtest_daemon::PairValues &pair) {
+          (*values)[std::make_tuple(pair.first, pair.second)] = pair.values;
+        },
+        stats_ptrs, hist_ptrs, error);
+  };
+
+  std::map<std::tuple<string, string>, std::vector<double>> values;
+  string error;
+  ASSERT_TRUE(run(spec, &values, &error)) << error;
+  ASSERT_EQ(values.size(), 3);
+  for (const auto &[first, second] : spec.pairs) {
+    EXPECT_EQ(values[std::make_tuple(first, second)],
+              expected_values(first, second, 0, 0))
+        << first << " " << second;
+  }
+  // The thresholds are told apart.
+  EXPECT_NE(values.begin()->second[1], values.begin()->second[2]);
+
+  // A second job on the same connection, over part of the data.
+  spec.first_date = "20180115";
+  spec.end_date = "20180201";
+  spec.skip_idle_ranges = false;
+  values.clear();
+  ASSERT_TRUE(run(spec, &values, &error)) << error;
+  ASSERT_EQ(values.size(), 3);
+  for (const auto &[first, second] : spec.pairs) {
+    EXPECT_EQ(values[std::make_tuple(first, second)],
+              expected_values(first, second,
+                              backtest_daemon::date_seconds("20180115"),
+                              backtest_daemon::date_seconds("20180201")))
+        << first << " " << second;
+  }
+
+  // Bad jobs are turned away without closing the connection.
+  const string threshold_usage = "WaveArbitrage needs a rebalance threshold "
+                                 "of at least 1, as in WaveArbitrage:1.001";
+  for (const auto &[field, value, message] :
+       std::vector<std::tuple<string, string, string>>{
+           {"strategy", "Nope", "No strategy named Nope"},
+           {"strategy", "WaveArbitrage:abc",
+            "Bad strategy WaveArbitrage:abc: " + threshold_usage},
+           {"strategy", "WaveArbitrage:1.01x",
+            "Bad strategy WaveArbitrage:1.01x: " + threshold_usage},
+           {"strategy", "WaveArbitrage",
+            "Bad strategy WaveArbitrage: " + threshold_usage},
+           {"strategy", "BuyAndHold:1",
+            "Bad strategy BuyAndHold:1: BuyAndHold takes no argument"},
+           {"symbol", "NOPE", "No data for NOPE"},
+           {"cash", "-1", "Bad cash -1.000000"},
+           {"first_date", "2018", "Bad first date 2018"},
+           {"first_date", "20190101",
+            "No trades for " + symbols[0] + " in the date range"}}) {
+    backtest_daemon::JobSpec bad = spec;
+    if (field == "strategy") {
+      bad.strategies.push_back(value);
+    } else if (field == "symbol") {
+      bad.pairs.push_back({symbols[0], value});
+    } else if (field == "cash") {
+      bad.cash = std::stod(value);
+    } else {
+      bad.first_date = value;
+      bad.end_date = "";
+    }
+    EXPECT_FALSE(run(bad, &values, &error));
+    EXPECT_EQ(error, message);
+  }
+
+  // So are messages that don't hold a whole job, or that hold more.
+  coordinator::Message request;
+  spec.put(&request);
+  coordinator::Message huge_count;
+  huge_count.put<uint32_t>(0xffffffff);
+  for (const string &data :
+       {request.data().substr(0, request.data().size() - 1),
+        request.data().substr(0, 9), string(), huge_count.data(),
+        request.data() + "x"}) {
+    ASSERT_TRUE(coordinator::send_message(fd, backtest_daemon::kRunJob,
+                                          coordinator::Message(data)));
+    uint8_t type;
+    coordinator::Message reply;
+    ASSERT_TRUE(coordinator::receive_message(fd, &type, &reply));
+    EXPECT_EQ(type, backtest_daemon::kJobError);
+    EXPECT_EQ(reply.get_string(), "Bad job message");
+  }
+
+  spec.first_date = "";
+  spec.end_date = "";
+  values.clear();
+  ASSERT_TRUE(run(spec, &values, &error)) << error;
+  EXPECT_EQ(values.size(), 3);
+
+  ASSERT_TRUE(backtest_daemon::shutdown_daemon(fd));
+  server.join();
+  close(fd);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,213 @@
+#ifndef WAVE_ARBITRAGE_FAN_OUT_H
+#define WAVE_ARBITRAGE_FAN_OUT_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+#include "job.h"
+#include "journal.h"
+#include "strategy.h"
+#include "trace.h"
+#include "util.h"
+
+using std::string;
+
+// Makes strategies by name, so that the variants to compare can be picked at
+// run time. A spec is a registered name, optionally followed by a colon and
+// an argument for the factory, as in "WaveArbitrage:1.001".
+class StrategyRegistry {
+public:
+  // The fill listener has to be passed on to the strategy's constructor, so
+  // that it hears about the opening buys.
+  typedef std::function<std::unique_ptr<Strategy>(
+      double cash, std::vector<SymbolId> symbol_ids,
+      const std::vector<double> &prices, const string &arg,
+      FillListener *fill_listener)>
+      Factory;
+
+  // Has BuyAndHold and WaveArbitrage, which takes its rebalance threshold as
+  // the argument. A factory that is given a bad argument throws
+  // std::invalid_argument.
+  static StrategyRegistry &global() {
+    static StrategyRegistry *registry = []() {
+      auto *registry = new StrategyRegistry();
+      registry->add("BuyAndHold",
+                    [](double cash, std::vector<SymbolId> symbol_ids,
+                       const std::vector<double> &prices, const string &arg,
+                       FillListener *fill_listener) {
+                      if (!arg.empty()) {
+                        throw std::invalid_argument(
+                            "BuyAndHold takes no argument");
+                      }
+                      return std::make_unique<BuyAndHold>(
+                          cash, std::move(symbol_ids), prices, fill_listener);
+                    });
+      registry->add("WaveArbitrage",
+                    [](double cash, std::vector<SymbolId> symbol_ids,
+                       const std::vector<double> &prices, const string &arg,
+                       FillListener *fill_listener) {
+                      return std::make_unique<WaveArbitrage>(
+                          cash, std::move(symbol_ids), prices,
+                          /*rebalance_threshold=*/rebalance_threshold(arg),
+                          fill_listener);
+                    });
+      return registry;
+    }();
+    return *registry;
+  }
+
+  void add(const string &name, Factory factory) {
+    CHECK(name.find(':') == string::npos) << name;
+    CHECK(factories_.emplace(name, std::move(factory)).second)
+        << name << " is already registered";
+  }
+
+  bool contains(const string &spec) const {
+    return factories_.count(spec.substr(0, spec.find(':')));
+  }
+
+  std::vector<string> names() const {
+    std::vector<string> names;
+    for (const auto &[name, factory] : factories_) {
+      names.push_back(name);
+    }
+    return names;
+  }
+
+  std::unique_ptr<Strategy> make(const string &spec, double cash,
+                                 std::vector<SymbolId> symbol_ids,
+                                 const std::vector<double> &prices,
+                                 FillListener *fill_listener = nullptr) const {
+    const size_t colon = spec.find(':');
+    const string name = spec.substr(0, colon);
+    const string arg = colon == string::npos ? "" : spec.substr(colon + 1);
+    auto found = factories_.find(name);
+    CHECK(found != factories_.end()) << "No strategy named " << name;
+    return found->second(cash, std::move(symbol_ids), prices, arg,
+                         fill_listener);
+  }
+
+private:
+  std::map<string, Factory> factories_;
+
+  static double rebalance_threshold(const string &arg) {
+    const string usage = "WaveArbitrage needs a rebalance threshold of at "
+                         "least 1, as in WaveArbitrage:1.001";
+    size_t end = 0;
+    double threshold = 0.0;
+    try {
+      threshold = std::stod(arg, &end);
+    } catch (const std::exception &) {
+      throw std::invalid_argument(usage);
+    }
+    if (end != arg.size() || !(threshold >= 1.0) || std::isinf(threshold)) {
+      throw std::invalid_argument(usage);
+    }
+    return threshold;
+  }
+};
+
+// A strategy for fan_out_job() to run, and where its returns go. Returns
+// over one year go into stats and hist, like job()'s, and returns over any
+// extra horizons are measured too.
+struct FanOutEntry {
+  string spec;
+  WelfordRunningStatistics *stats;
+  DynamicHistogram *hist;
+  std::vector<IntervalHorizon> horizons = {};
+};
+
+// Works like job(), but with any number of strategies on one pass over the
+// feed, so each extra strategy costs its own updates and not another replay.
+// With BuyAndHold and WaveArbitrage:<threshold> it gives the same results as
+// job(). Returns each strategy's final value, in the order of the entries.
+inline std::vector<double>
+fan_out_job(std::unique_ptr<Feed> feed, double cash,
+            const std::vector<FanOutEntry> &entries,
+            const StrategyRegistry &registry = StrategyRegistry::global(),
+            JournalWriter *journal_writer = nullptr) {
+  TraceSpan job_span("fan out job");
+  CHECK(!entries.empty());
+
+  std::vector<double> prices = feed->prices();
+
+  // The journal comes first, so that it gets the fills of the opening buys
+  // that the strategies make when they are constructed.
+  std::unique_ptr<PairJournal> journal;
+  if (journal_writer) {
+    // The specs, since two variants of one strategy share a name.
+    std::vector<string> names;
+    for (const auto &entry : entries) {
+      names.push_back(entry.spec);
+    }
+    journal = journal_writer->acquire(feed->symbols(), std::move(names));
+    journal->set_time(feed->timestamp().seconds());
+  }
+
+  // Everything a strategy needs per tick sits side by side, so the tick loop
+  // walks one array.
+  struct Slot {
+    std::unique_ptr<Strategy> strategy;
+    MultiIntervalStatistics si_stats;
+  };
+  Duration dur;
+  dur.set_seconds(365 * 24 * 60 * 60);
+  Duration cooldown;
+  cooldown.set_seconds(60);
+  std::vector<Slot> slots;
+  slots.reserve(entries.size());
+  for (size_t s = 0; s < entries.size(); s++) {
+    const FanOutEntry &entry = entries[s];
+    std::vector<IntervalHorizon> horizons = {{dur, entry.stats, entry.hist}};
+    horizons.insert(horizons.end(), entry.horizons.begin(),
+                    entry.horizons.end());
+    slots.push_back(
+        Slot{registry.make(entry.spec, cash, feed->symbol_ids(), prices,
+                           journal ? journal->listener(s) : nullptr),
+             MultiIntervalStatistics(horizons, cooldown)});
+  }
+
+  replay_ticks(
+      /*feed=*/feed.get(),
+      /*from_feed_price=*/[](double price) { return price; },
+      /*prices=*/&prices, /*journal=*/journal.get(),
+      /*for_each_strategy=*/
+      [&](auto visit) {
+        for (auto &slot : slots) {
+          visit(*slot.strategy);
+        }
+      },
+      /*sample=*/
+      [&](const Timestamp &timestamp) {
+        for (auto &slot : slots) {
+          const double value = slot.strategy->portfolio().value(prices);
+          slot.si_stats.update(value, timestamp);
+          if (journal) {
+            journal->add_value(value);
+          }
+        }
+      });
+
+  std::vector<double> values;
+  for (auto &slot : slots) {
+    values.push_back(slot.strategy->portfolio().value(prices));
+    if (journal) {
+      slot.strategy->set_fill_listener(nullptr);
+    }
+  }
+  if (journal) {
+    journal_writer->submit(std::move(journal));
+  }
+  return values;
+}
+
+#endif // WAVE_ARBITRAGE_FAN_OUT_H
@@ -0,0 +1,226 @@
+#include <deque>
+
+#include <glog/logging.h>
+
+#include "fan_out.h"
+#include "gtest/gtest.h"
+#include "job.h"
+#include "synthetic_data_testing.h"
+
+const std::vector<string> &test_symbols() {
+  static const std::vector<string> symbols = []() {
+    SyntheticIEXConfig config;
+    config.num_symbols = 2;
+    config.num_days = 20;
+    config.trades_per_day = 300.0;
+    config.dividend_probability = 0.2;
+    config.split_probability = 0.05;
+    return write_test_data("fan_out", config);
+  }();
+  return symbols;
+}
+
+// Never trades after buying in, and counts its price events.
+class CountingStrategy : public Strategy {
+public:
+  CountingStrategy(double cash, std::vector<SymbolId> symbol_ids,
+                   const std::vector<double> &prices)
+      : Strategy(cash, std::move(symbol_ids)) {
+    rebalance(prices);
+  }
+
+  string strategy_name() const override { return "Counting"; }
+
+  bool price_event(const std::vector<double> &prices) override {
+    num_events++;
+    return false;
+  }
+
+  bool idle_within(const std::vector<double> &low,
+                   const std::vector<double> &high) const override {
+    return true;
+  }
+
+  static inline int num_events = 0;
+};
+
+TEST(FanOutTest, Registry) {
+  const StrategyRegistry &registry = StrategyRegistry::global();
+  EXPECT_EQ(registry.names(),
+            (std::vector<string>{"BuyAndHold", "WaveArbitrage"}));
+  EXPECT_TRUE(registry.contains("WaveArbitrage:1.01"));
+  EXPECT_FALSE(registry.contains("Counting"));
+
+  const std::vector<SymbolId> ids = {SymbolTable::intern("FOO"),
+                                     SymbolTable::intern("BAR")};
+  const std::vector<double> prices = {10.0, 20.0};
+  auto wave =
+      registry.make("WaveArbitrage:1.01", /*cash=*/1000.0, ids, prices);
+  EXPECT_EQ(wave->strategy_name(), "WaveArbitrage");
+  // The first price event sets the thresholds. A 5% move is past a 1%
+  // threshold, but not past a 10% one.
+  wave->price_event(prices);
+  EXPECT_TRUE(wave->price_event({10.5, 20.0}));
+  auto wide =
+      registry.make("WaveArbitrage:1.1", /*cash=*/1000.0, ids, prices);
+  wide->price_event(prices);
+  EXPECT_FALSE(wide->price_event({10.5, 20.0}));
+  auto bh = registry.make("BuyAndHold", /*cash=*/1000.0, ids, prices);
+  EXPECT_EQ(bh->strategy_name(), "BuyAndHold");
+
+  for (const string &spec : std::vector<string>{
+           "WaveArbitrage", "WaveArbitrage:", "WaveArbitrage:abc",
+           "WaveArbitrage:1.01x", "WaveArbitrage:0.5", "WaveArbitrage:nan",
+           "BuyAndHold:1"}) {
+    EXPECT_THROW(registry.make(spec, /*cash=*/1000.0, ids, prices),
+                 std::invalid_argument)
+        << spec;
+  }
+}
+
+TEST(FanOutTest, SameAsJob) {
+  const std::vector<string> pair = test_symbols();
+  WelfordRunningStatistics bh_stats;
+  WelfordRunningStatistics wave_stats;
+  DynamicHistogram bh_hist(/*max_num_buckets=*/50);
+  DynamicHistogram wave_hist(/*max_num_buckets=*/50);
+  // The data is shorter than a year, so the returns are compared over a day.
+  Duration day;
+  day.set_seconds(24 * 60 * 60);
+  WelfordRunningStatistics bh_day_stats;
+  WelfordRunningStatistics wave_day_stats;
+  DynamicHistogram bh_day_hist(/*max_num_buckets=*/50);
+  DynamicHistogram wave_day_hist(/*max_num_buckets=*/50);
+  const auto expected =
+      job(/*feed=*/std::make_unique<IEXFeed>(pair), /*cash=*/100000.0,
+          /*rebalance_threshold=*/1.001, /*bh_stats=*/&bh_stats,
+          /*wave_stats=*/&wave_stats, /*bh_hist=*/&bh_hist,
+          /*wave_hist=*/&wave_hist, /*journal_writer=*/nullptr,
+          /*bh_horizons=*/{{day, &bh_day_stats, &bh_day_hist}},
+          /*wave_horizons=*/{{day, &wave_day_stats, &wave_day_hist}});
+  ASSERT_GT(bh_day_stats.count(), 0);
+
+  // Each strategy appears twice, and every copy matches job()'s.
+  const std::vector<string> specs = {"BuyAndHold", "WaveArbitrage:1.001",
+                                     "WaveArbitrage:1.001", "BuyAndHold"};
+  std::deque<ReturnStats> stats;
+  std::deque<ReturnStats> day_stats;
+  std::vector<FanOutEntry> entries;
+  for (const string &spec : specs) {
+    stats.emplace_back(/*max_num_buckets=*/50);
+    day_stats.emplace_back(/*max_num_buckets=*/50);
+    entries.push_back(FanOutEntry{
+        spec, &stats.back().stats, &stats.back().hist,
+        /*horizons=*/{{day, &day_stats.back().stats, &day_stats.back().hist}}});
+  }
+  const std::vector<double> values =
+      fan_out_job(/*feed=*/std::make_unique<IEXFeed>(pair), /*cash=*/100000.0,
+                  /*entries=*/entries);
+
+  ASSERT_EQ(values.size(), 4);
+  for (size_t s : {0, 3}) {
+    EXPECT_EQ(values[s], std::get<0>(expected));
+    EXPECT_EQ(stats[s].stats.count(), bh_stats.count());
+    EXPECT_EQ(day_stats[s].stats.count(), bh_day_stats.count());
+    EXPECT_EQ(day_stats[s].stats.mean(), bh_day_stats.mean());
+  }
+  for (size_t s : {1, 2}) {
+    EXPECT_EQ(values[s], std::get<1>(expected));
+    EXPECT_EQ(stats[s].stats.count(), wave_stats.count());
+    EXPECT_EQ(day_stats[s].stats.count(), wave_day_stats.count());
+    EXPECT_EQ(day_stats[s].stats.mean(), wave_day_stats.mean());
+  }
+}
+
+TEST(FanOutTest, JournalsLikeJob) {
+  const std::vector<string> pair = test_symbols();
+  const string job_filename = ::testing::TempDir() + "/fan_out_job.journal";
+  const string fan_out_filename = ::testing::TempDir() + "/fan_out.journal";
+  {
+    JournalWriter writer(job_filename);
+    WelfordRunningStatistics bh_stats;
+    WelfordRunningStatistics wave_stats;
+    DynamicHistogram bh_hist(/*max_num_buckets=*/50);
+    DynamicHistogram wave_hist(/*max_num_buckets=*/50);
+    job(/*feed=*/std::make_unique<IEXFeed>(pair), /*cash=*/100000.0,
+        /*rebalance_threshold=*/1.001, /*bh_stats=*/&bh_stats,
+        /*wave_stats=*/&wave_stats, /*bh_hist=*/&bh_hist,
+        /*wave_hist=*/&wave_hist, /*journal_writer=*/&writer);
+  }
+  {
+    JournalWriter writer(fan_out_filename);
+    WelfordRunningStatistics bh_stats;
+    WelfordRunningStatistics wave_stats;
+    DynamicHistogram bh_hist(/*max_num_buckets=*/50);
+    DynamicHistogram wave_hist(/*max_num_buckets=*/50);
+    fan_out_job(/*feed=*/std::make_unique<IEXFeed>(pair), /*cash=*/100000.0,
+                /*entries=*/
+                {{"BuyAndHold", &bh_stats, &bh_hist},
+                 {"WaveArbitrage:1.001", &wave_stats, &wave_hist}},
+                /*registry=*/StrategyRegistry::global(),
+                /*journal_writer=*/&writer);
+  }
+
+  const auto expected = JournalWriter::read_file(job_filename);
+  const auto actual = JournalWriter::read_file(fan_out_filename);
+  ASSERT_EQ(expected.size(), 1);
+  ASSERT_EQ(actual.size(), 1);
+  EXPECT_EQ(actual[0]->sample_seconds(), expected[0]->sample_seconds());
+  // Including the opening buys.
+  const auto &expected_fills = expected[0]->fills();
+  const auto &fills = actual[0]->fills();
+  ASSERT_GT(expected_fills.size(), 4);
+  ASSERT_EQ(fills.size(), expected_fills.size());
+  for (size_t f = 0; f < fills.size(); f++) {
+    EXPECT_EQ(fills[f].seconds, expected_fills[f].seconds) << f;
+    EXPECT_EQ(fills[f].shares, expected_fills[f].shares) << f;
+    EXPECT_EQ(fills[f].price, expected_fills[f].price) << f;
+    EXPECT_EQ(fills[f].strategy_index, expected_fills[f].strategy_index) << f;
+    EXPECT_EQ(fills[f].symbol_index, expected_fills[f].symbol_index) << f;
+  }
+}
+
+TEST(FanOutTest, CustomStrategy) {
+  StrategyRegistry registry;
+  registry.add("Counting",
+               [](double cash, std::vector<SymbolId> symbol_ids,
+                  const std::vector<double> &prices, const string &arg,
+                  FillListener *fill_listener) {
+                 return std::make_unique<CountingStrategy>(
+                     cash, std::move(symbol_ids), prices);
+               });
+  registry.add("WaveArbitrage",
+               [](double cash, std::vector<SymbolId> symbol_ids,
+                  const std::vector<double> &prices, const string &arg,
+                  FillListener *fill_listener) {
+                 return StrategyRegistry::global().make(
+                     "WaveArbitrage:" + arg, cash, std::move(symbol_ids),
+                     prices, fill_listener);
+               });
+
+  WelfordRunningStatistics counting_stats;
+  WelfordRunningStatistics tight_stats;
+  WelfordRunningStatistics loose_stats;
+  DynamicHistogram counting_hist(/*max_num_buckets=*/50);
+  DynamicHistogram tight_hist(/*max_num_buckets=*/50);
+  DynamicHistogram loose_hist(/*max_num_buckets=*/50);
+  CountingStrategy::num_events = 0;
+  const std::vector<double> values = fan_out_job(
+      /*feed=*/std::make_unique<IEXFeed>(test_symbols()), /*cash=*/100000.0,
+      /*entries=*/
+      {{"Counting", &counting_stats, &counting_hist},
+       {"WaveArbitrage:1.001", &tight_stats, &tight_hist},
+       {"WaveArbitrage:1.05", &loose_stats, &loose_hist}},
+      /*registry=*/registry);
+  ASSERT_EQ(values.size(), 3);
+  EXPECT_GT(CountingStrategy::num_events, 0);
+  // The variants were tracked separately.
+  EXPECT_NE(values[1], values[2]);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -1,20 +1,31 @@
 #ifndef WAVE_ARBITRAGE_FEED_H
 #define WAVE_ARBITRAGE_FEED_H
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <mutex>
 #include <random>
 #include <set>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <glog/logging.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/util/time_util.h>
+#include <google/protobuf/wire_format_lite.h>
 
 #include "market_data.pb.h"
+#include "symbols.h"
 #include "util.h"
 
 using ::google::protobuf::Timestamp;
@@ -27,6 +38,37 @@ static constexpr FeedStatus FEED_DIVIDEND = 4;
 static constexpr FeedStatus FEED_SPLIT = 8;
 static constexpr FeedStatus FEED_END = 16;
 
+typedef int TickFlags;
+static constexpr TickFlags TICK_PRICE = 1;
+static constexpr TickFlags TICK_DIVIDEND = 2;
+static constexpr TickFlags TICK_SPLIT = 4;
+static constexpr TickFlags TICK_DAY_CHANGE = 8;
+static constexpr TickFlags TICK_END = 16;
+// Set on the last tick of an adjustment. Strategies should only look at the
+// prices once they reach a tick with this flag.
+static constexpr TickFlags TICK_EVALUATE = 32;
+
+// One change reported by Feed::next_batch(). Each call to adjust_prices()
+// turns into a group of ticks: the dividends, then the splits, then the
+// prices that moved. The last price tick of the group carries TICK_EVALUATE,
+// unless the feed ended, in which case the group ends with a TICK_END tick.
+struct Tick {
+  int64_t seconds;
+  int32_t nanos;
+  // -1 for TICK_END.
+  int32_t symbol_index;
+  // The price for TICK_PRICE, the per-share payment for TICK_DIVIDEND, or the
+  // ratio from Feed::splits() for TICK_SPLIT.
+  double value;
+  TickFlags flags;
+};
+
+// Returns true if the consumer can't act on any prices between low and high,
+// inclusive. See Feed::set_skip_filter().
+typedef std::function<bool(const std::vector<double> &low,
+                           const std::vector<double> &high)>
+    SkipFilter;
+
 struct PriceAction {
   PriceAction(Timestamp timestamp, double ratio, bool is_dividend)
       : timestamp(timestamp), ratio(ratio), is_dividend(is_dividend) {}
@@ -79,7 +121,8 @@ struct PriceAction {
 class Feed {
 public:
   Feed(std::vector<string> symbols)
-      : symbols_(symbols), prices_(symbols.size(), 0.0),
+      : symbols_(symbols), symbol_ids_(SymbolTable::intern_all(symbols)),
+        prices_(symbols.size(), 0.0),
         dividends_(symbols.size(), 0.0), splits_(symbols.size(), 0.0),
         adjusts_(0) {}
 
@@ -111,8 +154,26 @@ public:
 
   virtual FeedStatus adjust_prices() = 0;
 
+  // Advances the feed by as many whole adjustments as fit into ticks and
+  // returns the number of ticks written. Returns 0 once the feed has ended.
+  // capacity must be at least max_ticks_per_adjust().
+  virtual size_t next_batch(Tick *ticks, size_t capacity) {
+    return fill_batch([this]() { return adjust_prices(); }, ticks, capacity);
+  }
+
+  size_t max_ticks_per_adjust() const { return 3 * symbols_.size() + 1; }
+
+  // Feeds that can skip ahead use the filter to leave out adjustments that
+  // the consumer wouldn't act on. The filter may look at the consumer's state,
+  // so the consumer must apply every tick it has been handed before asking
+  // for more. Other feeds ignore it.
+  virtual void set_skip_filter(SkipFilter filter) {}
+
   const std::vector<string> &symbols() const { return symbols_; }
 
+  // The interned ids of symbols(), in the same order.
+  const std::vector<SymbolId> &symbol_ids() const { return symbol_ids_; }
+
   const std::vector<double> &prices() const { return prices_; }
 
   const std::vector<double> &dividends() const { return dividends_; }
@@ -121,13 +182,101 @@ public:
 
   const Timestamp &timestamp() const { return timestamp_; }
 
+  // The index of the only symbol whose price changed during the last call to
+  // adjust_prices(), or -1 if any of the prices may have changed.
+  int updated_index() const { return updated_index_; }
+
 protected:
   std::vector<string> symbols_;
+  std::vector<SymbolId> symbol_ids_;
   std::vector<double> prices_;
   std::vector<double> dividends_;
   std::vector<double> splits_;
   Timestamp timestamp_;
   size_t adjusts_;
+  int updated_index_ = -1;
+  bool batch_ended_ = false;
+  // Set by adjust() to end the current batch after its adjustment.
+  bool batch_break_ = false;
+  // Whether apply_tick() is in the middle of an adjustment's ticks.
+  bool in_group_ = false;
+
+  // Keeps prices(), dividends(), splits() and timestamp() in step with a feed
+  // whose ticks are being handed on.
+  void apply_tick(const Tick &tick) {
+    if (!in_group_ && (tick.flags & TICK_DAY_CHANGE)) {
+      std::fill(dividends_.begin(), dividends_.end(), 0.0);
+      std::fill(splits_.begin(), splits_.end(), 0.0);
+    }
+    in_group_ = !(tick.flags & (TICK_EVALUATE | TICK_END));
+
+    if (tick.flags & TICK_PRICE) {
+      prices_[tick.symbol_index] = tick.value;
+    } else if (tick.flags & TICK_DIVIDEND) {
+      dividends_[tick.symbol_index] = tick.value;
+    } else if (tick.flags & TICK_SPLIT) {
+      splits_[tick.symbol_index] = tick.value;
+    } else if (tick.flags & TICK_END) {
+      batch_ended_ = true;
+    }
+    timestamp_.set_seconds(tick.seconds);
+    timestamp_.set_nanos(tick.nanos);
+  }
+
+  // Runs adjust() until ticks is nearly full. Subclasses pass a lambda that
+  // calls their own adjust_prices() non-virtually.
+  template <typename AdjustFn>
+  size_t fill_batch(AdjustFn adjust, Tick *ticks, size_t capacity) {
+    CHECK_GE(capacity, max_ticks_per_adjust());
+    size_t n = 0;
+    batch_break_ = false;
+    while (!batch_ended_ && !batch_break_ &&
+           capacity - n >= max_ticks_per_adjust()) {
+      const FeedStatus fs = adjust();
+      const int64_t seconds = timestamp_.seconds();
+      const int32_t nanos = timestamp_.nanos();
+      const TickFlags day_change =
+          (fs & FEED_DAY_CHANGE) ? TICK_DAY_CHANGE : 0;
+
+      if (fs & FEED_DIVIDEND) {
+        for (size_t i = 0; i < dividends_.size(); i++) {
+          if (dividends_[i] != 0.0) {
+            ticks[n++] = Tick{seconds, nanos, static_cast<int32_t>(i),
+                              dividends_[i], TICK_DIVIDEND | day_change};
+          }
+        }
+      }
+
+      if (fs & FEED_SPLIT) {
+        for (size_t i = 0; i < splits_.size(); i++) {
+          if (splits_[i] != 0.0) {
+            ticks[n++] = Tick{seconds, nanos, static_cast<int32_t>(i),
+                              splits_[i], TICK_SPLIT | day_change};
+          }
+        }
+      }
+
+      const size_t first_price = n;
+      if (updated_index_ >= 0) {
+        ticks[n++] = Tick{seconds, nanos, updated_index_,
+                          prices_[updated_index_], TICK_PRICE | day_change};
+      } else {
+        for (size_t i = 0; i < prices_.size(); i++) {
+          ticks[n++] = Tick{seconds, nanos, static_cast<int32_t>(i),
+                            prices_[i], TICK_PRICE | day_change};
+        }
+      }
+
+      if (fs & FEED_END) {
+        ticks[n++] = Tick{seconds, nanos, -1, 0.0, TICK_END};
+        batch_ended_ = true;
+        break;
+      } else if (n > first_price) {
+        ticks[n - 1].flags |= TICK_EVALUATE;
+      }
+    }
+    return n;
+  }
 };
 
 class RandomFeed : public Feed {
@@ -174,6 +323,11 @@ public:
     return FEED_OK;
   }
 
+  size_t next_batch(Tick *ticks, size_t capacity) override {
+    return fill_batch([this]() { return RandomFeed::adjust_prices(); }, ticks,
+                      capacity);
+  }
+
 private:
   const double gbm_sqrt_dt_;
   const double gbm_sigma_;
@@ -184,6 +338,29 @@ private:
   std::default_random_engine generator_;
 };
 
+string &iex_data_root_override() {
+  static string root;
+  return root;
+}
+
+// Points every IEXFeed at another data directory, laid out like the one the
+// scraper writes. The file listing is cached, so this has to be called before
+// the first IEXFeed is made.
+void set_iex_data_root(const string &root) { iex_data_root_override() = root; }
+
+// The directory holding processed/ and dividends/. This is whatever was
+// passed to set_iex_data_root(), or else $IEX_DATA_ROOT, or else
+// $HOME/iex_data.
+string iex_data_root() {
+  if (!iex_data_root_override().empty()) {
+    return iex_data_root_override();
+  }
+  if (const char *root = getenv("IEX_DATA_ROOT")) {
+    return root;
+  }
+  return string(getenv("HOME")) + "/iex_data";
+}
+
 const std::vector<string>& get_available_symbols() {
   static std::vector<string> symbols;
   static std::mutex mtx;
@@ -194,10 +371,9 @@ const std::vector<string>& get_available_symbols() {
     return symbols;
   }
 
-  static const string kProcessedDir =
-      string(getenv("HOME")) + "/iex_data/processed/";
+  const string processed_dir = iex_data_root() + "/processed/";
   std::set<string> res;
-  for (const auto &f : std::filesystem::directory_iterator(kProcessedDir)) {
+  for (const auto &f : std::filesystem::directory_iterator(processed_dir)) {
     if (!f.file_size()) {
       continue;
     }
@@ -211,8 +387,7 @@ const std::vector<string>& get_available_symbols() {
 }
 
 std::map<string, std::vector<string>>& get_iex_files() {
-  static const string kProcessedDir =
-      string(getenv("HOME")) + "/iex_data/processed/";
+  const string processed_dir = iex_data_root() + "/processed/";
   static std::map<string, std::vector<string>> files;
   static std::mutex mtx;
 
@@ -225,7 +400,7 @@ std::map<string, std::vector<string>>& get_iex_files() {
     files[symbol] = std::vector<string>();
   }
 
-  for (const auto &f : std::filesystem::directory_iterator(kProcessedDir)) {
+  for (const auto &f : std::filesystem::directory_iterator(processed_dir)) {
     if (!f.file_size()) {
       continue;
     }
@@ -243,22 +418,155 @@ std::map<string, std::vector<string>>& get_iex_files() {
   return files;
 }
 
-class IEXFeed : public Feed {
+std::vector<PriceAction> load_price_actions(const string &symbol) {
+  std::vector<PriceAction> price_actions;
+  string filename = iex_data_root() + "/dividends/" + symbol + ".csv";
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in.good()) {
+    return price_actions;
+  }
+  string csv_data{std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>()};
+
+  size_t idx = 0;
+  while (idx < csv_data.size()) {
+    size_t found_idx = csv_data.find("\n", idx);
+    price_actions.push_back(PriceAction(csv_data.substr(idx, found_idx - idx)));
+    idx = found_idx + 1;
+  }
+  return price_actions;
+}
+
+// The day files and corporate actions of a set of symbols. IEXFeeds that are
+// given a manifest read it instead of going back to the global file listing
+// and the dividend files, so that each NUMA node can keep its own copy.
+struct IEXManifest {
+  std::map<string, std::vector<string>> files;
+  std::map<string, std::vector<PriceAction>> price_actions;
+
+  static IEXManifest load(const std::vector<string> &symbols) {
+    IEXManifest manifest;
+    for (const auto &symbol : symbols) {
+      manifest.files[symbol] = get_iex_files()[symbol];
+      manifest.price_actions[symbol] = load_price_actions(symbol);
+    }
+    return manifest;
+  }
+};
+
+// Streams the trades out of a day file one at a time, instead of parsing the
+// whole market_data::Events message up front. Events that aren't trades are
+// skipped without being parsed. The current trade lives in an arena that is
+// reset whenever the next day file is opened, so memory use doesn't depend on
+// the size of the day.
+class TradeReader {
 public:
-  IEXFeed(std::vector<string> symbols) : Feed(symbols) {
-    day_events_.resize(symbols.size());
-    for (size_t i = 0; i < symbols.size(); i++) {
-      const string symbol = symbols[i];
-      iex_files_.push_back(get_iex_files()[symbol]);
-      iex_files_idxs_.push_back(0);
-      day_events_.push_back(market_data::Events());
-      day_events_next_idxs_.push_back(0);
+  TradeReader() { reset_arena(); }
+
+  TradeReader(const TradeReader &) = delete;
+  TradeReader &operator=(const TradeReader &) = delete;
+
+  void open(const string &filename) {
+    coded_.reset();
+    file_.reset();
+    reset_arena();
+
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    CHECK_GE(fd, 0) << filename;
+    file_ = std::make_unique<google::protobuf::io::FileInputStream>(fd);
+    file_->SetCloseOnDelete(true);
+    coded_ = std::make_unique<google::protobuf::io::CodedInputStream>(
+        file_.get());
+  }
+
+  // Moves past the next event, whatever it is. Returns false at the end of
+  // the file.
+  bool skip_event() { return read_event(/*want_trade=*/false); }
+
+  // Moves to the next trade. Returns false at the end of the file.
+  bool next_trade() {
+    while (true) {
+      if (!read_event(/*want_trade=*/true)) {
+        return false;
+      }
+      if (has_trade_) {
+        return true;
+      }
     }
+  }
+
+  const market_data::Trade &trade() const { return *trade_; }
 
+private:
+  typedef google::protobuf::internal::WireFormatLite WireFormatLite;
+
+  // Both Events.events and Event.trade are field 1.
+  static constexpr uint32_t kEventTag = WireFormatLite::MakeTag(
+      1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  static constexpr uint32_t kTradeTag = kEventTag;
+
+  google::protobuf::Arena arena_;
+  market_data::Trade *trade_ = nullptr;
+  bool has_trade_ = false;
+  std::unique_ptr<google::protobuf::io::FileInputStream> file_;
+  std::unique_ptr<google::protobuf::io::CodedInputStream> coded_;
+
+  void reset_arena() {
+    arena_.Reset();
+    trade_ = google::protobuf::Arena::CreateMessage<market_data::Trade>(
+        &arena_);
+  }
+
+  bool read_event(bool want_trade) {
+    has_trade_ = false;
+    if (!coded_) {
+      return false;
+    }
+
+    while (true) {
+      const uint32_t tag = coded_->ReadTag();
+      if (tag == 0) {
+        return false;
+      } else if (tag != kEventTag) {
+        CHECK(WireFormatLite::SkipField(coded_.get(), tag));
+        continue;
+      }
+
+      uint32_t length;
+      CHECK(coded_->ReadVarint32(&length));
+      const auto event_limit = coded_->PushLimit(length);
+      while (const uint32_t field_tag = coded_->ReadTag()) {
+        if (!want_trade || field_tag != kTradeTag) {
+          CHECK(WireFormatLite::SkipField(coded_.get(), field_tag));
+          continue;
+        }
+
+        // A oneof keeps the last member that was set.
+        CHECK(coded_->ReadVarint32(&length));
+        const auto trade_limit = coded_->PushLimit(length);
+        trade_->Clear();
+        CHECK(trade_->MergeFromCodedStream(coded_.get()));
+        coded_->PopLimit(trade_limit);
+        has_trade_ = true;
+      }
+      coded_->PopLimit(event_limit);
+      return true;
+    }
+  }
+};
+
+class IEXFeed : public Feed {
+public:
+  // Looks the symbols up in the manifest if there is one, and otherwise reads
+  // the day file listing and the corporate actions from disk.
+  IEXFeed(std::vector<string> symbols,
+          const IEXManifest *manifest = nullptr)
+      : Feed(symbols) {
+    open_files(manifest);
     CHECK_NE(advance_day(), FEED_END);
 
     for (size_t i = 0; i < symbols.size(); i++) {
-      auto trade = day_events_[i].events()[day_events_next_idxs_[i]].trade();
+      const auto &trade = readers_[i]->trade();
       if (before(timestamp_, trade.timestamp())) {
         last_timestamp_ = trade.timestamp();
         timestamp_ = trade.timestamp();
@@ -266,29 +574,72 @@ public:
       prices_[i] = trade.price() / 10000.0;
     }
 
-    price_actions_.resize(symbols.size());
+    load_price_actions(manifest);
+  }
+
+  // Replays only the days in [first_day, end_day), numbered as in
+  // plan_days(). The last adjustment is the one that moves to end_day, and
+  // there is no TICK_END unless the data runs out. Feeds over consecutive
+  // ranges give the same ticks, back to back, as one feed over every day.
+  IEXFeed(std::vector<string> symbols,
+          const std::vector<std::vector<size_t>> &day_files, size_t first_day,
+          size_t end_day, const IEXManifest *manifest = nullptr)
+      : Feed(symbols), day_(first_day), end_day_(end_day) {
+    CHECK_LT(first_day, end_day);
+    CHECK_LT(first_day, day_files.size());
+    open_files(manifest);
+    iex_files_idxs_ = day_files[first_day];
+    CHECK_NE(advance_day(), FEED_END);
+
     for (size_t i = 0; i < symbols.size(); i++) {
-      string filename =
-          string(getenv("HOME")) + "/iex_data/dividends/" + symbols[i] + ".csv";
-      std::ifstream in(filename, std::ios::in | std::ios::binary);
-      if (!in.good()) {
-        continue;
-      }
-      string csv_data{std::istreambuf_iterator<char>(in),
-                      std::istreambuf_iterator<char>()};
-
-      size_t idx = 0;
-      while (idx < csv_data.size()) {
-        size_t found_idx = csv_data.find("\n", idx);
-        price_actions_[i].push_back(
-            PriceAction(csv_data.substr(idx, found_idx - idx)));
-        idx = found_idx + 1;
+      const auto &trade = readers_[i]->trade();
+      // Only the first day starts out at the latest of the first trades, as
+      // in the other constructor. Later days start at the earliest, as they
+      // do after advance_day().
+      if (first_day == 0 && before(timestamp_, trade.timestamp())) {
+        last_timestamp_ = trade.timestamp();
+        timestamp_ = trade.timestamp();
       }
+      prices_[i] = trade.price() / 10000.0;
     }
+
+    load_price_actions(manifest);
   }
 
   ~IEXFeed() {}
 
+  // For every day the feed will reach, the index into each symbol's day files
+  // of the file it reads that day. Days where a symbol has no trades are
+  // skipped the same way the feed skips them. This reads the start of every
+  // day file.
+  static std::vector<std::vector<size_t>>
+  plan_days(const std::vector<string> &symbols,
+            const IEXManifest *manifest = nullptr) {
+    std::vector<std::vector<string>> files;
+    for (const auto &symbol : symbols) {
+      files.push_back(manifest ? manifest->files.at(symbol)
+                               : get_iex_files()[symbol]);
+    }
+
+    std::vector<std::vector<size_t>> days;
+    std::vector<size_t> idxs(symbols.size(), 0);
+    TradeReader reader;
+    while (true) {
+      std::vector<size_t> day;
+      for (size_t i = 0; i < symbols.size(); i++) {
+        do {
+          if (idxs[i] >= files[i].size()) {
+            return days;
+          }
+          reader.open(files[i][idxs[i]++]);
+          reader.skip_event();
+        } while (!reader.next_trade());
+        day.push_back(idxs[i] - 1);
+      }
+      days.push_back(std::move(day));
+    }
+  }
+
   string feed_name() const override {
     return "IEXFeed";
   }
@@ -299,19 +650,16 @@ public:
     int champ_idx = 0;
 
     for (size_t i = 0; i < symbols().size(); i++) {
-      auto event = day_events_[i].events()[day_events_next_idxs_[i]].trade();
-
-      Timestamp chump = event.timestamp();
+      const Timestamp &chump = readers_[i]->trade().timestamp();
       if (champ.seconds() == 0 || before(chump, champ)) {
         champ = chump;
         champ_idx = i;
       }
     }
 
-    auto trade = day_events_[champ_idx]
-                     .events()[day_events_next_idxs_[champ_idx]]
-                     .trade();
+    const auto &trade = readers_[champ_idx]->trade();
     prices_[champ_idx] = trade.price() / 10000.0;
+    updated_index_ = champ_idx;
     last_timestamp_ = timestamp_;
     timestamp_ = trade.timestamp();
 
@@ -320,6 +668,9 @@ public:
       if (advance_day() == FEED_END) {
         return FEED_END;
       }
+      if (++day_ == end_day_) {
+        batch_ended_ = true;
+      }
 
       for (size_t i = 0; i < symbols().size(); i++) {
         for (auto price_action : price_actions_[i]) {
@@ -340,17 +691,44 @@ public:
     return fs;
   }
 
+  size_t next_batch(Tick *ticks, size_t capacity) override {
+    return fill_batch([this]() { return IEXFeed::adjust_prices(); }, ticks,
+                      capacity);
+  }
+
 private:
   std::vector<std::vector<string>> iex_files_;
-  std::vector<int> iex_files_idxs_;
-  std::vector<market_data::Events> day_events_;
-  std::vector<int> day_events_next_idxs_;
+  std::vector<size_t> iex_files_idxs_;
+  std::vector<std::unique_ptr<TradeReader>> readers_;
 
   std::vector<std::vector<PriceAction>> price_actions_;
 
   Timestamp last_timestamp_;
 
+  // The day being replayed, as numbered by plan_days(), and the day to stop
+  // at.
+  size_t day_ = 0;
+  const size_t end_day_ = std::numeric_limits<size_t>::max();
+
+  void open_files(const IEXManifest *manifest) {
+    for (const auto &symbol : symbols_) {
+      iex_files_.push_back(manifest ? manifest->files.at(symbol)
+                                    : get_iex_files()[symbol]);
+      iex_files_idxs_.push_back(0);
+      readers_.push_back(std::make_unique<TradeReader>());
+    }
+  }
+
+  void load_price_actions(const IEXManifest *manifest) {
+    for (const auto &symbol : symbols_) {
+      price_actions_.push_back(
+          manifest ? manifest->price_actions.at(symbol)
+                   : ::load_price_actions(symbol));
+    }
+  }
+
   FeedStatus advance_day() {
+    TraceSpan span("load day");
     for (size_t i = 0; i < symbols().size(); i++) {
       dividends_[i] = 0.0;
       splits_[i] = 0.0;
@@ -361,20 +739,14 @@ private:
 
       initialize_day(i);
 
-      FeedStatus fs;
-      while (true) {
-        fs = advance_event(i);
-        if (fs & FEED_END) {
+      while (advance_event(i) & FEED_DAY_CHANGE) {
+        if (iex_files_idxs_[i] >= iex_files_[i].size()) {
           return FEED_END;
-        } else if (fs & FEED_DAY_CHANGE) {
-          initialize_day(i);
-        } else {
-          break;
         }
+        initialize_day(i);
       }
 
-      auto &ts =
-          day_events_[i].events()[day_events_next_idxs_[i]].trade().timestamp();
+      const auto &ts = readers_[i]->trade().timestamp();
       if (i == 0 || before(ts, timestamp_)) {
         timestamp_ = ts;
       }
@@ -384,29 +756,14 @@ private:
   }
 
   FeedStatus advance_event(size_t symbol_index) {
-    const size_t i = symbol_index;
-
-    while (true) {
-      day_events_next_idxs_[i] += 1;
-
-      if (day_events_next_idxs_[i] >= day_events_[i].events().size()) {
-        return FEED_DAY_CHANGE;
-      }
-
-      const auto event = day_events_[i].events()[day_events_next_idxs_[i]];
-
-      if (event.has_trade()) {
-        return FEED_OK;
-      }
-    }
+    return readers_[symbol_index]->next_trade() ? FEED_OK : FEED_DAY_CHANGE;
   }
 
   void initialize_day(size_t i) {
-    std::fstream input(iex_files_[i][iex_files_idxs_[i]],
-                       std::ios::in | std::ios::binary);
-    day_events_next_idxs_[i] = 0;
+    readers_[i]->open(iex_files_[i][iex_files_idxs_[i]]);
     iex_files_idxs_[i] += 1;
-    day_events_[i].ParseFromIstream(&input);
+    // The first event of a day has never been looked at for trades.
+    readers_[i]->skip_event();
   }
 };
 
@@ -27,6 +27,83 @@ TEST(FeedTest, Random) {
   EXPECT_NE(feed.timestamp().seconds(), before.seconds());
 }
 
+TEST(FeedTest, RandomBatch) {
+  RandomFeed feed(/*symbols=*/{"FOO", "BAR"}, {10.0, 10.0}, 1.0 / 252,
+                  1.0 / 252, /*lifespan=*/10);
+  EXPECT_EQ(feed.max_ticks_per_adjust(), 7);
+
+  std::vector<Tick> ticks(8);
+  std::vector<double> prices = feed.prices();
+  int evaluations = 0;
+  bool ended = false;
+  size_t n;
+  while ((n = feed.next_batch(ticks.data(), ticks.size())) > 0) {
+    ASSERT_FALSE(ended);
+    for (size_t i = 0; i < n; i++) {
+      if (ticks[i].flags & TICK_PRICE) {
+        prices[ticks[i].symbol_index] = ticks[i].value;
+      }
+      if (ticks[i].flags & TICK_EVALUATE) {
+        evaluations++;
+      }
+      if (ticks[i].flags & TICK_END) {
+        ended = true;
+        EXPECT_EQ(i + 1, n);
+      }
+    }
+  }
+
+  EXPECT_TRUE(ended);
+  EXPECT_EQ(evaluations, 10);
+  EXPECT_EQ(prices, feed.prices());
+  EXPECT_EQ(feed.next_batch(ticks.data(), ticks.size()), 0);
+}
+
+TEST(FeedTest, TradeReader) {
+  market_data::Events events;
+  events.add_events()->mutable_security_directory()->set_symbol("FOO");
+  for (int i = 0; i < 1000; i++) {
+    auto *event = events.add_events();
+    if (i % 3 == 0) {
+      event->mutable_official_price()->set_price(i);
+      continue;
+    }
+    auto *trade = event->mutable_trade();
+    trade->set_symbol("FOO");
+    trade->mutable_timestamp()->set_seconds(i);
+    trade->set_price(10000 + i);
+  }
+
+  const string filename = ::testing::TempDir() + "/trade_reader_test.pb";
+  {
+    std::ofstream out(filename, std::ios::out | std::ios::binary);
+    ASSERT_TRUE(events.SerializeToOstream(&out));
+  }
+
+  TradeReader reader;
+  for (int pass = 0; pass < 2; pass++) {
+    // Reopening starts the file over.
+    reader.open(filename);
+    for (const auto &event : events.events()) {
+      if (!event.has_trade()) {
+        continue;
+      }
+      ASSERT_TRUE(reader.next_trade());
+      EXPECT_EQ(reader.trade().timestamp().seconds(),
+                event.trade().timestamp().seconds());
+      EXPECT_EQ(reader.trade().price(), event.trade().price());
+      EXPECT_EQ(reader.trade().symbol(), "FOO");
+    }
+    EXPECT_FALSE(reader.next_trade());
+  }
+
+  reader.open(filename);
+  EXPECT_TRUE(reader.skip_event());
+  EXPECT_TRUE(reader.skip_event());
+  ASSERT_TRUE(reader.next_trade());
+  EXPECT_EQ(reader.trade().price(), 10001);
+}
+
 TEST(FeedTest, IEX) {
   IEXFeed feed(/*symbols=*/{"GOOG", "FB"});
 
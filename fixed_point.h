@@ -0,0 +1,334 @@
+#ifndef WAVE_ARBITRAGE_FIXED_POINT_H
+#define WAVE_ARBITRAGE_FIXED_POINT_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "portfolio.h"
+
+using std::string;
+
+// Integer versions of Portfolio, BuyAndHold and WaveArbitrage. Prices are in
+// the ten-thousandths of a dollar that IEX trades are reported in, money is in
+// micro-dollars and holdings are in micro-shares. Every result is rounded the
+// same way on every machine, so a backtest gives bit-identical results
+// regardless of compiler flags or how the work is split between threads.
+
+static constexpr int64_t kPriceUnitsPerDollar = 10000;
+static constexpr int64_t kMicrosPerDollar = 1000000;
+static constexpr int64_t kMicrosPerPriceUnit =
+    kMicrosPerDollar / kPriceUnitsPerDollar;
+static constexpr int64_t kMicroSharesPerShare = 1000000;
+
+// Feeds hand out IEX prices divided by 10000.0, which this undoes exactly.
+inline int64_t to_price_units(double dollars) {
+  return std::llround(dollars * kPriceUnitsPerDollar);
+}
+
+inline int64_t to_micros(double dollars) {
+  return std::llround(dollars * kMicrosPerDollar);
+}
+
+// Computes a * b / c without overflowing, rounding toward zero.
+inline int64_t mul_div(int64_t a, int64_t b, int64_t c) {
+  return static_cast<__int128>(a) * b / c;
+}
+
+class FixedPortfolio {
+public:
+  // Portfolio::kFeePerShare in micro-dollars.
+  static constexpr int64_t kFeePerShare = 900;
+
+  FixedPortfolio(int64_t cash, std::vector<SymbolId> symbol_ids)
+      : cash_(cash), fees_(0), symbol_ids_(std::move(symbol_ids)) {
+    shares_.resize(symbol_ids_.size());
+  }
+
+  int index(SymbolId symbol) const {
+    auto found = std::find(symbol_ids_.begin(), symbol_ids_.end(), symbol);
+    if (found == symbol_ids_.end()) {
+      return -1;
+    }
+    return std::distance(symbol_ids_.begin(), found);
+  }
+
+  int64_t cash() const { return cash_; }
+
+  int64_t fees() const { return fees_; }
+
+  int64_t shares(size_t symbol_index) const {
+    DCHECK_LT(symbol_index, shares_.size());
+    return shares_[symbol_index];
+  }
+
+  // The value of some number of micro-shares in micro-dollars.
+  static int64_t market_value(int64_t shares, int64_t price) {
+    return mul_div(shares, price * kMicrosPerPriceUnit, kMicroSharesPerShare);
+  }
+
+  int64_t value_micros(const std::vector<int64_t> &prices) const {
+    DCHECK_EQ(prices.size(), shares_.size());
+
+    int64_t value = cash_;
+    for (size_t i = 0; i < prices.size(); i++) {
+      value += market_value(shares_[i], prices[i]);
+    }
+    return value;
+  }
+
+  // The same as value_micros(), in dollars, to match Portfolio::value().
+  double value(const std::vector<int64_t> &prices) const {
+    return static_cast<double>(value_micros(prices)) / kMicrosPerDollar;
+  }
+
+  void buy(size_t symbol_index, int64_t cash_to_spend, int64_t price) {
+    if (cash_to_spend > cash_) {
+      cash_to_spend = cash_;
+    }
+
+    const int64_t shares =
+        mul_div(cash_to_spend, kMicroSharesPerShare,
+                price * kMicrosPerPriceUnit + kFeePerShare);
+    const int64_t fee = mul_div(shares, kFeePerShare, kMicroSharesPerShare);
+
+    cash_ -= cash_to_spend;
+    fees_ += fee;
+    shares_[symbol_index] += shares;
+
+    notify(symbol_index, shares, price, fee);
+  }
+
+  void sell(size_t symbol_index, int64_t quantity, int64_t price) {
+    DCHECK_LE(quantity, shares_[symbol_index]);
+
+    shares_[symbol_index] -= quantity;
+    const int64_t fee = mul_div(quantity, kFeePerShare, kMicroSharesPerShare);
+    cash_ += market_value(quantity, price) - fee;
+    fees_ += fee;
+
+    notify(symbol_index, -quantity, price, fee);
+  }
+
+  void pay_dividend(size_t symbol_index, int64_t per_share) {
+    cash_ += mul_div(shares_[symbol_index], per_share, kMicroSharesPerShare);
+  }
+
+  void stock_split(size_t symbol_index, double ratio) {
+    shares_[symbol_index] = std::llround(shares_[symbol_index] * ratio);
+  }
+
+  // The listener is not owned and may be null. It is told about fills in
+  // dollars and shares.
+  void set_fill_listener(FillListener *listener) { fill_listener_ = listener; }
+
+private:
+  int64_t cash_;
+  int64_t fees_;
+  FillListener *fill_listener_ = nullptr;
+
+  std::vector<SymbolId> symbol_ids_;
+  std::vector<int64_t> shares_;
+
+  void notify(size_t symbol_index, int64_t shares, int64_t price,
+              int64_t fee) {
+    if (fill_listener_) {
+      fill_listener_->on_fill(
+          symbol_index, static_cast<double>(shares) / kMicroSharesPerShare,
+          static_cast<double>(price) / kPriceUnitsPerDollar,
+          static_cast<double>(fee) / kMicrosPerDollar);
+    }
+  }
+};
+
+// Mirrors Strategy. The constructor and the dividend and split methods take
+// the same dollar amounts and ratios as Strategy, so that the two can be
+// swapped in job().
+class FixedStrategy {
+public:
+  typedef int64_t Price;
+
+  FixedStrategy(double cash, std::vector<SymbolId> symbol_ids,
+                FillListener *fill_listener = nullptr)
+      : rebalance_cash_(symbol_ids.size() * kMicrosPerDollar / 100),
+        folio_(to_micros(cash), symbol_ids) {
+    folio_.set_fill_listener(fill_listener);
+  }
+
+  virtual ~FixedStrategy() {}
+
+  static Price from_feed_price(double price) { return to_price_units(price); }
+
+  virtual string strategy_name() const = 0;
+
+  virtual bool price_event(const std::vector<int64_t> &prices) = 0;
+
+  // Always false, since skipping is done with the floating point strategies.
+  bool idle_within(const std::vector<double> &low,
+                   const std::vector<double> &high) const {
+    return false;
+  }
+
+  const FixedPortfolio &portfolio() const { return folio_; }
+
+  int num_rebalances() const { return num_rebalances_; }
+
+  void set_fill_listener(FillListener *listener) {
+    folio_.set_fill_listener(listener);
+  }
+
+  void rebalance(const std::vector<int64_t> &prices) {
+    std::vector<int64_t> values;
+    int64_t total = portfolio().cash();
+    for (size_t i = 0; i < prices.size(); i++) {
+      int64_t value =
+          FixedPortfolio::market_value(portfolio().shares(i), prices[i]);
+      values.push_back(value);
+      total += value;
+    }
+
+    const int64_t desired = total / prices.size();
+    for (size_t i = 0; i < prices.size(); i++) {
+      if (values[i] > desired) {
+        folio_.sell(i,
+                    mul_div(values[i] - desired, kMicroSharesPerShare,
+                            prices[i] * kMicrosPerPriceUnit),
+                    prices[i]);
+      }
+      DCHECK_GE(portfolio().shares(i), 0) << num_rebalances_;
+    }
+
+    for (size_t i = 0; i < prices.size(); i++) {
+      if (values[i] < desired) {
+        folio_.buy(i, desired - values[i], prices[i]);
+      }
+    }
+
+    num_rebalances_++;
+  }
+
+  void pay_dividend(SymbolId symbol, double per_share) {
+    folio_.pay_dividend(portfolio().index(symbol), to_micros(per_share));
+    num_dividends_ += 1;
+  }
+
+  void stock_split(SymbolId symbol, double ratio) {
+    folio_.stock_split(portfolio().index(symbol), ratio);
+    num_splits_ += 1;
+  }
+
+protected:
+  const int64_t rebalance_cash_;
+  FixedPortfolio folio_;
+  int num_rebalances_ = 0;
+  int num_dividends_ = 0;
+  int num_splits_ = 0;
+};
+
+class FixedBuyAndHold : public FixedStrategy {
+public:
+  FixedBuyAndHold(double cash, std::vector<SymbolId> symbol_ids,
+                  const std::vector<int64_t> &prices,
+                  FillListener *fill_listener = nullptr)
+      : FixedStrategy(cash, std::move(symbol_ids), fill_listener) {
+    rebalance(prices);
+  }
+
+  string strategy_name() const { return "BuyAndHold"; }
+
+  bool price_event(const std::vector<int64_t> &prices) {
+    if (portfolio().cash() < rebalance_cash_) {
+      return false;
+    }
+    // Reinvest dividends.
+    int64_t per_stock = portfolio().cash() / prices.size();
+    for (size_t i = 0; i < prices.size(); i++) {
+      folio_.buy(i, /*cash_to_spend=*/per_stock, /*price=*/prices[i]);
+    }
+    return true;
+  }
+};
+
+class FixedWaveArbitrage : public FixedStrategy {
+public:
+  FixedWaveArbitrage(double cash, std::vector<SymbolId> symbol_ids,
+                     const std::vector<int64_t> &prices,
+                     double rebalance_threshold,
+                     FillListener *fill_listener = nullptr)
+      : FixedStrategy(cash, std::move(symbol_ids), fill_listener),
+        rebalance_threshold_(std::llround(rebalance_threshold *
+                                          kThresholdScale)) {
+    rebalance_down_.resize(2);
+    rebalance_up_.resize(2);
+    rebalance(prices);
+  }
+
+  string strategy_name() const { return "WaveArbitrage"; }
+
+  // See WaveArbitrage::price_event().
+  bool price_event(const std::vector<int64_t> &prices) {
+    bool do_rebalance = false;
+    // Handle dividend events.
+    if (portfolio().cash() > rebalance_cash_) {
+      do_rebalance = true;
+    }
+
+    for (size_t i = 0; i < prices.size(); i++) {
+      if (prices[i] < rebalance_down_[i] || prices[i] > rebalance_up_[i]) {
+        do_rebalance = true;
+      }
+    }
+
+    // TODO(lpe): Assuming 2 asset types here.
+    const int64_t half_total =
+        (FixedPortfolio::market_value(portfolio().shares(0), prices[0]) +
+         FixedPortfolio::market_value(portfolio().shares(1), prices[1])) /
+        2;
+
+    for (size_t i = 0; i < prices.size(); i++) {
+      const int64_t shares = portfolio().shares(i);
+      if (shares == 0) {
+        // The floating point bands are infinite, so any price is below them
+        // and the next price event rebalances. With nothing to divide up,
+        // they are NaN and never trigger.
+        rebalance_down_[i] = half_total > 0
+                                 ? std::numeric_limits<int64_t>::max()
+                                 : 0;
+        rebalance_up_[i] = std::numeric_limits<int64_t>::max();
+        continue;
+      }
+      const __int128 scaled_shares =
+          static_cast<__int128>(shares) * kMicrosPerPriceUnit;
+      rebalance_down_[i] =
+          static_cast<__int128>(half_total) * kMicroSharesPerShare *
+              kThresholdScale / (scaled_shares * rebalance_threshold_) -
+          kPenny;
+      rebalance_up_[i] =
+          static_cast<__int128>(half_total) * kMicroSharesPerShare *
+              rebalance_threshold_ / (scaled_shares * kThresholdScale) +
+          kPenny;
+    }
+
+    if (do_rebalance) {
+      rebalance(prices);
+    }
+
+    return do_rebalance;
+  }
+
+private:
+  // The threshold is kept in millionths.
+  static constexpr int64_t kThresholdScale = 1000000;
+  static constexpr int64_t kPenny = kPriceUnitsPerDollar / 100;
+
+  const int64_t rebalance_threshold_;
+
+  std::vector<int64_t> rebalance_down_;
+  std::vector<int64_t> rebalance_up_;
+};
+
+#endif // WAVE_ARBITRAGE_FIXED_POINT_H
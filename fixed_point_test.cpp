@@ -0,0 +1,113 @@
+#include <glog/logging.h>
+
+#include <random>
+
+#include "gtest/gtest.h"
+#include "fixed_point.h"
+#include "strategy.h"
+
+const SymbolId kFoo = SymbolTable::intern("FOO");
+const SymbolId kBar = SymbolTable::intern("BAR");
+
+TEST(FixedPointTest, PriceUnits) {
+  // IEX reports $123.4567 as 1234567.
+  EXPECT_EQ(to_price_units(1234567 / 10000.0), 1234567);
+  EXPECT_EQ(to_price_units(0.0001), 1);
+  EXPECT_EQ(to_micros(0.0009), 900);
+}
+
+TEST(FixedPortfolioTest, BuyAndSell) {
+  FixedPortfolio folio(/*cash=*/100 * kMicrosPerDollar, {kFoo, kBar});
+
+  // $50.0009 buys one share of a $50 stock and pays the fee.
+  folio.buy(/*symbol_index=*/0, /*cash_to_spend=*/50000900,
+            /*price=*/500000);
+  EXPECT_EQ(folio.shares(0), kMicroSharesPerShare);
+  EXPECT_EQ(folio.fees(), 900);
+  EXPECT_EQ(folio.cash(), 49999100);
+
+  folio.sell(/*symbol_index=*/0, /*quantity=*/kMicroSharesPerShare,
+             /*price=*/200000);
+  EXPECT_EQ(folio.shares(0), 0);
+  EXPECT_EQ(folio.cash(), 49999100 + 20000000 - 900);
+  EXPECT_EQ(folio.value_micros({200000, 300000}), folio.cash());
+}
+
+TEST(FixedPortfolioTest, DividendAndSplit) {
+  FixedPortfolio folio(/*cash=*/100 * kMicrosPerDollar, {kFoo});
+  folio.buy(/*symbol_index=*/0, /*cash_to_spend=*/20001800,
+            /*price=*/100000);
+  ASSERT_EQ(folio.shares(0), 2 * kMicroSharesPerShare);
+
+  folio.pay_dividend(/*symbol_index=*/0, /*per_share=*/to_micros(0.25));
+  EXPECT_EQ(folio.cash(), 100000000 - 20001800 + 500000);
+
+  folio.stock_split(/*symbol_index=*/0, /*ratio=*/3.0);
+  EXPECT_EQ(folio.shares(0), 6 * kMicroSharesPerShare);
+}
+
+TEST(FixedStrategyTest, WaveArbitrage) {
+  FixedWaveArbitrage wave(1000, {kFoo, kBar}, {100000, 50000}, 1.0);
+  EXPECT_TRUE(wave.price_event({50000, 100000}));
+}
+
+TEST(FixedStrategyTest, RebalancesEmptyHoldings) {
+  // Less than a cent buys no micro-shares of BAR, and leaves too little cash
+  // for that to rebalance by itself.
+  FixedWaveArbitrage wave(0.015, {kFoo, kBar}, {10000, to_price_units(1e7)},
+                          1.01);
+  ASSERT_GT(wave.portfolio().shares(0), 0);
+  ASSERT_EQ(wave.portfolio().shares(1), 0);
+
+  // As in WaveArbitrage, whose bands are infinite for an empty holding.
+  wave.price_event({10000, to_price_units(1e7)});
+  EXPECT_TRUE(wave.price_event({10000, to_price_units(1e7)}));
+}
+
+TEST(FixedStrategyTest, MatchesFloatingPoint) {
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> symbol_dist(0, 1);
+  std::normal_distribution<double> move_dist(0.0, 0.002);
+  std::vector<int64_t> fixed_prices = {200000, 400000};
+  std::vector<double> prices = {20.0, 40.0};
+
+  BuyAndHold bh(100000.0, {kFoo, kBar}, prices);
+  WaveArbitrage wave(100000.0, {kFoo, kBar}, prices, 1.01);
+  FixedBuyAndHold fixed_bh(100000.0, {kFoo, kBar}, fixed_prices);
+  FixedWaveArbitrage fixed_wave(100000.0, {kFoo, kBar}, fixed_prices, 1.01);
+
+  int rebalances = 0;
+  int fixed_rebalances = 0;
+  for (int n = 0; n < 100000; n++) {
+    const int i = symbol_dist(generator);
+    fixed_prices[i] = std::max<int64_t>(
+        50000, std::llround(fixed_prices[i] * (1.0 + move_dist(generator))));
+    prices[i] = fixed_prices[i] / 10000.0;
+    if (n == 50000) {
+      bh.pay_dividend(kFoo, 0.5);
+      wave.pay_dividend(kFoo, 0.5);
+      fixed_bh.pay_dividend(kFoo, 0.5);
+      fixed_wave.pay_dividend(kFoo, 0.5);
+    }
+
+    bh.price_event(prices);
+    rebalances += wave.price_event(prices);
+    fixed_bh.price_event(fixed_prices);
+    fixed_rebalances += fixed_wave.price_event(fixed_prices);
+  }
+
+  ASSERT_GT(rebalances, 100);
+  EXPECT_NEAR(fixed_rebalances, rebalances, rebalances / 100);
+  EXPECT_NEAR(fixed_bh.portfolio().value(fixed_prices),
+              bh.portfolio().value(prices), 0.01);
+  EXPECT_NEAR(fixed_wave.portfolio().value(fixed_prices),
+              wave.portfolio().value(prices),
+              wave.portfolio().value(prices) * 1e-4);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,199 @@
+#ifndef WAVE_ARBITRAGE_JOB_H
+#define WAVE_ARBITRAGE_JOB_H
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "feed.h"
+#include "journal.h"
+#include "strategy.h"
+#include "trace.h"
+#include "util.h"
+
+// The tick loop of job() and fan_out_job(). Keeps prices up to date with the
+// feed, converted by from_feed_price, and passes the dividends, splits and
+// price events on to every strategy that for_each_strategy visits. Stops at
+// the end of the feed, or once any price is below $5. At most once a minute
+// after a price event, calls sample() with the tick's timestamp, after adding
+// the sample to the journal if there is one.
+template <typename Price, typename FromFeedPrice, typename ForEachStrategy,
+          typename Sample>
+void replay_ticks(Feed *feed, FromFeedPrice from_feed_price,
+                  std::vector<Price> *prices, PairJournal *journal,
+                  ForEachStrategy for_each_strategy, Sample sample) {
+  static constexpr double kMinPrice = 5.0;
+  const Price min_price = from_feed_price(kMinPrice);
+
+  // Lets feeds that support it leave out stretches where no strategy would
+  // trade.
+  feed->set_skip_filter([&](const std::vector<double> &low,
+                            const std::vector<double> &high) {
+    for (auto price : low) {
+      if (price < kMinPrice) {
+        return false;
+      }
+    }
+    bool idle = true;
+    for_each_strategy([&](const auto &strategy) {
+      idle = idle && strategy.idle_within(low, high);
+    });
+    return idle;
+  });
+
+  int64_t last_hist_seconds = 0;
+
+  static constexpr size_t kBatchSize = 4096;
+  std::vector<Tick> ticks(std::max(kBatchSize, feed->max_ticks_per_adjust()));
+  const std::vector<SymbolId> &symbol_ids = feed->symbol_ids();
+
+  bool running = true;
+  while (running) {
+    TraceSpan batch_span("next batch");
+    const size_t num_ticks = feed->next_batch(ticks.data(), ticks.size());
+    batch_span.end();
+    if (num_ticks == 0) {
+      break;
+    }
+
+    TraceSpan strategy_span("strategies");
+    for (size_t t = 0; t < num_ticks; t++) {
+      const Tick &tick = ticks[t];
+
+      if (tick.flags & TICK_PRICE) {
+        (*prices)[tick.symbol_index] = from_feed_price(tick.value);
+      } else if (tick.flags & TICK_DIVIDEND) {
+        for_each_strategy([&](auto &strategy) {
+          strategy.pay_dividend(symbol_ids[tick.symbol_index], tick.value);
+        });
+      } else if (tick.flags & TICK_SPLIT) {
+        for_each_strategy([&](auto &strategy) {
+          strategy.stock_split(symbol_ids[tick.symbol_index],
+                               1.0 / tick.value);
+        });
+      } else if (tick.flags & TICK_END) {
+        running = false;
+        break;
+      }
+
+      if (!(tick.flags & TICK_EVALUATE)) {
+        continue;
+      }
+
+      bool price_threshold = true;
+      for (auto price : *prices) {
+        if (price < min_price) {
+          price_threshold = false;
+        }
+      }
+      if (!price_threshold) {
+        running = false;
+        break;
+      }
+
+      if (journal) {
+        journal->set_time(tick.seconds);
+      }
+      for_each_strategy([&](auto &strategy) { strategy.price_event(*prices); });
+
+      if (tick.seconds - 60 > last_hist_seconds) {
+        last_hist_seconds = tick.seconds;
+        Timestamp timestamp;
+        timestamp.set_seconds(tick.seconds);
+        timestamp.set_nanos(tick.nanos);
+        if (journal) {
+          journal->add_sample(tick.seconds);
+        }
+        sample(timestamp);
+      }
+    }
+  }
+  // The filter refers to this frame.
+  feed->set_skip_filter(nullptr);
+}
+
+// Pass FixedBuyAndHold and FixedWaveArbitrage to run the pair with integer
+// accounting. Returns over one year go into the stats and histograms, and
+// returns over any extra horizons are measured in the same pass.
+template <typename BuyAndHoldT = BuyAndHold,
+          typename WaveArbitrageT = WaveArbitrage>
+std::tuple<double, double>
+job(std::unique_ptr<Feed> feed, double cash, double rebalance_threshold,
+    WelfordRunningStatistics *bh_stats, WelfordRunningStatistics *wave_stats,
+    DynamicHistogram *bh_hist, DynamicHistogram *wave_hist,
+    JournalWriter *journal_writer = nullptr,
+    const std::vector<IntervalHorizon> &bh_horizons = {},
+    const std::vector<IntervalHorizon> &wave_horizons = {}) {
+  TraceSpan job_span("job");
+  typedef typename WaveArbitrageT::Price Price;
+
+  // The feed may run ahead of the strategies by up to one batch, so the
+  // prices the strategies have seen are tracked here.
+  std::vector<Price> prices;
+  for (auto price : feed->prices()) {
+    prices.push_back(WaveArbitrageT::from_feed_price(price));
+  }
+
+  // The journal comes first, so that it gets the fills of the opening buys
+  // that the strategies make when they are constructed.
+  std::unique_ptr<PairJournal> journal;
+  if (journal_writer) {
+    journal = journal_writer->acquire(
+        feed->symbols(), std::vector<string>{"BuyAndHold", "WaveArbitrage"});
+    journal->set_time(feed->timestamp().seconds());
+  }
+
+  BuyAndHoldT bh(cash, feed->symbol_ids(), prices,
+                 journal ? journal->listener(0) : nullptr);
+  WaveArbitrageT wave(cash, feed->symbol_ids(), prices, rebalance_threshold,
+                      journal ? journal->listener(1) : nullptr);
+
+  Duration dur;
+  dur.set_seconds(365 * 24 * 60 * 60);
+  Duration cooldown;
+  cooldown.set_seconds(60);
+
+  std::vector<IntervalHorizon> all_bh_horizons = {{dur, bh_stats, bh_hist}};
+  all_bh_horizons.insert(all_bh_horizons.end(), bh_horizons.begin(),
+                         bh_horizons.end());
+  std::vector<IntervalHorizon> all_wave_horizons = {
+      {dur, wave_stats, wave_hist}};
+  all_wave_horizons.insert(all_wave_horizons.end(), wave_horizons.begin(),
+                           wave_horizons.end());
+  MultiIntervalStatistics bh_si_stats(all_bh_horizons, cooldown);
+  MultiIntervalStatistics wave_si_stats(all_wave_horizons, cooldown);
+
+  replay_ticks(
+      /*feed=*/feed.get(),
+      /*from_feed_price=*/
+      [](double price) { return WaveArbitrageT::from_feed_price(price); },
+      /*prices=*/&prices, /*journal=*/journal.get(),
+      /*for_each_strategy=*/
+      [&](auto visit) {
+        visit(bh);
+        visit(wave);
+      },
+      /*sample=*/
+      [&](const Timestamp &timestamp) {
+        const double bh_value = bh.portfolio().value(prices);
+        const double wave_value = wave.portfolio().value(prices);
+        bh_si_stats.update(bh_value, timestamp);
+        wave_si_stats.update(wave_value, timestamp);
+        if (journal) {
+          journal->add_value(bh_value);
+          journal->add_value(wave_value);
+        }
+      });
+
+  if (journal) {
+    bh.set_fill_listener(nullptr);
+    wave.set_fill_listener(nullptr);
+    journal_writer->submit(std::move(journal));
+  }
+
+  return std::make_tuple(bh.portfolio().value(prices),
+                         wave.portfolio().value(prices));
+}
+
+#endif // WAVE_ARBITRAGE_JOB_H
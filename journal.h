@@ -0,0 +1,369 @@
+#ifndef WAVE_ARBITRAGE_JOURNAL_H
+#define WAVE_ARBITRAGE_JOURNAL_H
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "portfolio.h"
+
+using std::string;
+
+// The equity curves and fills of every strategy that ran against one set of
+// symbols. Rows are buffered in memory while the backtest runs, and write()
+// stores each field as its own column so that a journal file can be scanned
+// one field at a time.
+class PairJournal {
+public:
+  struct Fill {
+    int64_t seconds;
+    // Negative for sells.
+    double shares;
+    double price;
+    double fee;
+    uint8_t strategy_index;
+    uint8_t symbol_index;
+  };
+
+  PairJournal(std::vector<string> symbols, std::vector<string> strategies) {
+    reset(std::move(symbols), std::move(strategies));
+  }
+
+  // Empties the journal while keeping its buffers.
+  void reset(std::vector<string> symbols, std::vector<string> strategies) {
+    symbols_ = std::move(symbols);
+    strategies_ = std::move(strategies);
+    listeners_.clear();
+    for (size_t i = 0; i < strategies_.size(); i++) {
+      listeners_.push_back(Listener(this, i));
+    }
+    seconds_ = 0;
+    sample_seconds_.clear();
+    values_.clear();
+    fills_.clear();
+  }
+
+  // Hands out a listener that tags fills with the given strategy. The
+  // journal must not move while the listener is in use.
+  FillListener *listener(size_t strategy_index) {
+    return &listeners_[strategy_index];
+  }
+
+  // Sets the time used for the fills that follow.
+  void set_time(int64_t seconds) { seconds_ = seconds; }
+
+  // Starts a new row of the equity curve. Call add_value() once per strategy
+  // afterwards, in strategy order.
+  void add_sample(int64_t seconds) { sample_seconds_.push_back(seconds); }
+
+  void add_value(double value) { values_.push_back(value); }
+
+  const std::vector<string> &symbols() const { return symbols_; }
+
+  const std::vector<string> &strategies() const { return strategies_; }
+
+  const std::vector<int64_t> &sample_seconds() const {
+    return sample_seconds_;
+  }
+
+  double value(size_t sample_index, size_t strategy_index) const {
+    return values_[sample_index * strategies_.size() + strategy_index];
+  }
+
+  const std::vector<Fill> &fills() const { return fills_; }
+
+  void write(std::ostream *out) const {
+    CHECK_EQ(values_.size(), sample_seconds_.size() * strategies_.size());
+
+    write_value<uint32_t>(out, kBlockMagic);
+    write_strings(out, symbols_);
+    write_strings(out, strategies_);
+
+    write_value<uint64_t>(out, sample_seconds_.size());
+    write_column(out, sample_seconds_);
+    for (size_t s = 0; s < strategies_.size(); s++) {
+      write_field<double>(out, sample_seconds_.size(), [&](size_t i) {
+        return values_[i * strategies_.size() + s];
+      });
+    }
+
+    write_value<uint64_t>(out, fills_.size());
+    write_field<int64_t>(out, fills_.size(),
+                         [&](size_t i) { return fills_[i].seconds; });
+    write_field<uint8_t>(out, fills_.size(),
+                         [&](size_t i) { return fills_[i].strategy_index; });
+    write_field<uint8_t>(out, fills_.size(),
+                         [&](size_t i) { return fills_[i].symbol_index; });
+    write_field<double>(out, fills_.size(),
+                        [&](size_t i) { return fills_[i].shares; });
+    write_field<double>(out, fills_.size(),
+                        [&](size_t i) { return fills_[i].price; });
+    write_field<double>(out, fills_.size(),
+                        [&](size_t i) { return fills_[i].fee; });
+  }
+
+  // Returns null at the end of the input.
+  static std::unique_ptr<PairJournal> read(std::istream *in) {
+    uint32_t magic;
+    if (!in->read(reinterpret_cast<char *>(&magic), sizeof(magic))) {
+      return nullptr;
+    }
+    CHECK_EQ(magic, kBlockMagic);
+
+    std::vector<string> symbols = read_strings(in);
+    std::vector<string> strategies = read_strings(in);
+    auto journal = std::make_unique<PairJournal>(symbols, strategies);
+
+    const uint64_t num_samples = read_value<uint64_t>(in);
+    read_column(in, num_samples, &journal->sample_seconds_);
+    journal->values_.resize(num_samples * strategies.size());
+    for (size_t s = 0; s < strategies.size(); s++) {
+      std::vector<double> column;
+      read_column(in, num_samples, &column);
+      for (size_t i = 0; i < num_samples; i++) {
+        journal->values_[i * strategies.size() + s] = column[i];
+      }
+    }
+
+    const uint64_t num_fills = read_value<uint64_t>(in);
+    std::vector<int64_t> seconds;
+    std::vector<uint8_t> strategy_idxs;
+    std::vector<uint8_t> symbol_idxs;
+    std::vector<double> shares;
+    std::vector<double> prices;
+    std::vector<double> fees;
+    read_column(in, num_fills, &seconds);
+    read_column(in, num_fills, &strategy_idxs);
+    read_column(in, num_fills, &symbol_idxs);
+    read_column(in, num_fills, &shares);
+    read_column(in, num_fills, &prices);
+    read_column(in, num_fills, &fees);
+    CHECK(in->good());
+
+    journal->fills_.reserve(num_fills);
+    for (size_t i = 0; i < num_fills; i++) {
+      journal->fills_.push_back(Fill{seconds[i], shares[i], prices[i],
+                                     fees[i], strategy_idxs[i],
+                                     symbol_idxs[i]});
+    }
+
+    return journal;
+  }
+
+private:
+  static constexpr uint32_t kBlockMagic = 0x4a415057; // "WPAJ"
+
+  class Listener : public FillListener {
+  public:
+    Listener(PairJournal *journal, size_t strategy_index)
+        : journal_(journal), strategy_index_(strategy_index) {}
+
+    void on_fill(size_t symbol_index, double shares, double price,
+                 double fee) override {
+      journal_->fills_.push_back(
+          Fill{journal_->seconds_, shares, price, fee, strategy_index_,
+               static_cast<uint8_t>(symbol_index)});
+    }
+
+  private:
+    PairJournal *journal_;
+    uint8_t strategy_index_;
+  };
+
+  std::vector<string> symbols_;
+  std::vector<string> strategies_;
+  std::vector<Listener> listeners_;
+  int64_t seconds_ = 0;
+
+  std::vector<int64_t> sample_seconds_;
+  // One row per sample, one column per strategy.
+  std::vector<double> values_;
+  std::vector<Fill> fills_;
+
+  template <typename T> static void write_value(std::ostream *out, T val) {
+    out->write(reinterpret_cast<const char *>(&val), sizeof(val));
+  }
+
+  template <typename T> static T read_value(std::istream *in) {
+    T val{};
+    in->read(reinterpret_cast<char *>(&val), sizeof(val));
+    return val;
+  }
+
+  template <typename T>
+  static void write_column(std::ostream *out, const std::vector<T> &column) {
+    out->write(reinterpret_cast<const char *>(column.data()),
+               column.size() * sizeof(T));
+  }
+
+  // Writes get(0), ..., get(size - 1) as one column.
+  template <typename T, typename GetFn>
+  static void write_field(std::ostream *out, size_t size, GetFn get) {
+    std::vector<T> column(size);
+    for (size_t i = 0; i < size; i++) {
+      column[i] = get(i);
+    }
+    write_column(out, column);
+  }
+
+  template <typename T>
+  static void read_column(std::istream *in, size_t size,
+                          std::vector<T> *column) {
+    column->resize(size);
+    in->read(reinterpret_cast<char *>(column->data()), size * sizeof(T));
+  }
+
+  static void write_strings(std::ostream *out,
+                            const std::vector<string> &strs) {
+    write_value<uint32_t>(out, strs.size());
+    for (const auto &str : strs) {
+      write_value<uint32_t>(out, str.size());
+      out->write(str.data(), str.size());
+    }
+  }
+
+  static std::vector<string> read_strings(std::istream *in) {
+    std::vector<string> strs(read_value<uint32_t>(in));
+    for (auto &str : strs) {
+      str.resize(read_value<uint32_t>(in));
+      in->read(str.data(), str.size());
+    }
+    return strs;
+  }
+};
+
+// Appends finished PairJournals to a file from a background thread, so that
+// the backtest workers only wait on the disk once kMaxQueuedJournals are
+// queued. Write errors are fatal rather than leaving a truncated journal.
+class JournalWriter {
+public:
+  JournalWriter(const string &filename)
+      : out_(filename, std::ios::out | std::ios::binary | std::ios::trunc) {
+    CHECK(out_.good()) << filename;
+    out_.write(kFileMagic, sizeof(kFileMagic));
+    writer_ = std::thread([this]() { drain(); });
+  }
+
+  ~JournalWriter() { close(); }
+
+  // Returns an empty journal. Journals that have already been written are
+  // recycled so that their buffers don't have to grow from scratch again.
+  std::unique_ptr<PairJournal> acquire(std::vector<string> symbols,
+                                       std::vector<string> strategies) {
+    std::unique_ptr<PairJournal> journal;
+    {
+      std::scoped_lock<std::mutex> lock(mu_);
+      if (!free_.empty()) {
+        journal = std::move(free_.back());
+        free_.pop_back();
+      }
+    }
+
+    if (journal) {
+      journal->reset(std::move(symbols), std::move(strategies));
+    } else {
+      journal = std::make_unique<PairJournal>(std::move(symbols),
+                                              std::move(strategies));
+    }
+    return journal;
+  }
+
+  // Blocks while the writer is kMaxQueuedJournals behind.
+  void submit(std::unique_ptr<PairJournal> journal) {
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      space_cv_.wait(lock,
+                     [&]() { return queue_.size() < kMaxQueuedJournals; });
+      CHECK(!closed_);
+      queue_.push_back(std::move(journal));
+    }
+    cv_.notify_one();
+  }
+
+  // Blocks until every submitted journal has been written.
+  void close() {
+    {
+      std::scoped_lock<std::mutex> lock(mu_);
+      if (closed_) {
+        return;
+      }
+      closed_ = true;
+    }
+    cv_.notify_one();
+    writer_.join();
+    out_.close();
+    CHECK(!out_.fail()) << "Failed to close the journal";
+  }
+
+  // Reads back every journal in a file written by a JournalWriter.
+  static std::vector<std::unique_ptr<PairJournal>>
+  read_file(const string &filename) {
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    CHECK(in.good()) << filename;
+    char magic[sizeof(kFileMagic)];
+    in.read(magic, sizeof(magic));
+    CHECK_EQ(memcmp(magic, kFileMagic, sizeof(magic)), 0) << filename;
+
+    std::vector<std::unique_ptr<PairJournal>> journals;
+    while (auto journal = PairJournal::read(&in)) {
+      journals.push_back(std::move(journal));
+    }
+    return journals;
+  }
+
+private:
+  // The trailing digit is the format version.
+  static constexpr char kFileMagic[8] = {'W', 'A', 'V', 'E',
+                                         'J', 'R', 'N', '1'};
+  static constexpr size_t kMaxFreeJournals = 256;
+  static constexpr size_t kMaxQueuedJournals = kMaxFreeJournals;
+
+  std::ofstream out_;
+  std::thread writer_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // Signalled when the writer takes the queue, for blocked submitters.
+  std::condition_variable space_cv_;
+  std::deque<std::unique_ptr<PairJournal>> queue_;
+  std::vector<std::unique_ptr<PairJournal>> free_;
+  bool closed_ = false;
+
+  void drain() {
+    while (true) {
+      std::deque<std::unique_ptr<PairJournal>> batch;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [&]() { return closed_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        batch.swap(queue_);
+      }
+      space_cv_.notify_all();
+
+      for (const auto &journal : batch) {
+        journal->write(&out_);
+        CHECK(out_.good()) << "Failed to write a journal";
+      }
+      out_.flush();
+      CHECK(out_.good()) << "Failed to flush the journal";
+
+      std::scoped_lock<std::mutex> lock(mu_);
+      for (auto &journal : batch) {
+        if (free_.size() < kMaxFreeJournals) {
+          free_.push_back(std::move(journal));
+        }
+      }
+    }
+  }
+};
+
+#endif // WAVE_ARBITRAGE_JOURNAL_H
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "job.h"
+#include "journal.h"
+#include "strategy.h"
+#include "synthetic_data_testing.h"
+
+const SymbolId kFoo = SymbolTable::intern("FOO");
+const SymbolId kBar = SymbolTable::intern("BAR");
+
+TEST(JournalTest, RecordsFills) {
+  PairJournal journal({"FOO", "BAR"}, {"WaveArbitrage"});
+  WaveArbitrage wave(1000, {kFoo, kBar}, {10.0, 5.0}, 1.0);
+  wave.set_fill_listener(journal.listener(0));
+
+  journal.set_time(100);
+  EXPECT_TRUE(wave.price_event({5.0, 10.0}));
+
+  const auto &fills = journal.fills();
+  ASSERT_EQ(fills.size(), 2);
+  EXPECT_EQ(fills[0].seconds, 100);
+  EXPECT_EQ(fills[0].strategy_index, 0);
+  // The rebalance sells the winner before buying the loser.
+  EXPECT_EQ(fills[0].symbol_index, 1);
+  EXPECT_LT(fills[0].shares, 0.0);
+  EXPECT_EQ(fills[0].price, 10.0);
+  EXPECT_EQ(fills[1].symbol_index, 0);
+  EXPECT_GT(fills[1].shares, 0.0);
+  EXPECT_GT(fills[1].fee, 0.0);
+}
+
+TEST(JournalTest, RecordsOpeningFills) {
+  PairJournal journal({"FOO", "BAR"}, {"BuyAndHold"});
+  journal.set_time(50);
+  BuyAndHold bh(1000, {kFoo, kBar}, {10.0, 5.0}, journal.listener(0));
+
+  const auto &fills = journal.fills();
+  ASSERT_EQ(fills.size(), 2);
+  for (size_t i = 0; i < fills.size(); i++) {
+    EXPECT_EQ(fills[i].seconds, 50);
+    EXPECT_EQ(fills[i].symbol_index, i);
+    EXPECT_DOUBLE_EQ(fills[i].shares, bh.portfolio().shares(i));
+  }
+}
+
+TEST(JournalTest, JobRecordsOpeningFills) {
+  SyntheticIEXConfig config;
+  config.num_symbols = 2;
+  config.num_days = 3;
+  config.trades_per_day = 100.0;
+  const auto symbols = write_test_data("journal", config);
+
+  const string filename = ::testing::TempDir() + "/journal_test_job.journal";
+  {
+    JournalWriter writer(filename);
+    WelfordRunningStatistics bh_stats;
+    WelfordRunningStatistics wave_stats;
+    DynamicHistogram bh_hist(10);
+    DynamicHistogram wave_hist(10);
+    job(/*feed=*/std::make_unique<IEXFeed>(symbols), /*cash=*/100000.0,
+        /*rebalance_threshold=*/1.001, /*bh_stats=*/&bh_stats,
+        /*wave_stats=*/&wave_stats, /*bh_hist=*/&bh_hist,
+        /*wave_hist=*/&wave_hist, /*journal_writer=*/&writer);
+  }
+
+  auto journals = JournalWriter::read_file(filename);
+  ASSERT_EQ(journals.size(), 1);
+  const auto &fills = journals[0]->fills();
+  // The opening buys of both strategies come before any other fill, at the
+  // time the feed starts.
+  ASSERT_GE(fills.size(), 4);
+  for (size_t f = 0; f < 4; f++) {
+    EXPECT_EQ(fills[f].strategy_index, f / 2);
+    EXPECT_EQ(fills[f].symbol_index, f % 2);
+    EXPECT_GT(fills[f].shares, 0.0);
+    EXPECT_GT(fills[f].seconds, 0);
+  }
+}
+
+TEST(JournalTest, RoundTrip) {
+  const string filename = ::testing::TempDir() + "/journal_test.journal";
+
+  {
+    JournalWriter writer(filename);
+    for (int pair = 0; pair < 3; pair++) {
+      auto journal = std::make_unique<PairJournal>(
+          std::vector<string>{"FOO", "BAR" + std::to_string(pair)},
+          std::vector<string>{"BuyAndHold", "WaveArbitrage"});
+      for (int i = 0; i < 10 * pair; i++) {
+        journal->add_sample(60 * i);
+        journal->add_value(1000.0 + i);
+        journal->add_value(2000.0 + i);
+      }
+      journal->set_time(42);
+      journal->listener(1)->on_fill(/*symbol_index=*/1, /*shares=*/-3.0,
+                                    /*price=*/12.5, /*fee=*/0.0027);
+      writer.submit(std::move(journal));
+    }
+  }
+
+  auto journals = JournalWriter::read_file(filename);
+  ASSERT_EQ(journals.size(), 3);
+  for (int pair = 0; pair < 3; pair++) {
+    const PairJournal &journal = *journals[pair];
+    EXPECT_EQ(journal.symbols()[1], "BAR" + std::to_string(pair));
+    EXPECT_EQ(journal.strategies()[1], "WaveArbitrage");
+    ASSERT_EQ(journal.sample_seconds().size(), 10 * pair);
+    for (int i = 0; i < 10 * pair; i++) {
+      EXPECT_EQ(journal.sample_seconds()[i], 60 * i);
+      EXPECT_EQ(journal.value(i, 0), 1000.0 + i);
+      EXPECT_EQ(journal.value(i, 1), 2000.0 + i);
+    }
+    ASSERT_EQ(journal.fills().size(), 1);
+    const auto &fill = journal.fills()[0];
+    EXPECT_EQ(fill.seconds, 42);
+    EXPECT_EQ(fill.strategy_index, 1);
+    EXPECT_EQ(fill.symbol_index, 1);
+    EXPECT_EQ(fill.shares, -3.0);
+    EXPECT_EQ(fill.price, 12.5);
+    EXPECT_EQ(fill.fee, 0.0027);
+  }
+}
+
+TEST(JournalTest, SubmitsPastTheQueueLimit) {
+  const string filename = ::testing::TempDir() + "/journal_test.journal";
+
+  // More journals than the writer queues, so that the submitters block.
+  const int num_threads = 4;
+  const int per_thread = 1000;
+  {
+    JournalWriter writer(filename);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&writer, t]() {
+        for (int i = 0; i < per_thread; i++) {
+          auto journal = writer.acquire(
+              std::vector<string>{"FOO", "BAR"},
+              std::vector<string>{"BuyAndHold", "WaveArbitrage"});
+          journal->set_time(t * per_thread + i);
+          journal->listener(0)->on_fill(/*symbol_index=*/0, /*shares=*/1.0,
+                                        /*price=*/10.0, /*fee=*/0.0);
+          writer.submit(std::move(journal));
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  auto journals = JournalWriter::read_file(filename);
+  ASSERT_EQ(journals.size(), num_threads * per_thread);
+  std::vector<bool> seen(num_threads * per_thread);
+  for (const auto &journal : journals) {
+    ASSERT_EQ(journal->fills().size(), 1);
+    seen.at(journal->fills()[0].seconds) = true;
+  }
+  EXPECT_EQ(std::count(seen.begin(), seen.end(), true), seen.size());
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,471 @@
+#ifndef WAVE_ARBITRAGE_LIVE_H
+#define WAVE_ARBITRAGE_LIVE_H
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "coordinator.h"
+#include "feed.h"
+#include "portfolio.h"
+#include "strategy.h"
+#include "symbols.h"
+#include "util.h"
+
+using std::string;
+
+// Streams trades from a publisher, such as replay_publisher standing in for
+// an exchange, to a strategy that paper trades on them as they arrive.
+
+// Nanoseconds on CLOCK_MONOTONIC, which every process on the machine shares,
+// so latencies can be measured across processes.
+inline int64_t monotonic_nanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// One trade on the wire. Symbols travel by name, since the two ends intern
+// them separately.
+struct LiveTrade {
+  static constexpr size_t kMaxSymbolSize = 15;
+
+  // NUL padded.
+  char symbol[kMaxSymbolSize + 1];
+  int64_t seconds;
+  int32_t nanos;
+  int32_t padding;
+  // In ten-thousandths of a dollar, as IEX reports them.
+  int64_t price;
+  // monotonic_nanos() when the trade was published.
+  int64_t sent_nanos;
+
+  void set_symbol(const string &name) {
+    CHECK_LE(name.size(), kMaxSymbolSize) << name;
+    memset(symbol, 0, sizeof(symbol));
+    memcpy(symbol, name.data(), name.size());
+  }
+};
+
+class TradeSink {
+public:
+  virtual ~TradeSink() {}
+
+  // Returns false if the subscriber has gone away.
+  virtual bool publish(const LiveTrade &trade) = 0;
+
+  // Tells the subscriber that no more trades are coming.
+  virtual void close() = 0;
+};
+
+class TradeSource {
+public:
+  virtual ~TradeSource() {}
+
+  // Waits for the next trade. Returns false once the stream has ended.
+  virtual bool next(LiveTrade *trade) = 0;
+};
+
+// Spins briefly before yielding, so that a waiting reader picks up a trade
+// within a few hundred nanoseconds while it has a core to itself.
+class Backoff {
+public:
+  void wait() {
+    if (++spins_ > kMaxSpins) {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  static constexpr int kMaxSpins = 1000;
+  int spins_ = 0;
+};
+
+// A single-producer, single-consumer ring of trades in POSIX shared memory.
+// The publisher creates it and the subscriber attaches to it, in either
+// order. The publisher waits while the ring is full, so a slow subscriber
+// slows the replay down rather than losing trades, until the subscriber
+// detaches or its process exits.
+class TradeRing : public TradeSink, public TradeSource {
+public:
+  static constexpr uint64_t kMagic = 0x474e495245564157; // "WAVERING"
+  static constexpr uint32_t kVersion = 2;
+
+  // reader_pid is set to kNoReader before anyone attaches and to kDetached
+  // once the subscriber has gone.
+  static constexpr int32_t kNoReader = 0;
+  static constexpr int32_t kDetached = -1;
+
+  struct Header {
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t capacity;
+    // The writer and the reader each own a cache line.
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> closed;
+    std::atomic<int32_t> reader_pid;
+  };
+
+  ~TradeRing() {
+    if (reader_) {
+      int32_t pid = getpid();
+      header_->reader_pid.compare_exchange_strong(pid, kDetached,
+                                                  std::memory_order_release);
+    }
+    munmap(header_, size_);
+  }
+
+  // Replaces any ring that already has the name. capacity must be a power of
+  // two.
+  static std::unique_ptr<TradeRing> create(const string &name,
+                                           uint32_t capacity) {
+    CHECK_GT(capacity, 0);
+    CHECK_EQ(capacity & (capacity - 1), 0) << capacity;
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    CHECK_GE(fd, 0) << name;
+    const size_t size = sizeof(Header) + capacity * sizeof(LiveTrade);
+    CHECK_EQ(ftruncate(fd, size), 0) << name;
+    void *base =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    CHECK(base != MAP_FAILED) << name;
+
+    Header *header = new (base) Header();
+    header->capacity = capacity;
+    header->head.store(0, std::memory_order_relaxed);
+    header->tail.store(0, std::memory_order_relaxed);
+    header->closed.store(0, std::memory_order_relaxed);
+    header->reader_pid.store(kNoReader, std::memory_order_relaxed);
+    header->version = kVersion;
+    // Written last, so that attach() doesn't accept a half set up ring.
+    header->magic.store(kMagic, std::memory_order_release);
+    return std::unique_ptr<TradeRing>(
+        new TradeRing(header, size, /*reader=*/false));
+  }
+
+  // Returns null if there's no ring with the name yet. The caller becomes the
+  // ring's subscriber.
+  static std::unique_ptr<TradeRing> attach(const string &name) {
+    const int fd = shm_open(name.c_str(), O_RDWR, 0644);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0) << name;
+    if (static_cast<size_t>(st.st_size) < sizeof(Header)) {
+      ::close(fd);
+      return nullptr;
+    }
+    void *base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    ::close(fd);
+    CHECK(base != MAP_FAILED) << name;
+
+    Header *header = static_cast<Header *>(base);
+    if (header->magic.load(std::memory_order_acquire) != kMagic ||
+        header->version != kVersion ||
+        sizeof(Header) + header->capacity * sizeof(LiveTrade) !=
+            static_cast<size_t>(st.st_size)) {
+      munmap(base, st.st_size);
+      return nullptr;
+    }
+    header->reader_pid.store(getpid(), std::memory_order_release);
+    return std::unique_ptr<TradeRing>(
+        new TradeRing(header, st.st_size, /*reader=*/true));
+  }
+
+  static void unlink(const string &name) { shm_unlink(name.c_str()); }
+
+  // Waits while the ring is full, which it stays until a subscriber
+  // attaches. Returns false once the subscriber has gone.
+  bool publish(const LiveTrade &trade) override {
+    const uint64_t head = header_->head.load(std::memory_order_relaxed);
+    Backoff backoff;
+    for (int waits = 0;
+         head - header_->tail.load(std::memory_order_acquire) >= capacity_;
+         waits++) {
+      // Checking for the reader's process is a system call, so only now and
+      // then.
+      if (waits % kReaderCheckInterval == 0 && !reader_alive()) {
+        return false;
+      }
+      backoff.wait();
+    }
+    slots_[head & mask_] = trade;
+    header_->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  void close() override {
+    header_->closed.store(1, std::memory_order_release);
+  }
+
+  bool next(LiveTrade *trade) override {
+    const uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    Backoff backoff;
+    while (header_->head.load(std::memory_order_acquire) == tail) {
+      // Every trade is published before the ring is closed, so the head has
+      // to be checked again once it is.
+      if (header_->closed.load(std::memory_order_acquire) &&
+          header_->head.load(std::memory_order_acquire) == tail) {
+        return false;
+      }
+      backoff.wait();
+    }
+    *trade = slots_[tail & mask_];
+    header_->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static constexpr int kReaderCheckInterval = 1024;
+
+  TradeRing(Header *header, size_t size, bool reader)
+      : header_(header), size_(size), capacity_(header->capacity),
+        mask_(header->capacity - 1),
+        slots_(reinterpret_cast<LiveTrade *>(header + 1)), reader_(reader) {}
+
+  // Whether the subscriber may still read, which includes not having
+  // attached yet.
+  bool reader_alive() const {
+    const int32_t pid = header_->reader_pid.load(std::memory_order_acquire);
+    if (pid == kDetached) {
+      return false;
+    }
+    return pid == kNoReader || kill(pid, 0) == 0 || errno != ESRCH;
+  }
+
+  Header *header_;
+  const size_t size_;
+  const uint64_t capacity_;
+  const uint64_t mask_;
+  LiveTrade *slots_;
+  const bool reader_;
+};
+
+// Publishes trades to a single subscriber over a Unix domain socket, using
+// the helpers from coordinator.h. The constructor waits for the subscriber to
+// connect.
+class SocketTradeSink : public TradeSink {
+public:
+  SocketTradeSink(const string &socket_path) : socket_path_(socket_path) {
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(listen_fd, 0);
+    ::unlink(socket_path_.c_str());
+    const sockaddr_un addr = coordinator::socket_address(socket_path_);
+    CHECK_EQ(bind(listen_fd, reinterpret_cast<const sockaddr *>(&addr),
+                  sizeof(addr)),
+             0)
+        << socket_path_;
+    CHECK_EQ(listen(listen_fd, 1), 0);
+    fd_ = accept(listen_fd, nullptr, nullptr);
+    CHECK_GE(fd_, 0) << socket_path_;
+    ::close(listen_fd);
+  }
+
+  ~SocketTradeSink() {
+    ::close(fd_);
+    ::unlink(socket_path_.c_str());
+  }
+
+  bool publish(const LiveTrade &trade) override {
+    return coordinator::write_all(fd_, reinterpret_cast<const char *>(&trade),
+                                  sizeof(trade));
+  }
+
+  void close() override { shutdown(fd_, SHUT_WR); }
+
+private:
+  const string socket_path_;
+  int fd_;
+};
+
+class SocketTradeSource : public TradeSource {
+public:
+  // Returns null if nobody is listening on the path yet.
+  static std::unique_ptr<SocketTradeSource> connect(const string &socket_path) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0);
+    const sockaddr_un addr = coordinator::socket_address(socket_path);
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr),
+                  sizeof(addr))) {
+      ::close(fd);
+      return nullptr;
+    }
+    return std::unique_ptr<SocketTradeSource>(new SocketTradeSource(fd));
+  }
+
+  ~SocketTradeSource() { ::close(fd_); }
+
+  bool next(LiveTrade *trade) override {
+    return coordinator::read_all(fd_, reinterpret_cast<char *>(trade),
+                                 sizeof(*trade));
+  }
+
+private:
+  SocketTradeSource(int fd) : fd_(fd) {}
+
+  int fd_;
+};
+
+// Turns the trades from a source into price changes for the given symbols,
+// one trade per adjust_prices(). Trades in other symbols are skipped. The
+// constructor waits until every symbol has traded, so that prices() starts
+// out complete. Dividends and splits aren't streamed.
+class LiveFeed : public Feed {
+public:
+  LiveFeed(std::vector<string> symbols, TradeSource *source)
+      : Feed(symbols), source_(source) {
+    for (const auto &symbol : symbols_) {
+      LiveTrade key;
+      key.set_symbol(symbol);
+      keys_.push_back(string(key.symbol, sizeof(key.symbol)));
+    }
+
+    size_t num_priced = 0;
+    while (num_priced < symbols_.size()) {
+      if (adjust_prices() == FEED_END) {
+        LOG(FATAL) << "The stream ended before every symbol traded";
+      }
+      num_priced = 0;
+      for (auto price : prices_) {
+        num_priced += price > 0.0;
+      }
+    }
+  }
+
+  string feed_name() const override { return "LiveFeed"; }
+
+  FeedStatus adjust_prices() override {
+    LiveTrade trade;
+    while (source_->next(&trade)) {
+      const int64_t received_nanos = monotonic_nanos();
+      for (size_t i = 0; i < keys_.size(); i++) {
+        if (memcmp(trade.symbol, keys_[i].data(), sizeof(trade.symbol))) {
+          continue;
+        }
+        adjusts_++;
+        prices_[i] = trade.price / 10000.0;
+        timestamp_.set_seconds(trade.seconds);
+        timestamp_.set_nanos(trade.nanos);
+        updated_index_ = i;
+        sent_nanos_ = trade.sent_nanos;
+        received_nanos_ = received_nanos;
+        return FEED_OK;
+      }
+    }
+    return FEED_END;
+  }
+
+  // When the trade behind the last price change was published.
+  int64_t sent_nanos() const { return sent_nanos_; }
+
+  // When the trade behind the last price change came out of the source.
+  int64_t received_nanos() const { return received_nanos_; }
+
+private:
+  TradeSource *source_;
+  // The symbols as they appear in LiveTrade::symbol.
+  std::vector<string> keys_;
+  int64_t sent_nanos_ = 0;
+  int64_t received_nanos_ = 0;
+};
+
+// A limit order from a paper trading strategy. Sells have negative shares.
+struct LimitOrder {
+  SymbolId symbol;
+  double shares;
+  double limit_price;
+  // monotonic_nanos() when the strategy decided on the order.
+  int64_t decision_nanos;
+};
+
+class OrderSink {
+public:
+  virtual ~OrderSink() {}
+
+  virtual void submit(const LimitOrder &order) = 0;
+};
+
+// Prints every order.
+class LoggingOrderSink : public OrderSink {
+public:
+  void submit(const LimitOrder &order) override {
+    printf("%s %s %lf @ %lf\n", order.shares < 0 ? "SELL" : "BUY",
+           SymbolTable::name(order.symbol).c_str(), std::abs(order.shares),
+           order.limit_price);
+  }
+};
+
+// WaveArbitrage books each rebalance as fills at the prices it would have
+// put limit orders in at, so every fill becomes an order.
+class OrderSinkListener : public FillListener {
+public:
+  OrderSinkListener(std::vector<SymbolId> symbol_ids, OrderSink *sink)
+      : symbol_ids_(std::move(symbol_ids)), sink_(sink) {}
+
+  void on_fill(size_t symbol_index, double shares, double price,
+               double fee) override {
+    sink_->submit(LimitOrder{symbol_ids_[symbol_index], shares, price,
+                             monotonic_nanos()});
+  }
+
+private:
+  const std::vector<SymbolId> symbol_ids_;
+  OrderSink *sink_;
+};
+
+// Runs WaveArbitrage on every price change from the feed until the stream
+// ends, and sends its orders to the sink, starting with the opening buys. For
+// each trade, the time from it coming out of the source until the strategy
+// has decided what to do goes into the latency stats and histogram, in
+// nanoseconds. The time from its publication until it came out of the source
+// goes into queue_stats if that's given. When the publisher runs ahead of the
+// strategy, that includes the time the trade waited in the ring or socket.
+// Returns the number of trades.
+inline int64_t run_paper_trading(LiveFeed *feed, double cash,
+                                 double rebalance_threshold, OrderSink *sink,
+                                 WelfordRunningStatistics *latency_stats,
+                                 DynamicHistogram *latency_hist,
+                                 WelfordRunningStatistics *queue_stats =
+                                     nullptr) {
+  OrderSinkListener listener(feed->symbol_ids(), sink);
+  WaveArbitrage wave(cash, feed->symbol_ids(), feed->prices(),
+                     rebalance_threshold, &listener);
+
+  int64_t num_trades = 0;
+  while (feed->adjust_prices() != FEED_END) {
+    wave.price_event(feed->prices());
+    const int64_t latency = monotonic_nanos() - feed->received_nanos();
+    latency_stats->update(latency);
+    latency_hist->addValue(latency);
+    if (queue_stats) {
+      queue_stats->update(feed->received_nanos() - feed->sent_nanos());
+    }
+    num_trades++;
+  }
+
+  wave.set_fill_listener(nullptr);
+  return num_trades;
+}
+
+#endif // WAVE_ARBITRAGE_LIVE_H
@@ -0,0 +1,209 @@
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "live.h"
+
+namespace {
+
+LiveTrade make_trade(const string &symbol, int64_t seconds, int64_t price) {
+  LiveTrade trade;
+  trade.set_symbol(symbol);
+  trade.seconds = seconds;
+  trade.nanos = 0;
+  trade.padding = 0;
+  trade.price = price;
+  trade.sent_nanos = monotonic_nanos();
+  return trade;
+}
+
+string ring_name(const string &test) {
+  return "/wave_arbitrage_live_test_" + test + "_" + std::to_string(getpid());
+}
+
+class RecordingOrderSink : public OrderSink {
+public:
+  void submit(const LimitOrder &order) override { orders.push_back(order); }
+
+  std::vector<LimitOrder> orders;
+};
+
+class RecordingFillListener : public FillListener {
+public:
+  void on_fill(size_t symbol_index, double shares, double price,
+               double fee) override {
+    fills.push_back(std::make_tuple(symbol_index, shares, price));
+  }
+
+  std::vector<std::tuple<size_t, double, double>> fills;
+};
+
+} // namespace
+
+TEST(LiveTest, RingInOrder) {
+  const string name = ring_name("RingInOrder");
+  EXPECT_EQ(TradeRing::attach(name), nullptr);
+
+  // A small ring, so that the publisher has to wait for the subscriber.
+  auto publisher = TradeRing::create(name, /*capacity=*/16);
+  auto subscriber = TradeRing::attach(name);
+  ASSERT_NE(subscriber, nullptr);
+
+  static constexpr int kNumTrades = 10000;
+  std::thread thread([&publisher]() {
+    for (int i = 0; i < kNumTrades; i++) {
+      EXPECT_TRUE(publisher->publish(make_trade("FOO", i, 10000 + i)));
+    }
+    publisher->close();
+  });
+
+  LiveTrade trade;
+  for (int i = 0; i < kNumTrades; i++) {
+    ASSERT_TRUE(subscriber->next(&trade));
+    EXPECT_STREQ(trade.symbol, "FOO");
+    EXPECT_EQ(trade.seconds, i);
+    EXPECT_EQ(trade.price, 10000 + i);
+  }
+  EXPECT_FALSE(subscriber->next(&trade));
+  thread.join();
+  TradeRing::unlink(name);
+}
+
+TEST(LiveTest, RingNoticesDetachedReader) {
+  const string name = ring_name("RingNoticesDetachedReader");
+  auto publisher = TradeRing::create(name, /*capacity=*/4);
+  auto subscriber = TradeRing::attach(name);
+  ASSERT_NE(subscriber, nullptr);
+  subscriber.reset();
+
+  // Trades still go into the ring until it fills up.
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(publisher->publish(make_trade("FOO", i, 10000)));
+  }
+  EXPECT_FALSE(publisher->publish(make_trade("FOO", 4, 10000)));
+  TradeRing::unlink(name);
+}
+
+TEST(LiveTest, RingNoticesExitedReader) {
+  const string name = ring_name("RingNoticesExitedReader");
+  auto publisher = TradeRing::create(name, /*capacity=*/4);
+
+  // The child exits without detaching, as if it had crashed.
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    _exit(TradeRing::attach(name).release() ? 0 : 1);
+  }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(publisher->publish(make_trade("FOO", i, 10000)));
+  }
+  EXPECT_FALSE(publisher->publish(make_trade("FOO", 4, 10000)));
+  TradeRing::unlink(name);
+}
+
+TEST(LiveTest, Socket) {
+  const string path = "/tmp/wave_arbitrage_live_test_" +
+                      std::to_string(getpid()) + ".sock";
+  std::thread thread([&path]() {
+    SocketTradeSink publisher(path);
+    for (int i = 0; i < 100; i++) {
+      EXPECT_TRUE(publisher.publish(make_trade("BAR", i, 20000 + i)));
+    }
+    publisher.close();
+  });
+
+  std::unique_ptr<SocketTradeSource> subscriber;
+  while (!(subscriber = SocketTradeSource::connect(path))) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  LiveTrade trade;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(subscriber->next(&trade));
+    EXPECT_STREQ(trade.symbol, "BAR");
+    EXPECT_EQ(trade.price, 20000 + i);
+  }
+  EXPECT_FALSE(subscriber->next(&trade));
+  thread.join();
+}
+
+TEST(LiveTest, PaperTrading) {
+  const string name = ring_name("PaperTrading");
+  auto publisher = TradeRing::create(name, /*capacity=*/1024);
+  auto subscriber = TradeRing::attach(name);
+  ASSERT_NE(subscriber, nullptr);
+
+  // BAZ isn't traded, and the first FOO trade is replaced before BAR trades.
+  std::vector<LiveTrade> trades = {
+      make_trade("FOO", 1, 90000),   make_trade("BAZ", 2, 10000),
+      make_trade("FOO", 3, 100000),  make_trade("BAR", 4, 200000),
+      make_trade("FOO", 5, 120000),  make_trade("BAZ", 6, 10000),
+      make_trade("BAR", 7, 190000),  make_trade("FOO", 8, 95000),
+      make_trade("FOO", 9, 100000),  make_trade("BAR", 10, 230000),
+  };
+  for (const auto &trade : trades) {
+    publisher->publish(trade);
+  }
+  publisher->close();
+
+  LiveFeed feed({"FOO", "BAR"}, subscriber.get());
+  EXPECT_EQ(feed.prices(), (std::vector<double>{10.0, 20.0}));
+  EXPECT_EQ(feed.timestamp().seconds(), 4);
+
+  RecordingOrderSink sink;
+  WelfordRunningStatistics latency_stats;
+  DynamicHistogram latency_hist(/*max_num_buckets=*/50);
+  WelfordRunningStatistics queue_stats;
+  EXPECT_EQ(run_paper_trading(&feed, /*cash=*/1000.0,
+                              /*rebalance_threshold=*/1.01, &sink,
+                              &latency_stats, &latency_hist, &queue_stats),
+            5);
+  EXPECT_EQ(latency_stats.count(), 5);
+  EXPECT_GT(latency_stats.mean(), 0.0);
+  // Every trade was published before the first one was read.
+  EXPECT_EQ(queue_stats.count(), 5);
+  EXPECT_GT(queue_stats.mean(), 0.0);
+
+  // The orders are the fills of the same strategy run directly on the prices,
+  // including the opening buys that it makes when it's constructed.
+  const std::vector<SymbolId> symbol_ids =
+      SymbolTable::intern_all({"FOO", "BAR"});
+  RecordingFillListener listener;
+  WaveArbitrage wave(1000.0, symbol_ids, {10.0, 20.0}, 1.01, &listener);
+  ASSERT_EQ(listener.fills.size(), 2);
+  for (const auto &prices : std::vector<std::vector<double>>{
+           {12.0, 20.0}, {12.0, 19.0}, {9.5, 19.0}, {10.0, 19.0},
+           {10.0, 23.0}}) {
+    wave.price_event(prices);
+  }
+  ASSERT_GT(listener.fills.size(), 2);
+  ASSERT_EQ(sink.orders.size(), listener.fills.size());
+  // The opening buys, at the prices the feed started with.
+  EXPECT_EQ(sink.orders[0].symbol, symbol_ids[0]);
+  EXPECT_GT(sink.orders[0].shares, 0.0);
+  EXPECT_EQ(sink.orders[0].limit_price, 10.0);
+  EXPECT_EQ(sink.orders[1].symbol, symbol_ids[1]);
+  EXPECT_GT(sink.orders[1].shares, 0.0);
+  EXPECT_EQ(sink.orders[1].limit_price, 20.0);
+  for (size_t i = 0; i < sink.orders.size(); i++) {
+    EXPECT_EQ(sink.orders[i].symbol,
+              symbol_ids[std::get<0>(listener.fills[i])]);
+    EXPECT_EQ(sink.orders[i].shares, std::get<1>(listener.fills[i]));
+    EXPECT_EQ(sink.orders[i].limit_price, std::get<2>(listener.fills[i]));
+  }
+  TradeRing::unlink(name);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,180 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "feed.h"
+#include "journal.h"
+#include "sweep.h"
+#include "synthetic_data.h"
+#include "util.h"
+
+// Runs the full pair sweep from backtest over a synthetic data set, once with
+// the day files evicted from the page cache and once with them cached, so
+// that throughput can be compared on any machine without the scraped data.
+//
+//   macrobenchmark [--root=<dir>] [--symbols=<n>] [--days=<n>]
+//                  [--trades_per_day=<n>] [--seed=<n>] [--generate_only]
+//
+// The data set is written to root, along with the flags that it was made
+// with, unless it's already there. A data set that was made with other flags
+// is written again. Point backtest at it with IEX_DATA_ROOT=<dir>.
+
+// The flags that shape the data set, as they're saved next to it.
+string config_string(const SyntheticIEXConfig &config) {
+  std::ostringstream out;
+  out << "symbols=" << config.num_symbols << " days=" << config.num_days
+      << " trades_per_day=" << config.trades_per_day
+      << " seed=" << config.seed << "\n";
+  return out.str();
+}
+
+// Asks the kernel to drop the files from the page cache. This doesn't need
+// root, but pages that are mapped or dirty may stay.
+size_t evict(const string &root) {
+  size_t bytes = 0;
+  for (const auto &f : std::filesystem::recursive_directory_iterator(root)) {
+    if (!f.is_regular_file()) {
+      continue;
+    }
+    const int fd = open(f.path().c_str(), O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    bytes += f.file_size();
+  }
+  return bytes;
+}
+
+// Runs every pair through backtest's default sweep, and returns the number of
+// seconds it took.
+double sweep(const std::vector<string> &symbols,
+             JournalWriter *journal_writer = nullptr) {
+  WelfordRunningStatistics bh_stats;
+  WelfordRunningStatistics wave_stats;
+  static constexpr size_t kMaxNumBuckets = 200;
+  DynamicHistogram bh_hist(kMaxNumBuckets);
+  DynamicHistogram wave_hist(kMaxNumBuckets);
+
+  const auto start = std::chrono::steady_clock::now();
+  pair_sweep(/*symbols=*/symbols, /*segment=*/nullptr,
+             /*skip_idle_ranges=*/true, /*fixed_point=*/false,
+             /*cash=*/100000.0, /*rebalance_threshold=*/1.001,
+             /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
+             /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist,
+             /*journal_writer=*/journal_writer, /*bh_horizons=*/{},
+             /*wave_horizons=*/{});
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  google::InitGoogleLogging(argv[0]);
+
+  string root = "/tmp/wave_arbitrage_macrobenchmark";
+  SyntheticIEXConfig config;
+  bool generate_only = false;
+  for (int a = 1; a < argc; a++) {
+    const string arg = argv[a];
+    const string value = arg.substr(arg.find('=') + 1);
+    if (arg.rfind("--root=", 0) == 0) {
+      root = value;
+    } else if (arg.rfind("--symbols=", 0) == 0) {
+      config.num_symbols = std::stoi(value);
+    } else if (arg.rfind("--days=", 0) == 0) {
+      config.num_days = std::stoi(value);
+    } else if (arg.rfind("--trades_per_day=", 0) == 0) {
+      config.trades_per_day = std::stod(value);
+    } else if (arg.rfind("--seed=", 0) == 0) {
+      config.seed = std::stoull(value);
+    } else if (arg == "--generate_only") {
+      generate_only = true;
+    } else {
+      LOG(FATAL) << "Unknown flag " << arg;
+    }
+  }
+
+  const string config_filename = root + "/macrobenchmark.config";
+  bool generate = true;
+  if (std::filesystem::exists(root + "/processed")) {
+    std::ifstream in(config_filename);
+    CHECK(in) << root << " has data that macrobenchmark didn't write, or that "
+              << "it didn't finish writing. Remove it or pick another --root";
+    std::stringstream saved;
+    saved << in.rdbuf();
+    generate = saved.str() != config_string(config);
+    if (generate) {
+      printf("%s was made with %s", root.c_str(), saved.str().c_str());
+      std::filesystem::remove(config_filename);
+      std::filesystem::remove_all(root + "/processed");
+      std::filesystem::remove_all(root + "/dividends");
+    }
+  }
+  if (generate) {
+    const auto start = std::chrono::steady_clock::now();
+    write_synthetic_iex(root, config);
+    std::ofstream(config_filename) << config_string(config);
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    printf("generated %s in %.3lf s\n", root.c_str(), elapsed.count());
+  } else {
+    printf("using %s\n", root.c_str());
+  }
+  if (generate_only) {
+    return 0;
+  }
+
+  set_iex_data_root(root);
+  const std::vector<string> symbols = get_available_symbols();
+  const size_t num_pairs = symbols.size() * (symbols.size() - 1) / 2;
+  printf("symbols: %zu, pairs: %zu, threads: %u\n", symbols.size(),
+         num_pairs, std::thread::hardware_concurrency());
+
+  double warm_seconds = 0.0;
+  for (bool cold : {true, false}) {
+    const size_t bytes = evict(root);
+    if (!cold) {
+      // Reads everything once, so that the timed run is fully cached.
+      sweep(symbols);
+    }
+
+    const double seconds = sweep(symbols);
+    // Every pair reads both of its symbols' files.
+    printf("%s: %.3lf s, %.1lf pairs/s, %.1lf MB/s of day files\n",
+           cold ? "cold" : "warm", seconds, num_pairs / seconds,
+           bytes * (symbols.size() - 1) / seconds / 1e6);
+    if (!cold) {
+      warm_seconds = seconds;
+    }
+  }
+
+  // The warm sweep again with every pair journaled, counting the time to
+  // write out the last journals.
+  const string journal_filename = root + "/macrobenchmark.journal";
+  const auto start = std::chrono::steady_clock::now();
+  {
+    JournalWriter writer(journal_filename);
+    sweep(symbols, &writer);
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("journaled: %.3lf s, %.1lf%% over warm, %.1lf MB of journal\n",
+         elapsed.count(), 100.0 * (elapsed.count() / warm_seconds - 1.0),
+         std::filesystem::file_size(journal_filename) / 1e6);
+  std::filesystem::remove(journal_filename);
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "live.h"
+#include "util.h"
+
+// Paper trades WaveArbitrage on the stream from replay_publisher, printing
+// the limit orders it would place, and then reports how long the strategy
+// took to decide after each trade was published.
+//
+//   paper_trade --symbols=<a>,<b>[,...] [--ring=<shm name>]
+//               [--socket=<path>] [--cash=<n>] [--threshold=<n>] [--quiet]
+//
+// Use the same --symbols and --ring or --socket as the publisher. Either side
+// can be started first.
+
+// Counts the orders without printing them, for --quiet.
+class CountingOrderSink : public OrderSink {
+public:
+  void submit(const LimitOrder &order) override { num_orders++; }
+
+  int64_t num_orders = 0;
+};
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<string> symbols;
+  string ring_name = "/wave_arbitrage_live";
+  string socket_path;
+  double cash = 100000.0;
+  double rebalance_threshold = 1.001;
+  bool quiet = false;
+  for (int a = 1; a < argc; a++) {
+    const string arg = argv[a];
+    const string value = arg.substr(arg.find('=') + 1);
+    if (arg.rfind("--symbols=", 0) == 0) {
+      std::istringstream in(value);
+      string symbol;
+      while (std::getline(in, symbol, ',')) {
+        symbols.push_back(symbol);
+      }
+    } else if (arg.rfind("--ring=", 0) == 0) {
+      ring_name = value;
+    } else if (arg.rfind("--socket=", 0) == 0) {
+      socket_path = value;
+    } else if (arg.rfind("--cash=", 0) == 0) {
+      cash = std::stod(value);
+    } else if (arg.rfind("--threshold=", 0) == 0) {
+      rebalance_threshold = std::stod(value);
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else {
+      LOG(FATAL) << "Unknown flag " << arg;
+    }
+  }
+  CHECK(!symbols.empty()) << "--symbols is required";
+
+  std::unique_ptr<TradeSource> source;
+  while (!source) {
+    if (!socket_path.empty()) {
+      source = SocketTradeSource::connect(socket_path);
+    } else {
+      source = TradeRing::attach(ring_name);
+    }
+    if (!source) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  LiveFeed feed(symbols, source.get());
+  LoggingOrderSink logging_sink;
+  CountingOrderSink counting_sink;
+
+  WelfordRunningStatistics latency_stats;
+  static constexpr size_t kMaxNumBuckets = 200;
+  DynamicHistogram latency_hist(kMaxNumBuckets);
+  WelfordRunningStatistics queue_stats;
+  const int64_t num_trades = run_paper_trading(
+      &feed, cash, rebalance_threshold,
+      quiet ? static_cast<OrderSink *>(&counting_sink) : &logging_sink,
+      &latency_stats, &latency_hist, &queue_stats);
+  if (socket_path.empty()) {
+    TradeRing::unlink(ring_name);
+  }
+
+  printf("trades: %ld\n", num_trades);
+  if (quiet) {
+    printf("orders: %ld\n", counting_sink.num_orders);
+  }
+  printf("tick to decision latency (us): mean %.3lf",
+         latency_stats.mean() / 1e3);
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    printf(", p%g %.3lf", 100 * q, latency_hist.getQuantileEstimate(q) / 1e3);
+  }
+  printf("\n");
+  // With --speed=0 on the publisher, this is mostly time spent queued.
+  printf("publish to tick latency (us): mean %.3lf\n",
+         queue_stats.mean() / 1e3);
+  return 0;
+}
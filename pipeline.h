@@ -0,0 +1,183 @@
+#ifndef WAVE_ARBITRAGE_PIPELINE_H
+#define WAVE_ARBITRAGE_PIPELINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+
+// A bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two.
+template <typename T> class SpscRing {
+public:
+  SpscRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    buffer_.resize(size);
+    mask_ = size - 1;
+  }
+
+  size_t capacity() const { return buffer_.size(); }
+
+  // Returns false if the ring is full. Only the producer may call this.
+  bool try_push(const T &val) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ >= buffer_.size()) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ >= buffer_.size()) {
+        return false;
+      }
+    }
+    buffer_[tail & mask_] = val;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false if the ring is empty. Only the consumer may call this.
+  bool try_pop(T *val) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    *val = buffer_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  std::vector<T> buffer_;
+  size_t mask_;
+
+  // The consumer owns head_ and the producer owns tail_. Each side keeps a
+  // stale copy of the other side's index so that it only touches the shared
+  // cache line when the ring looks full or empty.
+  alignas(kCacheLineSize) std::atomic<size_t> head_ = 0;
+  size_t cached_tail_ = 0;
+  alignas(kCacheLineSize) std::atomic<size_t> tail_ = 0;
+  size_t cached_head_ = 0;
+};
+
+// Wraps another feed and runs its next_batch() on a separate decoder thread.
+// The decoded ticks are handed over through an SpscRing, so the thread that
+// evaluates strategies only ever applies small tick records. The feed ends
+// when the inner feed runs out, even if it stops without a TICK_END, as a
+// feed over a range of days does.
+class PipelinedFeed : public Feed {
+public:
+  PipelinedFeed(std::unique_ptr<Feed> feed, size_t capacity = 1 << 16)
+      : Feed(feed->symbols()), feed_(std::move(feed)),
+        ring_(std::max(capacity, feed_->max_ticks_per_adjust())) {
+    prices_ = feed_->prices();
+    timestamp_ = feed_->timestamp();
+    decoder_ = std::thread([this]() { decode(); });
+  }
+
+  ~PipelinedFeed() {
+    stop_.store(true, std::memory_order_release);
+    decoder_.join();
+  }
+
+  string feed_name() const override {
+    return "PipelinedFeed(" + feed_->feed_name() + ")";
+  }
+
+  FeedStatus adjust_prices() override {
+    adjusts_++;
+    if (batch_ended_) {
+      return FEED_END;
+    }
+
+    FeedStatus fs = 0;
+    int num_prices = 0;
+    Tick tick;
+    while (true) {
+      pop(&tick);
+      apply_tick(tick);
+      if (tick.flags & TICK_DIVIDEND) {
+        fs |= FEED_DIVIDEND;
+      } else if (tick.flags & TICK_SPLIT) {
+        fs |= FEED_SPLIT;
+      } else if (tick.flags & TICK_PRICE) {
+        num_prices++;
+        updated_index_ = num_prices == 1 ? tick.symbol_index : -1;
+      }
+
+      if (tick.flags & TICK_END) {
+        return fs | FEED_END;
+      } else if (tick.flags & TICK_EVALUATE) {
+        return fs | ((tick.flags & TICK_DAY_CHANGE) ? FEED_DAY_CHANGE
+                                                     : FEED_OK);
+      }
+    }
+  }
+
+  size_t next_batch(Tick *ticks, size_t capacity) override {
+    CHECK_GE(capacity, max_ticks_per_adjust());
+    size_t n = 0;
+    while (!batch_ended_ && capacity - n >= max_ticks_per_adjust()) {
+      // Only whole adjustments are handed out.
+      while (true) {
+        Tick &tick = ticks[n++];
+        pop(&tick);
+        apply_tick(tick);
+        if (tick.flags & (TICK_EVALUATE | TICK_END)) {
+          break;
+        }
+      }
+    }
+    return n;
+  }
+
+private:
+  std::unique_ptr<Feed> feed_;
+  SpscRing<Tick> ring_;
+  std::thread decoder_;
+  std::atomic<bool> stop_ = false;
+
+  void decode() {
+    Tracer::set_thread_name("decoder");
+    std::vector<Tick> ticks(std::max(static_cast<size_t>(4096),
+                                     feed_->max_ticks_per_adjust()));
+    Tick last{feed_->timestamp().seconds(), feed_->timestamp().nanos(), -1,
+              0.0, 0};
+    while (!(last.flags & TICK_END)) {
+      TraceSpan decode_span("decode batch");
+      size_t n = feed_->next_batch(ticks.data(), ticks.size());
+      decode_span.end();
+      if (n == 0) {
+        // Ends the feed for pop(), at the time of the last tick.
+        ticks[n++] = Tick{last.seconds, last.nanos, -1, 0.0, TICK_END};
+      }
+      last = ticks[n - 1];
+      TraceSpan push_span("push batch");
+      for (size_t i = 0; i < n; i++) {
+        while (!ring_.try_push(ticks[i])) {
+          if (stop_.load(std::memory_order_acquire)) {
+            return;
+          }
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  void pop(Tick *tick) {
+    while (!ring_.try_pop(tick)) {
+      std::this_thread::yield();
+    }
+  }
+};
+
+#endif // WAVE_ARBITRAGE_PIPELINE_H
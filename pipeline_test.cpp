@@ -0,0 +1,159 @@
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "pipeline.h"
+
+// Deterministic feed that alternates single-symbol moves with moves of every
+// symbol, and pays a dividend on every tenth adjustment.
+class CountingFeed : public Feed {
+public:
+  CountingFeed(int lifespan) : Feed({"FOO", "BAR"}), lifespan_(lifespan) {
+    prices_ = {10.0, 20.0};
+  }
+
+  string feed_name() const override { return "CountingFeed"; }
+
+  FeedStatus adjust_prices() override {
+    adjusts_++;
+    if (num_adjusts_++ >= lifespan_) {
+      return FEED_END;
+    }
+
+    FeedStatus fs = FEED_OK;
+    if (num_adjusts_ % 3 == 0) {
+      updated_index_ = -1;
+      prices_[0] += 0.01;
+      prices_[1] -= 0.01;
+    } else {
+      updated_index_ = num_adjusts_ % 2;
+      prices_[updated_index_] += 0.02;
+    }
+    if (num_adjusts_ % 10 == 0) {
+      fs = FEED_DAY_CHANGE | FEED_DIVIDEND;
+      dividends_[1] = num_adjusts_ / 1000.0;
+    }
+    timestamp_.set_seconds(timestamp_.seconds() + 1);
+    timestamp_.set_nanos(num_adjusts_ % 1000);
+    return fs;
+  }
+
+private:
+  const int lifespan_;
+  int num_adjusts_ = 0;
+};
+
+// Hands out one adjustment and then stops without a TICK_END, like an IEXFeed
+// over a range of days.
+class RangeFeed : public Feed {
+public:
+  RangeFeed() : Feed({"FOO", "BAR"}) { prices_ = {10.0, 20.0}; }
+
+  string feed_name() const override { return "RangeFeed"; }
+
+  FeedStatus adjust_prices() override { return FEED_END; }
+
+  size_t next_batch(Tick *ticks, size_t capacity) override {
+    if (done_) {
+      return 0;
+    }
+    done_ = true;
+    ticks[0] = Tick{42, 7, 0, 11.0, TICK_PRICE};
+    ticks[1] = Tick{42, 7, 1, 21.0, TICK_PRICE | TICK_EVALUATE};
+    return 2;
+  }
+
+private:
+  bool done_ = false;
+};
+
+TEST(PipelineTest, SpscRingOrder) {
+  SpscRing<int> ring(100);
+  EXPECT_EQ(ring.capacity(), 128);
+
+  static constexpr int kCount = 1000000;
+  std::thread producer([&]() {
+    for (int i = 0; i < kCount; i++) {
+      while (!ring.try_push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  int val;
+  for (int i = 0; i < kCount; i++) {
+    while (!ring.try_pop(&val)) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(val, i);
+  }
+  EXPECT_FALSE(ring.try_pop(&val));
+  producer.join();
+}
+
+TEST(PipelineTest, SpscRingFull) {
+  SpscRing<int> ring(4);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(ring.try_push(i));
+  }
+  EXPECT_FALSE(ring.try_push(4));
+
+  int val;
+  EXPECT_TRUE(ring.try_pop(&val));
+  EXPECT_EQ(val, 0);
+  EXPECT_TRUE(ring.try_push(4));
+}
+
+TEST(PipelineTest, MatchesInnerFeed) {
+  CountingFeed expected(/*lifespan=*/10000);
+  PipelinedFeed feed(std::make_unique<CountingFeed>(/*lifespan=*/10000),
+                     /*capacity=*/64);
+  EXPECT_EQ(feed.prices(), expected.prices());
+
+  while (true) {
+    FeedStatus expected_fs = expected.adjust_prices();
+    FeedStatus fs = feed.adjust_prices();
+    ASSERT_EQ(fs, expected_fs);
+    if (fs & FEED_END) {
+      break;
+    }
+    ASSERT_EQ(feed.prices(), expected.prices());
+    ASSERT_EQ(feed.updated_index(), expected.updated_index());
+    ASSERT_EQ(feed.timestamp().seconds(), expected.timestamp().seconds());
+    ASSERT_EQ(feed.timestamp().nanos(), expected.timestamp().nanos());
+    if (fs & FEED_DIVIDEND) {
+      ASSERT_EQ(feed.dividends(), expected.dividends());
+    }
+  }
+  EXPECT_EQ(feed.adjust_prices(), FEED_END);
+}
+
+TEST(PipelineTest, InnerFeedWithoutEnd) {
+  PipelinedFeed feed(std::make_unique<RangeFeed>(), /*capacity=*/16);
+  EXPECT_EQ(feed.adjust_prices(), FEED_OK);
+  EXPECT_EQ(feed.prices(), (std::vector<double>{11.0, 21.0}));
+  EXPECT_EQ(feed.adjust_prices(), FEED_END);
+  EXPECT_EQ(feed.timestamp().seconds(), 42);
+  EXPECT_EQ(feed.timestamp().nanos(), 7);
+  EXPECT_EQ(feed.adjust_prices(), FEED_END);
+
+  Tick ticks[16];
+  PipelinedFeed batched(std::make_unique<RangeFeed>(), /*capacity=*/16);
+  ASSERT_EQ(batched.next_batch(ticks, 16), 3);
+  EXPECT_EQ(ticks[1].flags, TICK_PRICE | TICK_EVALUATE);
+  EXPECT_EQ(ticks[2].flags, TICK_END);
+  EXPECT_EQ(batched.next_batch(ticks, 16), 0);
+}
+
+TEST(PipelineTest, EarlyDestruction) {
+  // The decoder thread must not hang when the consumer stops early.
+  PipelinedFeed feed(std::make_unique<CountingFeed>(/*lifespan=*/1000000),
+                     /*capacity=*/16);
+  feed.adjust_prices();
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,166 @@
+#ifndef WAVE_ARBITRAGE_PLACEMENT_H
+#define WAVE_ARBITRAGE_PLACEMENT_H
+
+#include <numa.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+// The CPUs of each NUMA node.
+class NumaTopology {
+public:
+  NumaTopology(std::vector<std::vector<int>> node_cpus)
+      : node_cpus_(std::move(node_cpus)) {
+    CHECK(!node_cpus_.empty());
+    for (const auto &cpus : node_cpus_) {
+      CHECK(!cpus.empty());
+    }
+  }
+
+  // Asks libnuma, and falls back to a single node holding every CPU if the
+  // kernel doesn't support NUMA.
+  static NumaTopology detect() {
+    std::vector<std::vector<int>> node_cpus;
+    if (numa_available() >= 0) {
+      struct bitmask *mask = numa_allocate_cpumask();
+      for (int node = 0; node <= numa_max_node(); node++) {
+        std::vector<int> cpus;
+        if (numa_node_to_cpus(node, mask) == 0) {
+          for (int cpu = 0; cpu < numa_num_configured_cpus(); cpu++) {
+            if (numa_bitmask_isbitset(mask, cpu)) {
+              cpus.push_back(cpu);
+            }
+          }
+        }
+        // Memory-only nodes have no CPUs to run workers on.
+        if (!cpus.empty()) {
+          node_cpus.push_back(cpus);
+        }
+      }
+      numa_free_cpumask(mask);
+    }
+
+    if (node_cpus.empty()) {
+      std::vector<int> cpus;
+      for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency();
+           cpu++) {
+        cpus.push_back(cpu);
+      }
+      node_cpus.push_back(cpus);
+    }
+    return NumaTopology(node_cpus);
+  }
+
+  size_t num_nodes() const { return node_cpus_.size(); }
+
+  const std::vector<int> &cpus(size_t node) const { return node_cpus_[node]; }
+
+  // The same topology with only the first num_nodes nodes.
+  NumaTopology first_nodes(size_t num_nodes) const {
+    CHECK_LE(num_nodes, node_cpus_.size());
+    return NumaTopology(std::vector<std::vector<int>>(
+        node_cpus_.begin(), node_cpus_.begin() + num_nodes));
+  }
+
+private:
+  std::vector<std::vector<int>> node_cpus_;
+};
+
+// Pins the calling thread to one CPU. Allocations made afterwards land on the
+// CPU's node under the kernel's default first-touch policy.
+inline bool pin_to_cpu(int cpu) {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+}
+
+// Starts one thread per CPU of the topology, each pinned to its CPU, and
+// waits for them. fn is called with the thread's node and its index within
+// the node. With pin set to false the threads are left to the scheduler, but
+// still get the same node and index.
+inline void run_on_nodes(const NumaTopology &topology, bool pin,
+                         std::function<void(size_t node, size_t index)> fn) {
+  std::vector<std::thread> threads;
+  for (size_t node = 0; node < topology.num_nodes(); node++) {
+    for (size_t index = 0; index < topology.cpus(node).size(); index++) {
+      const int cpu = topology.cpus(node)[index];
+      threads.push_back(std::thread([&fn, node, index, cpu, pin]() {
+        if (pin && !pin_to_cpu(cpu)) {
+          LOG(WARNING) << "Couldn't pin to CPU " << cpu;
+        }
+        fn(node, index);
+      }));
+    }
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+// One copy of some data per NUMA node, for read-mostly data that every worker
+// looks at and for per-node accumulators. Each copy is made by a thread
+// running on that node, so its pages are allocated there.
+template <typename T> class NodeReplicas {
+public:
+  NodeReplicas(const NumaTopology &topology,
+               std::function<std::unique_ptr<T>()> make)
+      : replicas_(topology.num_nodes()) {
+    for (size_t node = 0; node < topology.num_nodes(); node++) {
+      const int cpu = topology.cpus(node)[0];
+      std::thread([&, node, cpu]() {
+        pin_to_cpu(cpu);
+        replicas_[node] = make();
+      }).join();
+    }
+  }
+
+  size_t size() const { return replicas_.size(); }
+
+  const T &get(size_t node) const { return *replicas_[node]; }
+
+  T *mutable_get(size_t node) { return replicas_[node].get(); }
+
+private:
+  std::vector<std::unique_ptr<T>> replicas_;
+};
+
+// Work items split into one queue per node. Workers take from their own
+// node's queue first, and steal from the other nodes once it runs dry.
+template <typename T> class NodeQueues {
+public:
+  NodeQueues(size_t num_nodes) : queues_(num_nodes) {}
+
+  void push(size_t node, T item) { queues_[node].items.push_back(item); }
+
+  // Sets item and returns true if there was any work left.
+  bool next(size_t node, T *item) {
+    for (size_t n = 0; n < queues_.size(); n++) {
+      Queue &queue = queues_[(node + n) % queues_.size()];
+      const size_t idx = queue.next.fetch_add(1, std::memory_order_relaxed);
+      if (idx < queue.items.size()) {
+        *item = queue.items[idx];
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  struct Queue {
+    std::vector<T> items;
+    // Each counter gets its own cache line so that nodes don't share one.
+    alignas(64) std::atomic<size_t> next = 0;
+  };
+
+  std::vector<Queue> queues_;
+};
+
+#endif // WAVE_ARBITRAGE_PLACEMENT_H
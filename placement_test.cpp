@@ -0,0 +1,74 @@
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "placement.h"
+
+TEST(PlacementTest, DetectFindsEveryNode) {
+  const NumaTopology topology = NumaTopology::detect();
+  ASSERT_GE(topology.num_nodes(), 1);
+  for (size_t node = 0; node < topology.num_nodes(); node++) {
+    EXPECT_FALSE(topology.cpus(node).empty());
+  }
+  EXPECT_EQ(topology.first_nodes(1).cpus(0), topology.cpus(0));
+}
+
+TEST(PlacementTest, RunOnNodesPins) {
+  const NumaTopology topology = NumaTopology::detect();
+  std::mutex mu;
+  std::vector<std::tuple<size_t, size_t, int>> seen;
+  run_on_nodes(topology, /*pin=*/true, [&](size_t node, size_t index) {
+    std::scoped_lock<std::mutex> lock(mu);
+    seen.push_back(std::make_tuple(node, index, sched_getcpu()));
+  });
+
+  size_t num_cpus = 0;
+  for (size_t node = 0; node < topology.num_nodes(); node++) {
+    num_cpus += topology.cpus(node).size();
+  }
+  ASSERT_EQ(seen.size(), num_cpus);
+  for (const auto &item : seen) {
+    EXPECT_EQ(std::get<2>(item),
+              topology.cpus(std::get<0>(item))[std::get<1>(item)]);
+  }
+}
+
+TEST(PlacementTest, NodeReplicas) {
+  // Two fake nodes on the same CPU.
+  const int cpu = NumaTopology::detect().cpus(0)[0];
+  NumaTopology topology({{cpu}, {cpu}});
+  int made = 0;
+  NodeReplicas<std::vector<int>> replicas(topology, [&]() {
+    made++;
+    return std::make_unique<std::vector<int>>(3, made);
+  });
+  ASSERT_EQ(replicas.size(), 2);
+  EXPECT_EQ(replicas.get(0), std::vector<int>(3, 1));
+  EXPECT_EQ(replicas.get(1), std::vector<int>(3, 2));
+  EXPECT_NE(&replicas.get(0), &replicas.get(1));
+}
+
+TEST(PlacementTest, NodeQueuesSteal) {
+  NodeQueues<int> queues(/*num_nodes=*/3);
+  for (int item = 0; item < 30; item++) {
+    queues.push(item / 10, item);
+  }
+
+  // Node 1 takes its own items first, and then the rest in node order.
+  std::vector<int> taken;
+  int item;
+  while (queues.next(1, &item)) {
+    taken.push_back(item);
+  }
+  ASSERT_EQ(taken.size(), 30);
+  for (int n = 0; n < 30; n++) {
+    EXPECT_EQ(taken[n], (n + 10) % 30);
+  }
+  EXPECT_FALSE(queues.next(0, &item));
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -6,15 +6,26 @@
 
 #include <glog/logging.h>
 
+#include "symbols.h"
+
 using std::string;
 
+// Receives every trade that a Portfolio makes. Sells have negative shares.
+class FillListener {
+public:
+  virtual ~FillListener() {}
+
+  virtual void on_fill(size_t symbol_index, double shares, double price,
+                       double fee) = 0;
+};
+
 class Portfolio {
 public:
   static constexpr double kFeePerShare = 0.0009;
 
-  Portfolio(double cash, std::vector<string> symbols)
-      : cash_(cash), fees_(0.0), symbols_(symbols) {
-    shares_.resize(symbols_.size());
+  Portfolio(double cash, std::vector<SymbolId> symbol_ids)
+      : cash_(cash), fees_(0.0), symbol_ids_(std::move(symbol_ids)) {
+    shares_.resize(symbol_ids_.size());
   }
 
   string to_string(const std::vector<double> &prices, int indent = 0) const {
@@ -34,21 +45,24 @@ public:
     s += middle_indent + "fees: " + std::to_string(fees_) + ",\n";
     s += middle_indent + "g: " + std::to_string(g(prices)) + ",\n";
     s += middle_indent + "stocks: {";
-    for (size_t i = 0; i < symbols_.size(); i++) {
-      s += symbols_[i] + ": " + std::to_string(shares_[i]) + ", ";
+    for (size_t i = 0; i < symbol_ids_.size(); i++) {
+      s += SymbolTable::name(symbol_ids_[i]) + ": " +
+           std::to_string(shares_[i]) + ", ";
     }
     s += "}\n" + top_indent + "}";
     return s;
   }
 
-  int index(string symbol) const {
-    auto found = std::find(symbols_.begin(), symbols_.end(), symbol);
-    if (found == symbols_.end()) {
+  int index(SymbolId symbol) const {
+    auto found = std::find(symbol_ids_.begin(), symbol_ids_.end(), symbol);
+    if (found == symbol_ids_.end()) {
       return -1;
     }
-    return std::distance(symbols_.begin(), found);
+    return std::distance(symbol_ids_.begin(), found);
   }
 
+  const std::vector<SymbolId> &symbol_ids() const { return symbol_ids_; }
+
   double cash() const { return cash_; }
 
   double shares(size_t symbol_index) const {
@@ -87,6 +101,10 @@ public:
     cash_ -= cash_to_spend;
     fees_ += fee;
     shares_[symbol_index] += shares;
+
+    if (fill_listener_) {
+      fill_listener_->on_fill(symbol_index, shares, price, fee);
+    }
   }
 
   void sell(size_t symbol_index, double quantity, double price) {
@@ -96,6 +114,10 @@ public:
     const double fee = quantity * kFeePerShare;
     cash_ += quantity * price - fee;
     fees_ += fee;
+
+    if (fill_listener_) {
+      fill_listener_->on_fill(symbol_index, -quantity, price, fee);
+    }
   }
 
   void pay_dividend(size_t symbol_index, double per_share) {
@@ -106,11 +128,15 @@ public:
     shares_[symbol_index] *= ratio;
   }
 
+  // The listener is not owned and may be null.
+  void set_fill_listener(FillListener *listener) { fill_listener_ = listener; }
+
 private:
   double cash_;
   double fees_;
+  FillListener *fill_listener_ = nullptr;
 
-  std::vector<string> symbols_;
+  std::vector<SymbolId> symbol_ids_;
   std::vector<double> shares_;
 };
 
@@ -3,48 +3,52 @@
 #include "gtest/gtest.h"
 #include "portfolio.h"
 
+const SymbolId kFoo = SymbolTable::intern("FOO");
+const SymbolId kBar = SymbolTable::intern("BAR");
+const SymbolId kBaz = SymbolTable::intern("BAZ");
+
 TEST(PortfolioTest, index) {
-  Portfolio folio(100.0, {"FOO", "BAR", "BAZ"});
-  EXPECT_EQ(folio.index("FOO"), 0);
-  EXPECT_EQ(folio.index("BAR"), 1);
-  EXPECT_EQ(folio.index("BAZ"), 2);
+  Portfolio folio(100.0, {kFoo, kBar, kBaz});
+  EXPECT_EQ(folio.index(kFoo), 0);
+  EXPECT_EQ(folio.index(kBar), 1);
+  EXPECT_EQ(folio.index(kBaz), 2);
 }
 
 TEST(PortfolioTest, shares) {
-  Portfolio folio(100.0, {"FOO", "BAR"});
-  EXPECT_EQ(folio.shares(folio.index("BAR")), 0.0);
+  Portfolio folio(100.0, {kFoo, kBar});
+  EXPECT_EQ(folio.shares(folio.index(kBar)), 0.0);
 }
 
 TEST(PortfolioTest, buy) {
-  Portfolio folio(100.0, {"FOO", "BAR"});
-  EXPECT_EQ(folio.shares(folio.index("BAR")), 0.0);
+  Portfolio folio(100.0, {kFoo, kBar});
+  EXPECT_EQ(folio.shares(folio.index(kBar)), 0.0);
 
   folio.buy(/*symbol_index=*/1, /*quantity=*/1, /*price=*/50.0);
-  EXPECT_EQ(folio.shares(folio.index("BAR")), 1.0);
+  EXPECT_EQ(folio.shares(folio.index(kBar)), 1.0);
 
   folio.buy(/*symbol_index=*/1, /*quantity=*/1, /*price=*/50.0);
-  EXPECT_EQ(folio.shares(folio.index("BAR")), 2.0);
+  EXPECT_EQ(folio.shares(folio.index(kBar)), 2.0);
 }
 
 TEST(PortfolioTest, sell) {
-  Portfolio folio(100.0, {"FOO", "BAR"});
+  Portfolio folio(100.0, {kFoo, kBar});
 
   folio.buy(/*symbol_index=*/0, /*quantity=*/1, /*price=*/50.0);
-  EXPECT_EQ(folio.shares(folio.index("FOO")), 1.0);
+  EXPECT_EQ(folio.shares(folio.index(kFoo)), 1.0);
   folio.buy(/*symbol_index=*/1, /*quantity=*/1, /*price=*/50.0);
-  EXPECT_EQ(folio.shares(folio.index("BAR")), 1.0);
+  EXPECT_EQ(folio.shares(folio.index(kBar)), 1.0);
 
   folio.sell(/*symbol_index=*/0, /*quantity=*/1, /*price=*/20.0);
-  EXPECT_EQ(folio.shares(folio.index("FOO")), 0.0);
+  EXPECT_EQ(folio.shares(folio.index(kFoo)), 0.0);
 
   folio.sell(/*symbol_index=*/1, /*quantity=*/1, /*price=*/10.0);
-  EXPECT_EQ(folio.shares(folio.index("BAR")), 0.0);
+  EXPECT_EQ(folio.shares(folio.index(kBar)), 0.0);
 
   EXPECT_EQ(folio.cash(), 30.0);
 }
 
 TEST(PortfolioTest, value) {
-  Portfolio folio(110.0, {"FOO", "BAR"});
+  Portfolio folio(110.0, {kFoo, kBar});
 
   folio.buy(/*symbol_index=*/0, /*quantity=*/1, /*price=*/50.0);
   folio.buy(/*symbol_index=*/1, /*quantity=*/1, /*price=*/50.0);
@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "feed.h"
+#include "job.h"
+#include "portfolio.h"
+#include "strategy.h"
+#include "symbols.h"
+#include "util.h"
+
+// Exposes the strategies, portfolios and feeds to Python as the
+// wave_arbitrage module, so that models like the one in flip.py can run on
+// the C++ code. See python_bindings_test.py for examples.
+//
+// Price arrays are read in place through the buffer protocol. They must be
+// C-contiguous float64, and anything else raises a TypeError instead of being
+// copied. WaveArbitrage only trades pairs, so the prices have to be for
+// exactly two symbols.
+
+namespace py = pybind11;
+
+PYBIND11_NUMPY_DTYPE(Tick, seconds, nanos, symbol_index, value, flags);
+
+namespace {
+
+// WaveArbitrage keeps its bands for two symbols.
+static constexpr size_t kNumSymbols = 2;
+
+// Prices are indexed by [step][symbol], or by [path][step][symbol] for a
+// batch of paths.
+typedef py::array_t<double, py::array::c_style> PriceArray;
+
+std::vector<SymbolId> default_symbol_ids(size_t num_symbols) {
+  std::vector<string> symbols;
+  for (size_t s = 0; s < num_symbols; s++) {
+    symbols.push_back("S" + std::to_string(s));
+  }
+  return SymbolTable::intern_all(symbols);
+}
+
+// Runs both strategies over one path of num_steps * num_symbols prices. Both
+// start on the first step. If values isn't null, the values of the two
+// portfolios after every step are written to it as [step][strategy].
+std::tuple<double, double> run_path(const double *prices, size_t num_steps,
+                                    size_t num_symbols,
+                                    const std::vector<SymbolId> &symbol_ids,
+                                    double cash, double rebalance_threshold,
+                                    double *values) {
+  std::vector<double> step(prices, prices + num_symbols);
+  BuyAndHold bh(cash, symbol_ids, step);
+  WaveArbitrage wave(cash, symbol_ids, step, rebalance_threshold);
+  for (size_t t = 0; t < num_steps; t++) {
+    if (t > 0) {
+      std::copy(prices + t * num_symbols, prices + (t + 1) * num_symbols,
+                step.begin());
+      bh.price_event(step);
+      wave.price_event(step);
+    }
+    if (values) {
+      values[2 * t] = bh.portfolio().value(step);
+      values[2 * t + 1] = wave.portfolio().value(step);
+    }
+  }
+  return std::make_tuple(bh.portfolio().value(step),
+                         wave.portfolio().value(step));
+}
+
+// Returns the [step][strategy] values of BuyAndHold and WaveArbitrage over a
+// [step][symbol] price array of two symbols. Unlike job(), this doesn't stop
+// when a price drops below $5, so paths that start at 1.0 work.
+py::array_t<double> simulate(PriceArray prices, double cash,
+                             double rebalance_threshold) {
+  if (prices.ndim() != 2 || prices.shape(0) == 0 ||
+      static_cast<size_t>(prices.shape(1)) != kNumSymbols) {
+    throw py::value_error("prices must have shape (num_steps, 2)");
+  }
+  const size_t num_steps = prices.shape(0);
+  const size_t num_symbols = prices.shape(1);
+  const std::vector<SymbolId> symbol_ids = default_symbol_ids(num_symbols);
+
+  py::array_t<double> values({num_steps, static_cast<size_t>(2)});
+  const double *in = prices.data();
+  double *out = values.mutable_data();
+  {
+    py::gil_scoped_release release;
+    run_path(in, num_steps, num_symbols, symbol_ids, cash,
+             rebalance_threshold, out);
+  }
+  return values;
+}
+
+// Like simulate() for a [path][step][symbol] price array, spread over
+// num_threads threads, or one per core if that's 0. Returns the final values
+// as [path][strategy].
+py::array_t<double> simulate_paths(PriceArray prices, double cash,
+                                   double rebalance_threshold,
+                                   unsigned num_threads) {
+  if (prices.ndim() != 3 || prices.shape(1) == 0 ||
+      static_cast<size_t>(prices.shape(2)) != kNumSymbols) {
+    throw py::value_error("prices must have shape (num_paths, num_steps, 2)");
+  }
+  const size_t num_paths = prices.shape(0);
+  const size_t num_steps = prices.shape(1);
+  const size_t num_symbols = prices.shape(2);
+  const std::vector<SymbolId> symbol_ids = default_symbol_ids(num_symbols);
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  py::array_t<double> values({num_paths, static_cast<size_t>(2)});
+  const double *in = prices.data();
+  double *out = values.mutable_data();
+  {
+    py::gil_scoped_release release;
+    std::vector<std::thread> threads;
+    for (unsigned tx = 0; tx < num_threads; tx++) {
+      threads.push_back(std::thread([&, tx]() {
+        for (size_t p = tx; p < num_paths; p += num_threads) {
+          std::tie(out[2 * p], out[2 * p + 1]) =
+              run_path(in + p * num_steps * num_symbols, num_steps,
+                       num_symbols, symbol_ids, cash, rebalance_threshold,
+                       /*values=*/nullptr);
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  return values;
+}
+
+} // namespace
+
+PYBIND11_MODULE(wave_arbitrage, m) {
+  m.doc() = "Strategies, portfolios and feeds from WaveArbitrage.";
+
+  py::class_<Portfolio>(m, "Portfolio")
+      .def(py::init([](double cash, const std::vector<string> &symbols) {
+             return Portfolio(cash, SymbolTable::intern_all(symbols));
+           }),
+           py::arg("cash"), py::arg("symbols"))
+      .def("cash", &Portfolio::cash)
+      .def("shares", &Portfolio::shares, py::arg("symbol_index"))
+      .def(
+          "index",
+          [](const Portfolio &folio, const string &symbol) {
+            return folio.index(SymbolTable::intern(symbol));
+          },
+          py::arg("symbol"))
+      .def("value", &Portfolio::value, py::arg("prices"))
+      .def("g", &Portfolio::g, py::arg("prices"))
+      .def("buy", &Portfolio::buy, py::arg("symbol_index"),
+           py::arg("cash_to_spend"), py::arg("price"))
+      .def("sell", &Portfolio::sell, py::arg("symbol_index"),
+           py::arg("quantity"), py::arg("price"))
+      .def("pay_dividend", &Portfolio::pay_dividend, py::arg("symbol_index"),
+           py::arg("per_share"))
+      .def("stock_split", &Portfolio::stock_split, py::arg("symbol_index"),
+           py::arg("ratio"))
+      .def("to_string", &Portfolio::to_string, py::arg("prices"),
+           py::arg("indent") = 0);
+
+  py::class_<Strategy>(m, "Strategy")
+      .def("strategy_name", &Strategy::strategy_name)
+      .def("price_event", &Strategy::price_event, py::arg("prices"))
+      .def("idle_within", &Strategy::idle_within, py::arg("low"),
+           py::arg("high"))
+      .def("portfolio", &Strategy::portfolio,
+           py::return_value_policy::reference_internal)
+      .def("rebalance", &Strategy::rebalance, py::arg("prices"))
+      .def(
+          "pay_dividend",
+          [](Strategy &strategy, const string &symbol, double per_share) {
+            strategy.pay_dividend(SymbolTable::intern(symbol), per_share);
+          },
+          py::arg("symbol"), py::arg("per_share"))
+      .def(
+          "stock_split",
+          [](Strategy &strategy, const string &symbol, double ratio) {
+            strategy.stock_split(SymbolTable::intern(symbol), ratio);
+          },
+          py::arg("symbol"), py::arg("ratio"))
+      .def("to_string", &Strategy::to_string, py::arg("prices"),
+           py::arg("indent") = 0);
+
+  py::class_<BuyAndHold, Strategy>(m, "BuyAndHold")
+      .def(py::init([](double cash, const std::vector<string> &symbols,
+                       const std::vector<double> &prices) {
+             return std::make_unique<BuyAndHold>(
+                 cash, SymbolTable::intern_all(symbols), prices);
+           }),
+           py::arg("cash"), py::arg("symbols"), py::arg("prices"));
+
+  py::class_<WaveArbitrage, Strategy>(m, "WaveArbitrage")
+      .def(py::init([](double cash, const std::vector<string> &symbols,
+                       const std::vector<double> &prices,
+                       double rebalance_threshold) {
+             if (symbols.size() != kNumSymbols ||
+                 prices.size() != kNumSymbols) {
+               throw py::value_error(
+                   "WaveArbitrage takes exactly two symbols and prices");
+             }
+             return std::make_unique<WaveArbitrage>(
+                 cash, SymbolTable::intern_all(symbols), prices,
+                 rebalance_threshold);
+           }),
+           py::arg("cash"), py::arg("symbols"), py::arg("prices"),
+           py::arg("rebalance_threshold"));
+
+  m.attr("TICK_PRICE") = TICK_PRICE;
+  m.attr("TICK_DIVIDEND") = TICK_DIVIDEND;
+  m.attr("TICK_SPLIT") = TICK_SPLIT;
+  m.attr("TICK_DAY_CHANGE") = TICK_DAY_CHANGE;
+  m.attr("TICK_END") = TICK_END;
+  m.attr("TICK_EVALUATE") = TICK_EVALUATE;
+  // A numpy array of this dtype can be passed to Feed.next_batch().
+  m.attr("tick_dtype") = py::dtype::of<Tick>();
+
+  py::class_<Feed>(m, "Feed")
+      .def("feed_name", &Feed::feed_name)
+      .def("symbols", &Feed::symbols)
+      .def("prices", &Feed::prices)
+      .def("timestamp_seconds",
+           [](const Feed &feed) { return feed.timestamp().seconds(); })
+      .def("max_ticks_per_adjust", &Feed::max_ticks_per_adjust)
+      .def(
+          "next_batch",
+          [](Feed &feed, py::array_t<Tick, py::array::c_style> ticks) {
+            if (ticks.ndim() != 1 ||
+                static_cast<size_t>(ticks.shape(0)) <
+                    feed.max_ticks_per_adjust()) {
+              throw py::value_error(
+                  "ticks must be a 1-d array of at least "
+                  "max_ticks_per_adjust() elements");
+            }
+            Tick *data = ticks.mutable_data();
+            const size_t capacity = ticks.shape(0);
+            py::gil_scoped_release release;
+            return feed.next_batch(data, capacity);
+          },
+          py::arg("ticks").noconvert(),
+          "Fills ticks in place and returns how many were written.")
+      .def("to_string", &Feed::to_string, py::arg("indent") = 0);
+
+  py::class_<RandomFeed, Feed>(m, "RandomFeed")
+      .def(py::init<std::vector<string>, std::vector<double>, double, double,
+                    int>(),
+           py::arg("symbols"), py::arg("prices"), py::arg("gbm_dt"),
+           py::arg("gbm_sigma"), py::arg("lifespan"));
+
+  py::class_<IEXFeed, Feed>(m, "IEXFeed")
+      .def(py::init<std::vector<string>>(), py::arg("symbols"));
+
+  m.def("set_iex_data_root", &set_iex_data_root, py::arg("root"));
+  m.def("get_available_symbols", &get_available_symbols);
+
+  m.def("simulate", &simulate, py::arg("prices").noconvert(),
+        py::arg("cash") = 100000.0, py::arg("rebalance_threshold") = 1.001,
+        "Returns the (num_steps, 2) values of BuyAndHold and WaveArbitrage "
+        "over a (num_steps, 2) price array.");
+  m.def("simulate_paths", &simulate_paths, py::arg("prices").noconvert(),
+        py::arg("cash") = 100000.0, py::arg("rebalance_threshold") = 1.001,
+        py::arg("num_threads") = 0,
+        "Returns the (num_paths, 2) final values of BuyAndHold and "
+        "WaveArbitrage over a (num_paths, num_steps, 2) price array.");
+
+  m.def(
+      "backtest_pair",
+      [](const string &first, const string &second, double cash,
+         double rebalance_threshold) {
+        WelfordRunningStatistics bh_stats;
+        WelfordRunningStatistics wave_stats;
+        static constexpr size_t kMaxNumBuckets = 200;
+        DynamicHistogram bh_hist(kMaxNumBuckets);
+        DynamicHistogram wave_hist(kMaxNumBuckets);
+        py::gil_scoped_release release;
+        return job(/*feed=*/std::make_unique<IEXFeed>(
+                       /*symbols=*/std::vector<string>{first, second}),
+                   /*cash=*/cash, /*rebalance_threshold=*/rebalance_threshold,
+                   /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
+                   /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist);
+      },
+      py::arg("first"), py::arg("second"), py::arg("cash") = 100000.0,
+      py::arg("rebalance_threshold") = 1.001,
+      "Runs job() over the pair's IEX data and returns the final values of "
+      "BuyAndHold and WaveArbitrage.");
+}
@@ -0,0 +1,92 @@
+import unittest
+
+import numpy as np
+
+import wave_arbitrage
+
+
+class PythonBindingsTest(unittest.TestCase):
+    def test_strategies(self):
+        prices = [10.0, 20.0]
+        bh = wave_arbitrage.BuyAndHold(1000.0, ['FOO', 'BAR'], prices)
+        wave = wave_arbitrage.WaveArbitrage(
+                1000.0, ['FOO', 'BAR'], prices, rebalance_threshold=1.01)
+        self.assertEqual(bh.strategy_name(), 'BuyAndHold')
+        self.assertEqual(wave.portfolio().index('BAR'), 1)
+        self.assertGreater(wave.portfolio().shares(0), 0.0)
+
+        wave.price_event([10.0, 20.0])
+        self.assertTrue(wave.price_event([12.0, 20.0]))
+        self.assertAlmostEqual(
+                bh.portfolio().value([12.0, 20.0]),
+                bh.portfolio().shares(0) * 12.0 +
+                bh.portfolio().shares(1) * 20.0 + bh.portfolio().cash())
+
+    def test_simulate_matches_strategies(self):
+        rng = np.random.default_rng(1)
+        prices = np.exp(np.cumsum(rng.normal(0.0, 0.01, (500, 2)), axis=0))
+        values = wave_arbitrage.simulate(prices, cash=1000.0,
+                                         rebalance_threshold=1.005)
+        self.assertEqual(values.shape, (500, 2))
+
+        bh = wave_arbitrage.BuyAndHold(1000.0, ['S0', 'S1'], list(prices[0]))
+        wave = wave_arbitrage.WaveArbitrage(1000.0, ['S0', 'S1'],
+                                            list(prices[0]), 1.005)
+        for step in prices[1:]:
+            bh.price_event(list(step))
+            wave.price_event(list(step))
+        self.assertEqual(values[-1, 0], bh.portfolio().value(list(prices[-1])))
+        self.assertEqual(values[-1, 1],
+                         wave.portfolio().value(list(prices[-1])))
+
+    def test_simulate_paths(self):
+        rng = np.random.default_rng(2)
+        prices = np.exp(np.cumsum(rng.normal(0.0, 0.01, (7, 300, 2)), axis=1))
+        finals = wave_arbitrage.simulate_paths(prices, num_threads=3)
+        self.assertEqual(finals.shape, (7, 2))
+        for p in range(7):
+            np.testing.assert_array_equal(
+                    finals[p], wave_arbitrage.simulate(prices[p])[-1])
+
+    def test_price_arrays_are_not_copied(self):
+        prices = np.ones((10, 2), dtype=np.float32)
+        with self.assertRaises(TypeError):
+            wave_arbitrage.simulate(prices)
+        with self.assertRaises(TypeError):
+            wave_arbitrage.simulate(np.ones((2, 10)).T)
+
+    def test_only_pairs(self):
+        # WaveArbitrage keeps its bands for exactly two symbols.
+        for shape in [(10, 1), (10, 3)]:
+            with self.assertRaises(ValueError):
+                wave_arbitrage.simulate(np.ones(shape))
+        with self.assertRaises(ValueError):
+            wave_arbitrage.simulate_paths(np.ones((4, 10, 3)))
+        with self.assertRaises(ValueError):
+            wave_arbitrage.WaveArbitrage(1000.0, ['FOO', 'BAR', 'BAZ'],
+                                         [10.0, 20.0, 30.0], 1.01)
+        with self.assertRaises(ValueError):
+            wave_arbitrage.WaveArbitrage(1000.0, ['FOO', 'BAR'], [10.0],
+                                         1.01)
+
+    def test_feed(self):
+        feed = wave_arbitrage.RandomFeed(['FOO', 'BAR'], [10.0, 10.0],
+                                         gbm_dt=1.0 / 252, gbm_sigma=0.01,
+                                         lifespan=100)
+        ticks = np.zeros(64, dtype=wave_arbitrage.tick_dtype)
+        evaluations = 0
+        ended = False
+        while True:
+            n = feed.next_batch(ticks)
+            if n == 0:
+                break
+            flags = ticks['flags'][:n]
+            evaluations += np.count_nonzero(
+                    flags & wave_arbitrage.TICK_EVALUATE)
+            ended = ended or np.any(flags & wave_arbitrage.TICK_END)
+        self.assertEqual(evaluations, 100)
+        self.assertTrue(ended)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,349 @@
+#ifndef WAVE_ARBITRAGE_RANGE_INDEX_H
+#define WAVE_ARBITRAGE_RANGE_INDEX_H
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+
+// The smallest and largest value in each fixed-size block of a column, with a
+// sparse table on top so that the extrema of any run of whole blocks can be
+// found in constant time.
+class BlockRangeIndex {
+public:
+  BlockRangeIndex(const std::vector<double> &values, size_t block_size) {
+    CHECK_GT(block_size, 0);
+    const size_t num_blocks = (values.size() + block_size - 1) / block_size;
+    mins_.emplace_back(num_blocks);
+    maxes_.emplace_back(num_blocks);
+    for (size_t b = 0; b < num_blocks; b++) {
+      const auto first = values.begin() + b * block_size;
+      const auto last =
+          values.begin() + std::min(values.size(), (b + 1) * block_size);
+      const auto extrema = std::minmax_element(first, last);
+      mins_[0][b] = *extrema.first;
+      maxes_[0][b] = *extrema.second;
+    }
+
+    // Level k holds the extrema of the 2^k blocks starting at each block.
+    for (size_t width = 2; width <= num_blocks; width *= 2) {
+      const std::vector<double> &prev_mins = mins_.back();
+      const std::vector<double> &prev_maxes = maxes_.back();
+      std::vector<double> level_mins(num_blocks - width + 1);
+      std::vector<double> level_maxes(num_blocks - width + 1);
+      for (size_t b = 0; b < level_mins.size(); b++) {
+        level_mins[b] = std::min(prev_mins[b], prev_mins[b + width / 2]);
+        level_maxes[b] = std::max(prev_maxes[b], prev_maxes[b + width / 2]);
+      }
+      mins_.push_back(std::move(level_mins));
+      maxes_.push_back(std::move(level_maxes));
+    }
+  }
+
+  size_t num_blocks() const { return mins_[0].size(); }
+
+  // Returns the smallest and largest values in blocks [first, first + count).
+  std::tuple<double, double> range(size_t first, size_t count) const {
+    DCHECK_GT(count, 0);
+    DCHECK_LE(first + count, num_blocks());
+    const size_t level = 63 - __builtin_clzll(count);
+    const size_t second = first + count - (static_cast<size_t>(1) << level);
+    return std::make_tuple(
+        std::min(mins_[level][first], mins_[level][second]),
+        std::max(maxes_[level][first], maxes_[level][second]));
+  }
+
+private:
+  std::vector<std::vector<double>> mins_;
+  std::vector<std::vector<double>> maxes_;
+};
+
+// Decodes another feed into columns a window of adjustments at a time, and
+// skips over whole blocks of adjustments in the window that the consumer's
+// skip filter says can't make it trade. Inside a skipped run, only the
+// adjustments that the consumer would sample every sample_interval_seconds
+// are handed out, followed by the last adjustment of the run so that the
+// consumer ends up with the same prices as if it had seen the whole run. Runs
+// never cross a dividend, a split or the end of a window, and only one window
+// is held in memory at a time.
+//
+// Every adjustment reports the prices of all symbols. Batches end wherever the
+// skip filter is about to be asked about the next run, so that the consumer
+// has caught up by then. That also means this can't be wrapped in a
+// PipelinedFeed.
+class RangeSkipFeed : public Feed {
+public:
+  static constexpr size_t kBlockSize = 64;
+  // About 8 MB of columns for a pair.
+  static constexpr size_t kDefaultWindowSize = 1 << 18;
+
+  // A window holds at least window_size adjustments, and at most one batch
+  // of the wrapped feed more.
+  RangeSkipFeed(std::unique_ptr<Feed> feed, int64_t sample_interval_seconds,
+                size_t window_size = kDefaultWindowSize)
+      : Feed(feed->symbols()), feed_(std::move(feed)),
+        feed_name_(feed_->feed_name()),
+        sample_interval_seconds_(sample_interval_seconds),
+        window_size_(window_size), price_columns_(feed_->symbols().size()),
+        decode_prices_(feed_->prices()),
+        decode_ticks_(std::max(static_cast<size_t>(4096),
+                               feed_->max_ticks_per_adjust())) {
+    prices_ = feed_->prices();
+    timestamp_ = feed_->timestamp();
+    decode_window();
+  }
+
+  string feed_name() const override {
+    return "RangeSkipFeed(" + feed_name_ + ")";
+  }
+
+  void set_skip_filter(SkipFilter filter) override {
+    skip_filter_ = std::move(filter);
+  }
+
+  FeedStatus adjust_prices() override {
+    adjusts_++;
+    if (next_group_ >= seconds_.size()) {
+      if (feed_done_) {
+        return FEED_END;
+      }
+      decode_window();
+      if (seconds_.empty()) {
+        return FEED_END;
+      }
+    }
+
+    if (next_group_ >= skip_end_ && skip_filter_ &&
+        next_group_ % kBlockSize == 0) {
+      skip_end_ = find_skip_end();
+    }
+
+    size_t group = next_group_;
+    if (group < skip_end_) {
+      // Jump to the next sample, or to the last adjustment of the run.
+      group = std::upper_bound(seconds_.begin() + group,
+                               seconds_.begin() + skip_end_ - 1,
+                               last_sample_seconds_ +
+                                   sample_interval_seconds_) -
+              seconds_.begin();
+    }
+    skipped_ += group - next_group_;
+    next_group_ = group + 1;
+    // The next window is decoded and searched as soon as this one runs out.
+    batch_break_ = skip_filter_ && next_group_ >= skip_end_ &&
+                   (next_group_ % kBlockSize == 0 ||
+                    next_group_ >= seconds_.size());
+    return load_group(group);
+  }
+
+  size_t next_batch(Tick *ticks, size_t capacity) override {
+    return fill_batch([this]() { return RangeSkipFeed::adjust_prices(); },
+                      ticks, capacity);
+  }
+
+  // The number of adjustments decoded from the wrapped feed so far.
+  size_t num_adjustments() const { return num_adjustments_; }
+
+  // The number of adjustments that have been skipped so far.
+  size_t skipped() const { return skipped_; }
+
+private:
+  static constexpr uint8_t kGroupDayChange = 1;
+  static constexpr uint8_t kGroupEnd = 2;
+
+  // A dividend or split that happens during an adjustment.
+  struct PriceActionTick {
+    size_t group;
+    int32_t symbol_index;
+    double value;
+    bool is_dividend;
+  };
+
+  std::unique_ptr<Feed> feed_;
+  const string feed_name_;
+  const int64_t sample_interval_seconds_;
+  const size_t window_size_;
+  SkipFilter skip_filter_;
+
+  // One entry per adjustment of the wrapped feed in the current window.
+  std::vector<int64_t> seconds_;
+  std::vector<int32_t> nanos_;
+  std::vector<uint8_t> group_flags_;
+  // The price of each symbol after each adjustment.
+  std::vector<std::vector<double>> price_columns_;
+  std::vector<PriceActionTick> actions_;
+
+  std::vector<BlockRangeIndex> indexes_;
+  // The first block at or after each block that a run can't skip over.
+  std::vector<size_t> next_stop_block_;
+
+  // Carried from one window to the next while decoding.
+  std::vector<double> decode_prices_;
+  uint8_t decode_flags_ = 0;
+  std::vector<Tick> decode_ticks_;
+  bool feed_done_ = false;
+  size_t num_adjustments_ = 0;
+
+  size_t next_group_ = 0;
+  size_t next_action_ = 0;
+  size_t skip_end_ = 0;
+  size_t skipped_ = 0;
+  // Mirrors the sampling in job().
+  int64_t last_sample_seconds_ = 0;
+
+  // Replaces the window with the next adjustments of the wrapped feed.
+  void decode_window() {
+    seconds_.clear();
+    nanos_.clear();
+    group_flags_.clear();
+    for (auto &column : price_columns_) {
+      column.clear();
+    }
+    actions_.clear();
+    next_group_ = 0;
+    next_action_ = 0;
+    skip_end_ = 0;
+
+    while (!feed_done_ && seconds_.size() < window_size_) {
+      const size_t n =
+          feed_->next_batch(decode_ticks_.data(), decode_ticks_.size());
+      if (n == 0) {
+        feed_done_ = true;
+        break;
+      }
+      for (size_t t = 0; t < n; t++) {
+        const Tick &tick = decode_ticks_[t];
+        if (tick.flags & TICK_DAY_CHANGE) {
+          decode_flags_ |= kGroupDayChange;
+        }
+
+        if (tick.flags & TICK_PRICE) {
+          decode_prices_[tick.symbol_index] = tick.value;
+        } else if (tick.flags & (TICK_DIVIDEND | TICK_SPLIT)) {
+          const bool is_dividend = tick.flags & TICK_DIVIDEND;
+          actions_.push_back(PriceActionTick{
+              seconds_.size(), tick.symbol_index, tick.value, is_dividend});
+        } else if (tick.flags & TICK_END) {
+          decode_flags_ |= kGroupEnd;
+          feed_done_ = true;
+        }
+
+        if (tick.flags & (TICK_EVALUATE | TICK_END)) {
+          seconds_.push_back(tick.seconds);
+          nanos_.push_back(tick.nanos);
+          group_flags_.push_back(decode_flags_);
+          for (size_t i = 0; i < decode_prices_.size(); i++) {
+            price_columns_[i].push_back(decode_prices_[i]);
+          }
+          decode_flags_ = 0;
+        }
+      }
+    }
+    num_adjustments_ += seconds_.size();
+
+    // A block that holds a dividend, a split or the end of the window stops
+    // every run that reaches it.
+    const size_t num_blocks = (seconds_.size() + kBlockSize - 1) / kBlockSize;
+    next_stop_block_.assign(num_blocks + 1, num_blocks);
+    for (const auto &action : actions_) {
+      next_stop_block_[action.group / kBlockSize] = action.group / kBlockSize;
+    }
+    if (num_blocks > 0) {
+      next_stop_block_[num_blocks - 1] = num_blocks - 1;
+    }
+    for (size_t b = num_blocks; b-- > 0;) {
+      next_stop_block_[b] = std::min(next_stop_block_[b],
+                                     next_stop_block_[b + 1]);
+    }
+
+    indexes_.clear();
+    for (const auto &column : price_columns_) {
+      indexes_.emplace_back(column, kBlockSize);
+    }
+  }
+
+  // Returns the end of the longest run of whole blocks starting at
+  // next_group_ that the skip filter allows, or next_group_ if there is none.
+  size_t find_skip_end() {
+    const size_t first = next_group_ / kBlockSize;
+    const size_t max_count = next_stop_block_[first] - first;
+
+    std::vector<double> low(prices_.size());
+    std::vector<double> high(prices_.size());
+    auto allowed = [&](size_t count) {
+      for (size_t i = 0; i < prices_.size(); i++) {
+        const auto range = indexes_[i].range(first, count);
+        low[i] = std::min(prices_[i], std::get<0>(range));
+        high[i] = std::max(prices_[i], std::get<1>(range));
+      }
+      return skip_filter_(low, high);
+    };
+
+    if (max_count == 0 || !allowed(1)) {
+      return next_group_;
+    }
+
+    // Gallop, then binary search. Widening a run only widens its ranges, so
+    // the filter can only go from allowing to refusing.
+    size_t good = 1;
+    size_t bad = max_count + 1;
+    while (good * 2 <= max_count) {
+      if (!allowed(good * 2)) {
+        bad = good * 2;
+        break;
+      }
+      good *= 2;
+    }
+    bad = std::min(bad, max_count + 1);
+    while (bad - good > 1) {
+      const size_t mid = good + (bad - good) / 2;
+      if (allowed(mid)) {
+        good = mid;
+      } else {
+        bad = mid;
+      }
+    }
+    return (first + good) * kBlockSize;
+  }
+
+  FeedStatus load_group(size_t group) {
+    std::fill(dividends_.begin(), dividends_.end(), 0.0);
+    std::fill(splits_.begin(), splits_.end(), 0.0);
+    updated_index_ = -1;
+
+    FeedStatus fs =
+        (group_flags_[group] & kGroupDayChange) ? FEED_DAY_CHANGE : FEED_OK;
+    while (next_action_ < actions_.size() &&
+           actions_[next_action_].group <= group) {
+      const PriceActionTick &action = actions_[next_action_++];
+      DCHECK_EQ(action.group, group);
+      if (action.is_dividend) {
+        dividends_[action.symbol_index] = action.value;
+        fs |= FEED_DIVIDEND;
+      } else {
+        splits_[action.symbol_index] = action.value;
+        fs |= FEED_SPLIT;
+      }
+    }
+
+    for (size_t i = 0; i < prices_.size(); i++) {
+      prices_[i] = price_columns_[i][group];
+    }
+    timestamp_.set_seconds(seconds_[group]);
+    timestamp_.set_nanos(nanos_[group]);
+
+    if (group_flags_[group] & kGroupEnd) {
+      return fs | FEED_END;
+    }
+    if (seconds_[group] - sample_interval_seconds_ > last_sample_seconds_) {
+      last_sample_seconds_ = seconds_[group];
+    }
+    return fs;
+  }
+};
+
+#endif // WAVE_ARBITRAGE_RANGE_INDEX_H
@@ -0,0 +1,189 @@
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "range_index.h"
+#include "strategy.h"
+
+// Moves one symbol per adjustment along a fixed script, and pays a dividend
+// on the first symbol at the given step.
+class ScriptedFeed : public Feed {
+public:
+  ScriptedFeed(std::vector<string> symbols, std::vector<double> prices,
+               std::vector<std::tuple<int, double>> script,
+               size_t dividend_step)
+      : Feed(symbols), script_(script), dividend_step_(dividend_step) {
+    prices_ = prices;
+  }
+
+  string feed_name() const override { return "ScriptedFeed"; }
+
+  FeedStatus adjust_prices() override {
+    dividends_[0] = 0.0;
+    if (next_ >= script_.size()) {
+      return FEED_END;
+    }
+    updated_index_ = std::get<0>(script_[next_]);
+    prices_[updated_index_] = std::get<1>(script_[next_]);
+    timestamp_.set_seconds(timestamp_.seconds() + 7);
+    if (next_++ == dividend_step_) {
+      dividends_[0] = 0.5;
+      return FEED_DIVIDEND;
+    }
+    return FEED_OK;
+  }
+
+private:
+  std::vector<std::tuple<int, double>> script_;
+  size_t dividend_step_;
+  size_t next_ = 0;
+};
+
+std::unique_ptr<Feed> make_feed(double step_stddev) {
+  std::vector<std::tuple<int, double>> script;
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> symbol_dist(0, 1);
+  std::normal_distribution<double> move_dist(0.0, step_stddev);
+  std::vector<double> walk = {20.0, 40.0};
+  for (int n = 0; n < 50000; n++) {
+    int i = symbol_dist(generator);
+    walk[i] *= 1.0 + move_dist(generator);
+    script.push_back(std::make_tuple(i, walk[i]));
+  }
+  return std::make_unique<ScriptedFeed>(std::vector<string>{"FOO", "BAR"},
+                                        std::vector<double>{20.0, 40.0},
+                                        script, /*dividend_step=*/20000);
+}
+
+struct ReplayResult {
+  double bh_value;
+  double wave_value;
+  std::vector<int64_t> sample_seconds;
+  std::vector<double> sample_values;
+};
+
+// Does what job() does with the feed.
+ReplayResult replay(Feed *feed, double rebalance_threshold, bool skip) {
+  BuyAndHold bh(1000.0, feed->symbol_ids(), feed->prices());
+  WaveArbitrage wave(1000.0, feed->symbol_ids(), feed->prices(),
+                     rebalance_threshold);
+  if (skip) {
+    feed->set_skip_filter([&](const std::vector<double> &low,
+                              const std::vector<double> &high) {
+      return bh.idle_within(low, high) && wave.idle_within(low, high);
+    });
+  }
+
+  ReplayResult result;
+  std::vector<double> prices = feed->prices();
+  std::vector<Tick> ticks(64);
+  int64_t last_sample_seconds = 0;
+  size_t n;
+  while ((n = feed->next_batch(ticks.data(), ticks.size())) > 0) {
+    for (size_t t = 0; t < n; t++) {
+      const Tick &tick = ticks[t];
+      if (tick.flags & TICK_PRICE) {
+        prices[tick.symbol_index] = tick.value;
+      } else if (tick.flags & TICK_DIVIDEND) {
+        bh.pay_dividend(feed->symbol_ids()[tick.symbol_index], tick.value);
+        wave.pay_dividend(feed->symbol_ids()[tick.symbol_index], tick.value);
+      }
+      if (!(tick.flags & TICK_EVALUATE)) {
+        continue;
+      }
+
+      bh.price_event(prices);
+      wave.price_event(prices);
+      if (tick.seconds - 60 > last_sample_seconds) {
+        last_sample_seconds = tick.seconds;
+        result.sample_seconds.push_back(tick.seconds);
+        result.sample_values.push_back(wave.portfolio().value(prices));
+      }
+    }
+  }
+
+  result.bh_value = bh.portfolio().value(prices);
+  result.wave_value = wave.portfolio().value(prices);
+  return result;
+}
+
+TEST(BlockRangeIndexTest, MatchesScan) {
+  std::default_random_engine generator;
+  std::normal_distribution<double> dist(0.0, 1.0);
+  std::vector<double> values(1000);
+  for (auto &value : values) {
+    value = dist(generator);
+  }
+
+  BlockRangeIndex index(values, /*block_size=*/8);
+  ASSERT_EQ(index.num_blocks(), 125);
+  for (size_t first = 0; first < index.num_blocks(); first++) {
+    for (size_t count = 1; first + count <= index.num_blocks(); count++) {
+      const auto begin = values.begin() + first * 8;
+      const auto end = values.begin() + (first + count) * 8;
+      const auto range = index.range(first, count);
+      EXPECT_EQ(std::get<0>(range), *std::min_element(begin, end));
+      EXPECT_EQ(std::get<1>(range), *std::max_element(begin, end));
+    }
+  }
+}
+
+TEST(RangeSkipFeedTest, NoFilterMatchesInnerFeed) {
+  RangeSkipFeed feed(make_feed(/*step_stddev=*/0.001),
+                     /*sample_interval_seconds=*/60);
+  EXPECT_EQ(feed.num_adjustments(), 50001);
+
+  auto inner = make_feed(/*step_stddev=*/0.001);
+  const ReplayResult expected = replay(inner.get(), 1.01, /*skip=*/false);
+  const ReplayResult actual = replay(&feed, 1.01, /*skip=*/false);
+  EXPECT_EQ(feed.skipped(), 0);
+  EXPECT_EQ(actual.bh_value, expected.bh_value);
+  EXPECT_EQ(actual.wave_value, expected.wave_value);
+  EXPECT_EQ(actual.sample_seconds, expected.sample_seconds);
+}
+
+TEST(RangeSkipFeedTest, SkippingMatchesFullReplay) {
+  for (double threshold : {1.001, 1.01, 1.05}) {
+    RangeSkipFeed feed(make_feed(/*step_stddev=*/0.0005),
+                       /*sample_interval_seconds=*/60);
+    auto inner = make_feed(/*step_stddev=*/0.0005);
+    const ReplayResult expected = replay(inner.get(), threshold, false);
+    const ReplayResult actual = replay(&feed, threshold, /*skip=*/true);
+
+    EXPECT_EQ(actual.bh_value, expected.bh_value) << threshold;
+    EXPECT_EQ(actual.wave_value, expected.wave_value) << threshold;
+    EXPECT_EQ(actual.sample_seconds, expected.sample_seconds) << threshold;
+    EXPECT_EQ(actual.sample_values, expected.sample_values) << threshold;
+    if (threshold > 1.001) {
+      EXPECT_GT(feed.skipped(), feed.num_adjustments() / 2) << threshold;
+    }
+  }
+}
+
+TEST(RangeSkipFeedTest, SmallWindows) {
+  for (double threshold : {1.001, 1.05}) {
+    RangeSkipFeed feed(make_feed(/*step_stddev=*/0.0005),
+                       /*sample_interval_seconds=*/60,
+                       /*window_size=*/1000);
+    // Only the first window has been decoded.
+    EXPECT_LT(feed.num_adjustments(), 50001);
+    auto inner = make_feed(/*step_stddev=*/0.0005);
+    const ReplayResult expected = replay(inner.get(), threshold, false);
+    const ReplayResult actual = replay(&feed, threshold, /*skip=*/true);
+
+    EXPECT_EQ(feed.num_adjustments(), 50001);
+    EXPECT_EQ(actual.bh_value, expected.bh_value) << threshold;
+    EXPECT_EQ(actual.wave_value, expected.wave_value) << threshold;
+    EXPECT_EQ(actual.sample_seconds, expected.sample_seconds) << threshold;
+    EXPECT_EQ(actual.sample_values, expected.sample_values) << threshold;
+    if (threshold > 1.001) {
+      EXPECT_GT(feed.skipped(), feed.num_adjustments() / 2) << threshold;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "feed.h"
+#include "live.h"
+
+// Replays the processed IEX trades of some symbols as a live stream, for
+// paper_trade to consume, at the pace they happened or sped up.
+//
+//   replay_publisher --symbols=<a>,<b>[,...] [--ring=<shm name>]
+//                    [--socket=<path>] [--speed=<n>] [--max_gap=<seconds>]
+//
+// The default is a shared memory ring named /wave_arbitrage_live. With
+// --socket, it waits for paper_trade to connect instead. --speed=0 publishes
+// as fast as the subscriber keeps up. Gaps between trades longer than
+// --max_gap market seconds, like nights and weekends, are cut down to it.
+
+int main(int argc, char **argv) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<string> symbols;
+  string ring_name = "/wave_arbitrage_live";
+  string socket_path;
+  double speed = 1.0;
+  double max_gap = 60.0;
+  for (int a = 1; a < argc; a++) {
+    const string arg = argv[a];
+    const string value = arg.substr(arg.find('=') + 1);
+    if (arg.rfind("--symbols=", 0) == 0) {
+      std::istringstream in(value);
+      string symbol;
+      while (std::getline(in, symbol, ',')) {
+        symbols.push_back(symbol);
+      }
+    } else if (arg.rfind("--ring=", 0) == 0) {
+      ring_name = value;
+    } else if (arg.rfind("--socket=", 0) == 0) {
+      socket_path = value;
+    } else if (arg.rfind("--speed=", 0) == 0) {
+      speed = std::stod(value);
+    } else if (arg.rfind("--max_gap=", 0) == 0) {
+      max_gap = std::stod(value);
+    } else {
+      LOG(FATAL) << "Unknown flag " << arg;
+    }
+  }
+  CHECK(!symbols.empty()) << "--symbols is required";
+  CHECK_GE(speed, 0.0);
+
+  std::unique_ptr<TradeSink> sink;
+  if (!socket_path.empty()) {
+    printf("waiting for a subscriber on %s\n", socket_path.c_str());
+    sink = std::make_unique<SocketTradeSink>(socket_path);
+  } else {
+    sink = TradeRing::create(ring_name, /*capacity=*/1 << 16);
+    printf("publishing to %s\n", ring_name.c_str());
+  }
+
+  IEXFeed feed(symbols);
+  auto to_trade = [&feed](size_t i) {
+    LiveTrade trade;
+    trade.set_symbol(feed.symbols()[i]);
+    trade.seconds = feed.timestamp().seconds();
+    trade.nanos = feed.timestamp().nanos();
+    trade.padding = 0;
+    trade.price = std::llround(feed.prices()[i] * 10000.0);
+    return trade;
+  };
+
+  // The feed starts out with every symbol's first price.
+  int64_t num_trades = 0;
+  bool subscribed = true;
+  for (size_t i = 0; subscribed && i < symbols.size(); i++) {
+    LiveTrade trade = to_trade(i);
+    trade.sent_nanos = monotonic_nanos();
+    subscribed = sink->publish(trade);
+    num_trades += subscribed;
+  }
+
+  // Market time is mapped onto wall time starting from the first trade.
+  const auto start = std::chrono::steady_clock::now();
+  double market_elapsed = 0.0;
+  double last_market_seconds = feed.timestamp().seconds() +
+                               feed.timestamp().nanos() / 1e9;
+  while (subscribed && !(feed.adjust_prices() & FEED_END)) {
+    const double market_seconds =
+        feed.timestamp().seconds() + feed.timestamp().nanos() / 1e9;
+    market_elapsed +=
+        std::min(std::max(market_seconds - last_market_seconds, 0.0), max_gap);
+    last_market_seconds = market_seconds;
+    if (speed > 0.0) {
+      std::this_thread::sleep_until(
+          start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::duration<double>(market_elapsed / speed)));
+    }
+
+    LiveTrade trade = to_trade(feed.updated_index());
+    trade.sent_nanos = monotonic_nanos();
+    subscribed = sink->publish(trade);
+    num_trades += subscribed;
+  }
+  if (!subscribed) {
+    LOG(WARNING) << "The subscriber went away";
+  }
+  sink->close();
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("published %ld trades in %.3lf s\n", num_trades, elapsed.count());
+  return 0;
+}
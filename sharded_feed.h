@@ -0,0 +1,226 @@
+#ifndef WAVE_ARBITRAGE_SHARDED_FEED_H
+#define WAVE_ARBITRAGE_SHARDED_FEED_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+#include "trace.h"
+
+// Decodes one pair's IEX data on several threads at once by splitting its
+// days into shards, and hands the ticks out in order. A single long pair
+// replay is otherwise stuck on one core, and most of its time goes to
+// decoding. The ticks are exactly those of an IEXFeed over the same symbols,
+// so job() gives the same results with either feed.
+//
+// The strategies themselves still run in order on the consumer's thread.
+// They can't be split by time, because the per-share fees make a portfolio's
+// holdings after a rebalance depend on how far off balance it was.
+class ShardedIEXFeed : public Feed {
+public:
+  // num_threads is one per core if it's 0. At most two shards per thread are
+  // decoded ahead of the consumer.
+  ShardedIEXFeed(std::vector<string> symbols, unsigned num_threads = 0,
+                 size_t days_per_shard = 5,
+                 const IEXManifest *manifest = nullptr)
+      : Feed(symbols), manifest_(manifest),
+        day_files_(IEXFeed::plan_days(symbols, manifest)) {
+    CHECK(!day_files_.empty()) << "No days to replay";
+    CHECK_GT(days_per_shard, 0);
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    max_ahead_ = 2 * num_threads;
+
+    for (size_t first = 0; first < day_files_.size();
+         first += days_per_shard) {
+      shards_.push_back(std::make_unique<Shard>());
+      shards_.back()->first_day = first;
+      // The last shard runs to the end of the data.
+      shards_.back()->end_day = first + days_per_shard < day_files_.size()
+                                    ? first + days_per_shard
+                                    : std::numeric_limits<size_t>::max();
+    }
+
+    // The first shard's feed starts out where a plain IEXFeed would.
+    auto first = make_shard_feed(*shards_[0]);
+    prices_ = first->prices();
+    timestamp_ = first->timestamp();
+    first_feed_ = std::move(first);
+
+    for (unsigned tx = 0; tx < num_threads; tx++) {
+      decoders_.push_back(std::thread([this]() { decode(); }));
+    }
+  }
+
+  ~ShardedIEXFeed() {
+    {
+      std::scoped_lock<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &decoder : decoders_) {
+      decoder.join();
+    }
+  }
+
+  string feed_name() const override { return "ShardedIEXFeed"; }
+
+  size_t num_shards() const { return shards_.size(); }
+
+  FeedStatus adjust_prices() override {
+    adjusts_++;
+    if (batch_ended_) {
+      return FEED_END;
+    }
+
+    FeedStatus fs = 0;
+    int num_prices = 0;
+    while (true) {
+      const Tick &tick = pop();
+      apply_tick(tick);
+      if (tick.flags & TICK_DIVIDEND) {
+        fs |= FEED_DIVIDEND;
+      } else if (tick.flags & TICK_SPLIT) {
+        fs |= FEED_SPLIT;
+      } else if (tick.flags & TICK_PRICE) {
+        num_prices++;
+        updated_index_ = num_prices == 1 ? tick.symbol_index : -1;
+      }
+
+      if (tick.flags & TICK_END) {
+        return fs | FEED_END;
+      } else if (tick.flags & TICK_EVALUATE) {
+        return fs | ((tick.flags & TICK_DAY_CHANGE) ? FEED_DAY_CHANGE
+                                                     : FEED_OK);
+      }
+    }
+  }
+
+  size_t next_batch(Tick *ticks, size_t capacity) override {
+    CHECK_GE(capacity, max_ticks_per_adjust());
+    size_t n = 0;
+    while (!batch_ended_ && capacity - n >= max_ticks_per_adjust()) {
+      // Only whole adjustments are handed out.
+      while (true) {
+        Tick &tick = ticks[n++];
+        tick = pop();
+        apply_tick(tick);
+        if (tick.flags & (TICK_EVALUATE | TICK_END)) {
+          break;
+        }
+      }
+    }
+    return n;
+  }
+
+private:
+  struct Shard {
+    size_t first_day;
+    size_t end_day;
+    std::vector<Tick> ticks;
+    bool done = false;
+  };
+
+  const IEXManifest *manifest_;
+  const std::vector<std::vector<size_t>> day_files_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  // Made up front for its prices, and decoded by whichever thread takes the
+  // first shard.
+  std::unique_ptr<IEXFeed> first_feed_;
+  size_t max_ahead_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // The next shard to decode, and the one the consumer is reading.
+  size_t next_shard_ = 0;
+  size_t current_shard_ = 0;
+  bool stop_ = false;
+  std::vector<std::thread> decoders_;
+
+  // Only the consumer uses these. Once it has seen the current shard done,
+  // it reads the shard's ticks without the lock.
+  bool current_done_ = false;
+  size_t cursor_ = 0;
+
+  std::unique_ptr<IEXFeed> make_shard_feed(const Shard &shard) const {
+    return std::make_unique<IEXFeed>(symbols_, day_files_, shard.first_day,
+                                     shard.end_day, manifest_);
+  }
+
+  void decode() {
+    Tracer::set_thread_name("shard decoder");
+    while (true) {
+      size_t s;
+      std::unique_ptr<IEXFeed> feed;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this]() {
+          return stop_ || next_shard_ >= shards_.size() ||
+                 next_shard_ < current_shard_ + max_ahead_;
+        });
+        if (stop_ || next_shard_ >= shards_.size()) {
+          return;
+        }
+        s = next_shard_++;
+        if (s == 0) {
+          feed = std::move(first_feed_);
+        }
+      }
+
+      TraceSpan span("decode shard");
+      if (!feed) {
+        feed = make_shard_feed(*shards_[s]);
+      }
+      std::vector<Tick> ticks;
+      std::vector<Tick> batch(
+          std::max(static_cast<size_t>(4096), feed->max_ticks_per_adjust()));
+      while (const size_t n = feed->next_batch(batch.data(), batch.size())) {
+        ticks.insert(ticks.end(), batch.begin(), batch.begin() + n);
+      }
+      span.end();
+
+      {
+        std::scoped_lock<std::mutex> lock(mu_);
+        shards_[s]->ticks = std::move(ticks);
+        shards_[s]->done = true;
+      }
+      cv_.notify_all();
+    }
+  }
+
+  const Tick &pop() {
+    while (true) {
+      CHECK_LT(current_shard_, shards_.size()) << "No TICK_END";
+      Shard &shard = *shards_[current_shard_];
+      if (!current_done_) {
+        TraceSpan span("wait for shard");
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [&shard]() { return shard.done; });
+        current_done_ = true;
+      }
+      if (cursor_ < shard.ticks.size()) {
+        return shard.ticks[cursor_++];
+      }
+
+      // Frees the shard and lets the decoders move on to another one.
+      std::vector<Tick>().swap(shard.ticks);
+      current_done_ = false;
+      cursor_ = 0;
+      {
+        std::scoped_lock<std::mutex> lock(mu_);
+        current_shard_++;
+      }
+      cv_.notify_all();
+    }
+  }
+};
+
+#endif // WAVE_ARBITRAGE_SHARDED_FEED_H
@@ -0,0 +1,142 @@
+#include <fstream>
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "job.h"
+#include "sharded_feed.h"
+#include "synthetic_data_testing.h"
+
+const std::vector<string> &test_symbols() {
+  static const std::vector<string> symbols = []() {
+    SyntheticIEXConfig config;
+    config.num_symbols = 3;
+    config.num_days = 23;
+    config.trades_per_day = 200.0;
+    config.dividend_probability = 0.1;
+    config.split_probability = 0.05;
+    const auto symbols = write_test_data("sharded_feed", config);
+
+    // A day file with no trades, which the feed has to skip.
+    market_data::Events events;
+    events.add_events()->mutable_security_directory()->set_symbol("SYAB");
+    std::ofstream out(
+        test_data_root("sharded_feed") + "/processed/SYAB_20180110x",
+        std::ios::out | std::ios::binary);
+    events.SerializeToOstream(&out);
+    out.close();
+    return symbols;
+  }();
+  return symbols;
+}
+
+void expect_same_ticks(const std::vector<Tick> &actual,
+                       const std::vector<Tick> &expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t t = 0; t < actual.size(); t++) {
+    EXPECT_EQ(actual[t].seconds, expected[t].seconds) << t;
+    EXPECT_EQ(actual[t].nanos, expected[t].nanos) << t;
+    EXPECT_EQ(actual[t].symbol_index, expected[t].symbol_index) << t;
+    EXPECT_EQ(actual[t].value, expected[t].value) << t;
+    EXPECT_EQ(actual[t].flags, expected[t].flags) << t;
+  }
+}
+
+TEST(ShardedFeedTest, PlanDays) {
+  const std::vector<string> pair = {test_symbols()[0], test_symbols()[1]};
+  const auto days = IEXFeed::plan_days(pair);
+  ASSERT_EQ(days.size(), 23);
+  EXPECT_EQ(days[0], (std::vector<size_t>{0, 0}));
+  // SYAB skips its empty file after the seventh day.
+  EXPECT_EQ(days[6], (std::vector<size_t>{6, 6}));
+  EXPECT_EQ(days[7], (std::vector<size_t>{7, 8}));
+  EXPECT_EQ(days[22], (std::vector<size_t>{22, 23}));
+}
+
+TEST(ShardedFeedTest, DayRangesMatch) {
+  const std::vector<string> pair = {test_symbols()[0], test_symbols()[1]};
+  IEXFeed feed(pair);
+  const std::vector<Tick> expected = all_ticks(&feed);
+  ASSERT_FALSE(expected.empty());
+  EXPECT_TRUE(expected.back().flags & TICK_END);
+
+  // The ranges, back to back, give the same ticks as the whole feed.
+  const auto days = IEXFeed::plan_days(pair);
+  std::vector<Tick> ticks;
+  const size_t kEnd = std::numeric_limits<size_t>::max();
+  for (const auto &range : std::vector<std::tuple<size_t, size_t>>{
+           {0, 4}, {4, 5}, {5, 13}, {13, kEnd}}) {
+    IEXFeed range_feed(pair, days, std::get<0>(range), std::get<1>(range));
+    const std::vector<Tick> range_ticks = all_ticks(&range_feed);
+    ASSERT_FALSE(range_ticks.empty());
+    EXPECT_EQ(static_cast<bool>(range_ticks.back().flags & TICK_END),
+              std::get<1>(range) == kEnd);
+    ticks.insert(ticks.end(), range_ticks.begin(), range_ticks.end());
+  }
+  expect_same_ticks(ticks, expected);
+
+  IEXFeed first(pair, days, 0, 4);
+  EXPECT_EQ(first.prices(), IEXFeed(pair).prices());
+}
+
+TEST(ShardedFeedTest, SameTicks) {
+  const std::vector<string> pair = {test_symbols()[1], test_symbols()[2]};
+  IEXFeed feed(pair);
+  const std::vector<Tick> expected = all_ticks(&feed);
+
+  for (unsigned num_threads : {1, 3}) {
+    for (size_t days_per_shard : {1, 2, 5, 100}) {
+      ShardedIEXFeed sharded(pair, num_threads, days_per_shard);
+      EXPECT_EQ(sharded.num_shards(), (23 + days_per_shard - 1) /
+                                          days_per_shard);
+      EXPECT_EQ(sharded.prices(), IEXFeed(pair).prices());
+      expect_same_ticks(all_ticks(&sharded), expected);
+    }
+  }
+
+  // Reading it an adjustment at a time gives the same prices.
+  IEXFeed plain(pair);
+  ShardedIEXFeed sharded(pair, /*num_threads=*/2, /*days_per_shard=*/3);
+  while (true) {
+    const FeedStatus fs = plain.adjust_prices();
+    EXPECT_EQ(sharded.adjust_prices(), fs);
+    EXPECT_EQ(sharded.prices(), plain.prices());
+    if (fs & FEED_END) {
+      break;
+    }
+  }
+
+  // Stopping early doesn't hang the decoders.
+  ShardedIEXFeed abandoned(pair, /*num_threads=*/2, /*days_per_shard=*/1);
+  abandoned.adjust_prices();
+}
+
+TEST(ShardedFeedTest, SameJobResults) {
+  const std::vector<string> pair = {test_symbols()[0], test_symbols()[2]};
+  std::vector<std::tuple<double, double>> results;
+  for (bool sharded : {false, true}) {
+    std::unique_ptr<Feed> feed;
+    if (sharded) {
+      feed = std::make_unique<ShardedIEXFeed>(pair, /*num_threads=*/4,
+                                              /*days_per_shard=*/2);
+    } else {
+      feed = std::make_unique<IEXFeed>(pair);
+    }
+    WelfordRunningStatistics bh_stats;
+    WelfordRunningStatistics wave_stats;
+    DynamicHistogram bh_hist(/*max_num_buckets=*/50);
+    DynamicHistogram wave_hist(/*max_num_buckets=*/50);
+    results.push_back(job(/*feed=*/std::move(feed), /*cash=*/100000.0,
+                          /*rebalance_threshold=*/1.001,
+                          /*bh_stats=*/&bh_stats, /*wave_stats=*/&wave_stats,
+                          /*bh_hist=*/&bh_hist, /*wave_hist=*/&wave_hist));
+  }
+  EXPECT_EQ(results[1], results[0]);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
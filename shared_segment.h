@@ -0,0 +1,627 @@
+#ifndef WAVE_ARBITRAGE_SHARED_SEGMENT_H
+#define WAVE_ARBITRAGE_SHARED_SEGMENT_H
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+
+using std::string;
+
+// The trades and corporate actions of a symbol, decoded from its day files.
+// A day holds the trades that IEXFeed would see from that day's file, which
+// leaves out the file's first event.
+struct DecodedSymbol {
+  string symbol;
+  std::vector<int64_t> seconds;
+  std::vector<int32_t> nanos;
+  // As reported by IEX, in ten-thousandths of a dollar.
+  std::vector<int64_t> prices;
+  // The end of each day's trades.
+  std::vector<uint64_t> day_ends;
+  std::vector<PriceAction> price_actions;
+
+  static DecodedSymbol decode(const string &symbol,
+                              const std::vector<string> &files,
+                              const std::vector<PriceAction> &price_actions) {
+    DecodedSymbol decoded;
+    decoded.symbol = symbol;
+    decoded.price_actions = price_actions;
+    TradeReader reader;
+    for (const auto &file : files) {
+      reader.open(file);
+      reader.skip_event();
+      while (reader.next_trade()) {
+        decoded.seconds.push_back(reader.trade().timestamp().seconds());
+        decoded.nanos.push_back(reader.trade().timestamp().nanos());
+        decoded.prices.push_back(reader.trade().price());
+      }
+      decoded.day_ends.push_back(decoded.seconds.size());
+    }
+    return decoded;
+  }
+};
+
+// Decoded symbols published in a named shared memory segment, so that any
+// number of backtest processes on the machine can replay them without
+// decoding the day files again. The first process to ask for a segment
+// decodes and publishes it, and later ones map it read-only. The publisher
+// holds an exclusive flock on the segment until it's ready, so a segment
+// whose publisher died part way through can be told apart and replaced.
+//
+// Names that start with a '/' and contain no other '/' are POSIX shared
+// memory objects. Any other name is taken to be a file path, which lets the
+// segment live on a hugetlbfs mount such as /dev/hugepages.
+//
+// The segment starts with a Header, followed by one SymbolEntry per symbol.
+// Every column is at an 8-byte aligned offset from the start of the segment.
+class SharedTradeSegment {
+public:
+  static constexpr uint64_t kMagic = 0x5741564553484d31; // "WAVESHM1"
+  // Bump whenever the layout changes.
+  static constexpr uint32_t kVersion = 1;
+  // hugetlbfs only maps whole huge pages.
+  static constexpr size_t kAlignment = 2 << 20;
+  // How long an unlocked, unfinished segment is given before it's taken to
+  // be abandoned. Publishers lock the segment right after creating it.
+  static constexpr time_t kClaimSeconds = 2;
+
+  struct Header {
+    uint64_t magic;
+    uint32_t version;
+    // Set once everything else has been written.
+    uint32_t ready;
+    uint64_t size;
+    uint64_t num_symbols;
+  };
+
+  struct SymbolEntry {
+    char symbol[16];
+    uint64_t num_trades;
+    uint64_t seconds_offset;
+    uint64_t nanos_offset;
+    uint64_t prices_offset;
+    uint64_t num_days;
+    uint64_t day_ends_offset;
+    uint64_t num_price_actions;
+    uint64_t price_actions_offset;
+  };
+
+  struct PriceActionEntry {
+    int64_t seconds;
+    int32_t nanos;
+    uint32_t is_dividend;
+    double ratio;
+  };
+
+  // A symbol's columns, pointing into the segment.
+  struct SymbolView {
+    size_t num_trades;
+    const int64_t *seconds;
+    const int32_t *nanos;
+    const int64_t *prices;
+    size_t num_days;
+    const uint64_t *day_ends;
+    std::vector<PriceAction> price_actions;
+  };
+
+  SharedTradeSegment(const SharedTradeSegment &) = delete;
+  SharedTradeSegment &operator=(const SharedTradeSegment &) = delete;
+
+  ~SharedTradeSegment() { munmap(const_cast<char *>(base_), size_); }
+
+  // Creates the segment and writes the symbols that decode returns to it.
+  // Returns false without calling decode if a segment with the name already
+  // exists.
+  static bool publish(const string &name,
+                      std::function<std::vector<DecodedSymbol>()> decode) {
+    // Creating the segment first claims the name, so that other processes
+    // wait for this one instead of decoding the same symbols.
+    const int fd = open_fd(name, O_RDWR | O_CREAT | O_EXCL);
+    if (fd < 0) {
+      return false;
+    }
+    // Released when the fd is closed, or when this process dies.
+    CHECK_EQ(flock(fd, LOCK_EX), 0) << name;
+    const std::vector<DecodedSymbol> symbols = decode();
+
+    size_t size = sizeof(Header) + symbols.size() * sizeof(SymbolEntry);
+    for (const auto &symbol : symbols) {
+      size += padded(symbol.seconds.size() * sizeof(int64_t)) +
+              padded(symbol.nanos.size() * sizeof(int32_t)) +
+              padded(symbol.prices.size() * sizeof(int64_t)) +
+              padded(symbol.day_ends.size() * sizeof(uint64_t)) +
+              symbol.price_actions.size() * sizeof(PriceActionEntry);
+    }
+    size = (size + kAlignment - 1) / kAlignment * kAlignment;
+
+    CHECK_EQ(ftruncate(fd, size), 0) << name;
+    char *base = static_cast<char *>(
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    CHECK(base != MAP_FAILED) << name;
+
+    Header *header = reinterpret_cast<Header *>(base);
+    header->magic = kMagic;
+    header->version = kVersion;
+    header->size = size;
+    header->num_symbols = symbols.size();
+
+    SymbolEntry *entries = reinterpret_cast<SymbolEntry *>(header + 1);
+    uint64_t offset = sizeof(Header) + symbols.size() * sizeof(SymbolEntry);
+    auto append = [&](const void *data, size_t bytes) {
+      const uint64_t start = offset;
+      if (bytes > 0) {
+        memcpy(base + offset, data, bytes);
+      }
+      offset += padded(bytes);
+      return start;
+    };
+    for (size_t s = 0; s < symbols.size(); s++) {
+      const DecodedSymbol &symbol = symbols[s];
+      SymbolEntry &entry = entries[s];
+      CHECK_LT(symbol.symbol.size(), sizeof(entry.symbol)) << symbol.symbol;
+      memset(entry.symbol, 0, sizeof(entry.symbol));
+      memcpy(entry.symbol, symbol.symbol.data(), symbol.symbol.size());
+
+      entry.num_trades = symbol.seconds.size();
+      entry.seconds_offset = append(symbol.seconds.data(),
+                                    symbol.seconds.size() * sizeof(int64_t));
+      entry.nanos_offset =
+          append(symbol.nanos.data(), symbol.nanos.size() * sizeof(int32_t));
+      entry.prices_offset =
+          append(symbol.prices.data(), symbol.prices.size() * sizeof(int64_t));
+      entry.num_days = symbol.day_ends.size();
+      entry.day_ends_offset =
+          append(symbol.day_ends.data(),
+                 symbol.day_ends.size() * sizeof(uint64_t));
+
+      std::vector<PriceActionEntry> price_actions;
+      for (const auto &price_action : symbol.price_actions) {
+        price_actions.push_back(PriceActionEntry{
+            price_action.timestamp.seconds(), price_action.timestamp.nanos(),
+            price_action.is_dividend, price_action.ratio});
+      }
+      entry.num_price_actions = price_actions.size();
+      entry.price_actions_offset =
+          append(price_actions.data(),
+                 price_actions.size() * sizeof(PriceActionEntry));
+    }
+
+    __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+    munmap(base, size);
+    close(fd);
+    return true;
+  }
+
+  // Maps an existing segment read-only. Returns null if there is none, if it
+  // hasn't been finished yet, or if it was written with a different layout.
+  static std::unique_ptr<SharedTradeSegment> attach(const string &name) {
+    bool stale;
+    return attach(name, &stale);
+  }
+
+  // Attaches to the segment, first decoding the symbols and publishing it if
+  // it doesn't exist yet. If another process is publishing it, waits for
+  // that to finish. A segment left by an older version or by a publisher
+  // that died is replaced, and so is one that lacks any of the symbols. The
+  // replacement holds the old segment's symbols as well, so that processes
+  // asking for different symbols settle on one segment.
+  static std::unique_ptr<SharedTradeSegment>
+  attach_or_publish(const string &name, const std::vector<string> &symbols,
+                    const IEXManifest &manifest) {
+    std::vector<string> wanted = symbols;
+    while (true) {
+      bool stale = false;
+      if (auto segment = attach(name, &stale)) {
+        std::vector<string> missing;
+        for (const auto &symbol : wanted) {
+          if (!segment->has_symbol(symbol)) {
+            missing.push_back(symbol);
+          }
+        }
+        if (missing.empty()) {
+          return segment;
+        }
+        LOG(WARNING) << "Replacing " << name << ", which lacks "
+                     << missing.size() << " symbols, such as " << missing[0];
+        const std::set<string> known(wanted.begin(), wanted.end());
+        for (const auto &symbol : segment->symbols()) {
+          if (known.count(symbol) == 0) {
+            wanted.push_back(symbol);
+          }
+        }
+        unlink_if_same(name, segment->device_, segment->inode_);
+      } else if (stale) {
+        LOG(WARNING) << "Replacing " << name << ", which has another layout";
+        unlink(name);
+      } else {
+        struct stat st;
+        if (abandoned(name, &st)) {
+          LOG(WARNING) << "Replacing " << name
+                       << ", whose publisher went away";
+          unlink_if_same(name, st.st_dev, st.st_ino);
+        }
+      }
+
+      if (!publish(name, [&]() {
+            IEXManifest merged = manifest;
+            for (const auto &symbol : wanted) {
+              if (merged.files.count(symbol) == 0) {
+                const IEXManifest loaded = IEXManifest::load({symbol});
+                merged.files[symbol] = loaded.files.at(symbol);
+                merged.price_actions[symbol] =
+                    loaded.price_actions.at(symbol);
+              }
+            }
+            return decode_all(wanted, merged);
+          })) {
+        // Somebody else is writing it.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+    }
+  }
+
+  // Removes the name. Processes that are attached keep their mapping.
+  static void unlink(const string &name) {
+    if (is_file(name)) {
+      ::unlink(name.c_str());
+    } else {
+      shm_unlink(name.c_str());
+    }
+  }
+
+  size_t size() const { return size_; }
+
+  size_t num_symbols() const { return header()->num_symbols; }
+
+  std::vector<string> symbols() const {
+    const SymbolEntry *entries =
+        reinterpret_cast<const SymbolEntry *>(header() + 1);
+    std::vector<string> symbols;
+    for (size_t s = 0; s < num_symbols(); s++) {
+      symbols.push_back(
+          string(entries[s].symbol,
+                 strnlen(entries[s].symbol, sizeof(entries[s].symbol))));
+    }
+    return symbols;
+  }
+
+  bool has_symbol(const string &symbol) const {
+    return find(symbol) != nullptr;
+  }
+
+  // Dies if the symbol isn't in the segment.
+  SymbolView symbol(const string &symbol) const {
+    const SymbolEntry *found = find(symbol);
+    CHECK(found != nullptr) << "No " << symbol << " in the shared segment";
+    const SymbolEntry &entry = *found;
+
+    SymbolView view;
+    view.num_trades = entry.num_trades;
+    view.seconds = at<int64_t>(entry.seconds_offset);
+    view.nanos = at<int32_t>(entry.nanos_offset);
+    view.prices = at<int64_t>(entry.prices_offset);
+    view.num_days = entry.num_days;
+    view.day_ends = at<uint64_t>(entry.day_ends_offset);
+    const PriceActionEntry *price_actions =
+        at<PriceActionEntry>(entry.price_actions_offset);
+    for (size_t a = 0; a < entry.num_price_actions; a++) {
+      Timestamp timestamp;
+      timestamp.set_seconds(price_actions[a].seconds);
+      timestamp.set_nanos(price_actions[a].nanos);
+      view.price_actions.push_back(PriceAction(
+          timestamp, price_actions[a].ratio, price_actions[a].is_dividend));
+    }
+    return view;
+  }
+
+  // Decodes the symbols on all cores.
+  static std::vector<DecodedSymbol>
+  decode_all(const std::vector<string> &symbols, const IEXManifest &manifest) {
+    std::vector<DecodedSymbol> decoded(symbols.size());
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> threads;
+    for (unsigned tx = 0; tx < std::thread::hardware_concurrency(); tx++) {
+      threads.push_back(std::thread([&]() {
+        size_t s;
+        while ((s = next.fetch_add(1)) < symbols.size()) {
+          decoded[s] = DecodedSymbol::decode(
+              symbols[s], manifest.files.at(symbols[s]),
+              manifest.price_actions.at(symbols[s]));
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    return decoded;
+  }
+
+private:
+  const char *base_;
+  size_t size_;
+  // Which segment this is, in case the name has since been reused.
+  dev_t device_;
+  ino_t inode_;
+
+  SharedTradeSegment(const char *base, size_t size, dev_t device, ino_t inode)
+      : base_(base), size_(size), device_(device), inode_(inode) {}
+
+  static std::unique_ptr<SharedTradeSegment> attach(const string &name,
+                                                    bool *stale) {
+    *stale = false;
+    const int fd = open_fd(name, O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0) << name;
+    if (static_cast<size_t>(st.st_size) < sizeof(Header)) {
+      close(fd);
+      return nullptr;
+    }
+    const char *base = static_cast<const char *>(
+        mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    close(fd);
+    CHECK(base != MAP_FAILED) << name;
+
+    const Header *header = reinterpret_cast<const Header *>(base);
+    const bool ready = __atomic_load_n(&header->ready, __ATOMIC_ACQUIRE);
+    if (!ready || header->magic != kMagic || header->version != kVersion ||
+        header->size != static_cast<size_t>(st.st_size)) {
+      *stale = ready;
+      munmap(const_cast<char *>(base), st.st_size);
+      return nullptr;
+    }
+    return std::unique_ptr<SharedTradeSegment>(
+        new SharedTradeSegment(base, st.st_size, st.st_dev, st.st_ino));
+  }
+
+  // Returns true if the segment under the name was left unfinished by a
+  // publisher that went away, and sets *st to its stat.
+  static bool abandoned(const string &name, struct stat *st) {
+    const int fd = open_fd(name, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    bool abandoned = false;
+    // The publisher's lock is held until the segment is ready.
+    if (flock(fd, LOCK_SH | LOCK_NB) == 0) {
+      CHECK_EQ(fstat(fd, st), 0) << name;
+      Header header;
+      const bool ready =
+          static_cast<size_t>(st->st_size) >= sizeof(Header) &&
+          pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+          header.ready;
+      // A segment that was just created may not have been locked yet.
+      abandoned = !ready && time(nullptr) - st->st_ctime >= kClaimSeconds;
+    }
+    close(fd);
+    return abandoned;
+  }
+
+  // Unlinks the name if it still refers to the given segment, so that a
+  // replacement that another process has published in the meantime stays.
+  static void unlink_if_same(const string &name, dev_t device, ino_t inode) {
+    const int fd = open_fd(name, O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0) << name;
+    close(fd);
+    if (st.st_dev == device && st.st_ino == inode) {
+      unlink(name);
+    }
+  }
+
+  const SymbolEntry *find(const string &symbol) const {
+    const SymbolEntry *entries =
+        reinterpret_cast<const SymbolEntry *>(header() + 1);
+    for (size_t s = 0; s < num_symbols(); s++) {
+      if (strncmp(entries[s].symbol, symbol.c_str(),
+                  sizeof(entries[s].symbol)) == 0) {
+        return &entries[s];
+      }
+    }
+    return nullptr;
+  }
+
+  const Header *header() const {
+    return reinterpret_cast<const Header *>(base_);
+  }
+
+  template <typename T> const T *at(uint64_t offset) const {
+    return reinterpret_cast<const T *>(base_ + offset);
+  }
+
+  static size_t padded(size_t bytes) { return (bytes + 7) / 8 * 8; }
+
+  static bool is_file(const string &name) {
+    return name.empty() || name[0] != '/' ||
+           name.find('/', 1) != string::npos;
+  }
+
+  static int open_fd(const string &name, int flags) {
+    if (is_file(name)) {
+      return ::open(name.c_str(), flags, 0644);
+    }
+    return shm_open(name.c_str(), flags, 0644);
+  }
+};
+
+// Replays symbols from a SharedTradeSegment exactly the way IEXFeed replays
+// them from their day files.
+class SharedIEXFeed : public Feed {
+public:
+  // Only the days with trades in [first_seconds, end_seconds) are replayed.
+  // Each symbol starts at its first such day, and the feed ends at the first
+  // day that starts at or after end_seconds. There has to be such a day for
+  // every symbol; see has_days().
+  SharedIEXFeed(std::vector<string> symbols,
+                const SharedTradeSegment *segment, int64_t first_seconds = 0,
+                int64_t end_seconds = std::numeric_limits<int64_t>::max())
+      : Feed(symbols), end_seconds_(end_seconds) {
+    for (const auto &symbol : symbols) {
+      views_.push_back(segment->symbol(symbol));
+      days_.push_back(first_day(views_.back(), first_seconds));
+      trades_.push_back(0);
+    }
+
+    CHECK_NE(advance_day(), FEED_END);
+
+    for (size_t i = 0; i < symbols.size(); i++) {
+      const Timestamp ts = trade_timestamp(i);
+      if (before(timestamp_, ts)) {
+        last_timestamp_ = ts;
+        timestamp_ = ts;
+      }
+      prices_[i] = views_[i].prices[trades_[i]] / 10000.0;
+    }
+  }
+
+  string feed_name() const override { return "SharedIEXFeed"; }
+
+  // See IEXFeed::adjust_prices().
+  FeedStatus adjust_prices() override {
+    adjusts_++;
+    Timestamp champ;
+    int champ_idx = 0;
+
+    for (size_t i = 0; i < symbols().size(); i++) {
+      const Timestamp chump = trade_timestamp(i);
+      if (champ.seconds() == 0 || before(chump, champ)) {
+        champ = chump;
+        champ_idx = i;
+      }
+    }
+
+    prices_[champ_idx] = views_[champ_idx].prices[trades_[champ_idx]] / 10000.0;
+    updated_index_ = champ_idx;
+    last_timestamp_ = timestamp_;
+    timestamp_ = champ;
+
+    FeedStatus fs = advance_event(champ_idx);
+    if (fs == FEED_DAY_CHANGE) {
+      if (advance_day() == FEED_END) {
+        return FEED_END;
+      }
+
+      for (size_t i = 0; i < symbols().size(); i++) {
+        for (const auto &price_action : views_[i].price_actions) {
+          if (before(last_timestamp_, price_action.timestamp) &&
+              before(price_action.timestamp, timestamp_)) {
+            if (price_action.is_dividend) {
+              dividends_[i] = price_action.ratio;
+              fs |= FEED_DIVIDEND;
+            } else {
+              splits_[i] = price_action.ratio;
+              fs |= FEED_SPLIT;
+            }
+          }
+        }
+      }
+    }
+
+    return fs;
+  }
+
+  size_t next_batch(Tick *ticks, size_t capacity) override {
+    return fill_batch([this]() { return SharedIEXFeed::adjust_prices(); },
+                      ticks, capacity);
+  }
+
+  // Returns true if the symbol has a day with trades in
+  // [first_seconds, end_seconds).
+  static bool has_days(const SharedTradeSegment::SymbolView &view,
+                       int64_t first_seconds, int64_t end_seconds) {
+    const size_t d = first_day(view, first_seconds);
+    for (size_t day = d; day < view.num_days; day++) {
+      const size_t start = day == 0 ? 0 : view.day_ends[day - 1];
+      if (start < view.day_ends[day]) {
+        return view.seconds[start] < end_seconds;
+      }
+    }
+    return false;
+  }
+
+private:
+  const int64_t end_seconds_;
+  std::vector<SharedTradeSegment::SymbolView> views_;
+  // The next day of each symbol.
+  std::vector<size_t> days_;
+  // The current trade of each symbol.
+  std::vector<size_t> trades_;
+
+  Timestamp last_timestamp_;
+
+  // The first day whose last trade isn't before first_seconds.
+  static size_t first_day(const SharedTradeSegment::SymbolView &view,
+                          int64_t first_seconds) {
+    size_t d = 0;
+    while (d < view.num_days &&
+           (view.day_ends[d] == 0 ||
+            view.seconds[view.day_ends[d] - 1] < first_seconds)) {
+      d++;
+    }
+    return d;
+  }
+
+  Timestamp trade_timestamp(size_t i) const {
+    Timestamp ts;
+    ts.set_seconds(views_[i].seconds[trades_[i]]);
+    ts.set_nanos(views_[i].nanos[trades_[i]]);
+    return ts;
+  }
+
+  FeedStatus advance_day() {
+    for (size_t i = 0; i < symbols().size(); i++) {
+      dividends_[i] = 0.0;
+      splits_[i] = 0.0;
+
+      // Skips days without trades.
+      do {
+        if (days_[i] >= views_[i].num_days) {
+          return FEED_END;
+        }
+        trades_[i] = days_[i] == 0 ? 0 : views_[i].day_ends[days_[i] - 1];
+        days_[i]++;
+      } while (trades_[i] >= views_[i].day_ends[days_[i] - 1]);
+      if (views_[i].seconds[trades_[i]] >= end_seconds_) {
+        return FEED_END;
+      }
+
+      const Timestamp ts = trade_timestamp(i);
+      if (i == 0 || before(ts, timestamp_)) {
+        timestamp_ = ts;
+      }
+    }
+
+    return FEED_DAY_CHANGE;
+  }
+
+  FeedStatus advance_event(size_t i) {
+    trades_[i]++;
+    return trades_[i] < views_[i].day_ends[days_[i] - 1] ? FEED_OK
+                                                         : FEED_DAY_CHANGE;
+  }
+};
+
+#endif // WAVE_ARBITRAGE_SHARED_SEGMENT_H
@@ -0,0 +1,285 @@
+#include <sys/wait.h>
+
+#include <fstream>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "shared_segment.h"
+#include "synthetic_data_testing.h"
+
+// Writes a day file with a trade every few seconds after the given start, and
+// returns its name.
+string write_day(const string &symbol, int day, int64_t start, int num_trades,
+                 int64_t base_price) {
+  market_data::Events events;
+  events.add_events()->mutable_security_directory()->set_symbol(symbol);
+  for (int n = 0; n < num_trades; n++) {
+    auto *trade = events.add_events()->mutable_trade();
+    trade->set_symbol(symbol);
+    trade->mutable_timestamp()->set_seconds(start + 3 * n);
+    trade->mutable_timestamp()->set_nanos(n * 1000);
+    trade->set_price(base_price + (n * 37) % 101);
+  }
+
+  const string filename = ::testing::TempDir() + "/" + symbol + "_" +
+                          std::to_string(day) + ".pb";
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+  CHECK(events.SerializeToOstream(&out));
+  return filename;
+}
+
+IEXManifest make_manifest() {
+  static constexpr int64_t kDay = 24 * 60 * 60;
+  IEXManifest manifest;
+  for (int day = 0; day < 3; day++) {
+    // BAR has no trades on the second day.
+    manifest.files["FOO"].push_back(
+        write_day("FOO", day, day * kDay + 1, 200, 200000));
+    manifest.files["BAR"].push_back(
+        write_day("BAR", day, day * kDay + 2, day == 1 ? 0 : 150, 400000));
+  }
+  Timestamp ex_date;
+  ex_date.set_seconds(kDay - 10);
+  manifest.price_actions["FOO"] = {PriceAction(ex_date, 0.25, true)};
+  ex_date.set_seconds(2 * kDay - 10);
+  manifest.price_actions["BAR"] = {PriceAction(ex_date, 2.0, false)};
+  return manifest;
+}
+
+TEST(SharedSegmentTest, PublishAndAttach) {
+  const string name = "/shared_segment_test." + std::to_string(getpid());
+  SharedTradeSegment::unlink(name);
+  EXPECT_EQ(SharedTradeSegment::attach(name), nullptr);
+
+  DecodedSymbol foo;
+  foo.symbol = "FOO";
+  foo.seconds = {1, 2, 3};
+  foo.nanos = {0, 5, 0};
+  foo.prices = {100, 101, 99};
+  foo.day_ends = {2, 3};
+  Timestamp ts;
+  ts.set_seconds(2);
+  foo.price_actions = {PriceAction(ts, 0.5, true)};
+  DecodedSymbol bar;
+  bar.symbol = "BAR";
+
+  ASSERT_TRUE(SharedTradeSegment::publish(name, [&]() {
+    return std::vector<DecodedSymbol>{foo, bar};
+  }));
+  // The name is taken now.
+  EXPECT_FALSE(SharedTradeSegment::publish(name, []() {
+    ADD_FAILURE() << "Decoded for an existing segment";
+    return std::vector<DecodedSymbol>();
+  }));
+
+  auto segment = SharedTradeSegment::attach(name);
+  ASSERT_NE(segment, nullptr);
+  EXPECT_EQ(segment->num_symbols(), 2);
+  EXPECT_EQ(segment->size() % SharedTradeSegment::kAlignment, 0);
+
+  const auto view = segment->symbol("FOO");
+  ASSERT_EQ(view.num_trades, 3);
+  EXPECT_EQ(std::vector<int64_t>(view.seconds, view.seconds + 3),
+            foo.seconds);
+  EXPECT_EQ(std::vector<int32_t>(view.nanos, view.nanos + 3), foo.nanos);
+  EXPECT_EQ(std::vector<int64_t>(view.prices, view.prices + 3), foo.prices);
+  ASSERT_EQ(view.num_days, 2);
+  EXPECT_EQ(view.day_ends[1], 3);
+  ASSERT_EQ(view.price_actions.size(), 1);
+  EXPECT_EQ(view.price_actions[0].timestamp.seconds(), 2);
+  EXPECT_EQ(view.price_actions[0].ratio, 0.5);
+  EXPECT_TRUE(view.price_actions[0].is_dividend);
+  EXPECT_EQ(segment->symbol("BAR").num_trades, 0);
+
+  SharedTradeSegment::unlink(name);
+  // Mappings outlive the name.
+  EXPECT_EQ(segment->symbol("FOO").prices[2], 99);
+  EXPECT_EQ(SharedTradeSegment::attach(name), nullptr);
+}
+
+TEST(SharedSegmentTest, RejectsOtherVersions) {
+  const string name = ::testing::TempDir() + "/shared_segment_test.old";
+  SharedTradeSegment::unlink(name);
+  ASSERT_TRUE(SharedTradeSegment::publish(
+      name, []() { return std::vector<DecodedSymbol>(); }));
+  {
+    // Pretend the segment was written by an older version.
+    std::fstream file(name, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offsetof(SharedTradeSegment::Header, version));
+    const uint32_t version = SharedTradeSegment::kVersion - 1;
+    file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  }
+  EXPECT_EQ(SharedTradeSegment::attach(name), nullptr);
+
+  // It gets replaced.
+  const IEXManifest manifest = make_manifest();
+  auto segment = SharedTradeSegment::attach_or_publish(name, {"FOO"},
+                                                       manifest);
+  ASSERT_NE(segment, nullptr);
+  EXPECT_EQ(segment->num_symbols(), 1);
+  SharedTradeSegment::unlink(name);
+}
+
+TEST(SharedSegmentTest, ReplacesAbandonedSegments) {
+  const string name = "/shared_segment_test." + std::to_string(getpid());
+  SharedTradeSegment::unlink(name);
+  // The publisher dies before the segment is ready.
+  const pid_t pid = fork();
+  if (pid == 0) {
+    SharedTradeSegment::publish(name, []() {
+      _exit(0);
+      return std::vector<DecodedSymbol>();
+    });
+    _exit(1);
+  }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+  EXPECT_EQ(SharedTradeSegment::attach(name), nullptr);
+
+  auto segment =
+      SharedTradeSegment::attach_or_publish(name, {"FOO"}, make_manifest());
+  ASSERT_NE(segment, nullptr);
+  EXPECT_EQ(segment->symbols(), std::vector<string>{"FOO"});
+  SharedTradeSegment::unlink(name);
+}
+
+TEST(SharedSegmentTest, WaitsForSlowPublishers) {
+  const string name = "/shared_segment_test." + std::to_string(getpid());
+  SharedTradeSegment::unlink(name);
+  const IEXManifest manifest = make_manifest();
+  std::atomic<int> decodes = 0;
+  std::thread publisher([&]() {
+    ASSERT_TRUE(SharedTradeSegment::publish(name, [&]() {
+      decodes++;
+      std::this_thread::sleep_for(
+          std::chrono::seconds(SharedTradeSegment::kClaimSeconds + 1));
+      return SharedTradeSegment::decode_all({"BAR"}, manifest);
+    }));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  auto segment = SharedTradeSegment::attach_or_publish(name, {"BAR"}, manifest);
+  publisher.join();
+  ASSERT_NE(segment, nullptr);
+  EXPECT_EQ(decodes, 1);
+  SharedTradeSegment::unlink(name);
+}
+
+TEST(SharedSegmentTest, ReplacesSegmentsWithoutTheSymbols) {
+  const string name = "/shared_segment_test." + std::to_string(getpid());
+  SharedTradeSegment::unlink(name);
+  const IEXManifest manifest = make_manifest();
+  auto foo = SharedTradeSegment::attach_or_publish(name, {"FOO"}, manifest);
+  ASSERT_NE(foo, nullptr);
+  EXPECT_FALSE(foo->has_symbol("BAR"));
+
+  // The replacement keeps the symbols that were already there.
+  auto bar = SharedTradeSegment::attach_or_publish(name, {"BAR"}, manifest);
+  ASSERT_NE(bar, nullptr);
+  EXPECT_EQ(bar->symbols(), (std::vector<string>{"BAR", "FOO"}));
+  EXPECT_EQ(bar->symbol("FOO").num_trades, foo->symbol("FOO").num_trades);
+
+  // Which now does for both.
+  auto both =
+      SharedTradeSegment::attach_or_publish(name, {"FOO", "BAR"}, manifest);
+  EXPECT_EQ(both->symbols(), (std::vector<string>{"BAR", "FOO"}));
+  SharedTradeSegment::unlink(name);
+}
+
+TEST(SharedSegmentTest, MatchesIEXFeed) {
+  const string name = "/shared_segment_test." + std::to_string(getpid());
+  SharedTradeSegment::unlink(name);
+  const IEXManifest manifest = make_manifest();
+  auto segment =
+      SharedTradeSegment::attach_or_publish(name, {"FOO", "BAR"}, manifest);
+  ASSERT_NE(segment, nullptr);
+  SharedTradeSegment::unlink(name);
+
+  for (const auto &symbols : std::vector<std::vector<string>>{
+           {"FOO", "BAR"}, {"BAR", "FOO"}, {"FOO"}}) {
+    IEXFeed expected_feed(symbols, &manifest);
+    SharedIEXFeed actual_feed(symbols, segment.get());
+    EXPECT_EQ(actual_feed.prices(), expected_feed.prices());
+    EXPECT_EQ(actual_feed.timestamp().seconds(),
+              expected_feed.timestamp().seconds());
+
+    const std::vector<Tick> expected =
+        all_ticks(&expected_feed, /*batch_size=*/64);
+    const std::vector<Tick> actual =
+        all_ticks(&actual_feed, /*batch_size=*/64);
+    ASSERT_EQ(actual.size(), expected.size());
+    int actions = 0;
+    for (size_t t = 0; t < expected.size(); t++) {
+      EXPECT_EQ(actual[t].seconds, expected[t].seconds) << t;
+      EXPECT_EQ(actual[t].nanos, expected[t].nanos) << t;
+      EXPECT_EQ(actual[t].symbol_index, expected[t].symbol_index) << t;
+      EXPECT_EQ(actual[t].value, expected[t].value) << t;
+      EXPECT_EQ(actual[t].flags, expected[t].flags) << t;
+      actions += (expected[t].flags & (TICK_DIVIDEND | TICK_SPLIT)) != 0;
+    }
+    EXPECT_GT(actions, 0);
+  }
+}
+
+TEST(SharedSegmentTest, DayRange) {
+  static constexpr int64_t kDay = 24 * 60 * 60;
+  const string name = "/shared_segment_test." + std::to_string(getpid());
+  SharedTradeSegment::unlink(name);
+  const IEXManifest manifest = make_manifest();
+  auto segment =
+      SharedTradeSegment::attach_or_publish(name, {"FOO", "BAR"}, manifest);
+  ASSERT_NE(segment, nullptr);
+  SharedTradeSegment::unlink(name);
+  EXPECT_EQ(segment->symbols(), (std::vector<string>{"FOO", "BAR"}));
+
+  const auto foo = segment->symbol("FOO");
+  const auto bar = segment->symbol("BAR");
+  EXPECT_TRUE(SharedIEXFeed::has_days(foo, kDay, 2 * kDay));
+  EXPECT_FALSE(SharedIEXFeed::has_days(bar, kDay, 2 * kDay));
+  EXPECT_TRUE(SharedIEXFeed::has_days(bar, kDay, 3 * kDay));
+  EXPECT_FALSE(SharedIEXFeed::has_days(foo, 3 * kDay, 4 * kDay));
+
+  // Only the middle day, without the dividend before it.
+  SharedIEXFeed middle({"FOO"}, segment.get(), kDay, 2 * kDay);
+  EXPECT_EQ(middle.timestamp().seconds(), kDay + 1);
+  const std::vector<Tick> ticks = all_ticks(&middle, /*batch_size=*/64);
+  ASSERT_FALSE(ticks.empty());
+  EXPECT_TRUE(ticks.back().flags & TICK_END);
+  for (const auto &tick : ticks) {
+    EXPECT_GE(tick.seconds, kDay);
+    EXPECT_LT(tick.seconds, 2 * kDay);
+    EXPECT_FALSE(tick.flags & TICK_DIVIDEND);
+  }
+
+  // From the middle day on, the last day is the same as in the whole feed.
+  SharedIEXFeed whole({"FOO", "BAR"}, segment.get());
+  SharedIEXFeed late({"FOO", "BAR"}, segment.get(), kDay);
+  std::vector<Tick> expected;
+  for (const auto &tick : all_ticks(&whole, /*batch_size=*/64)) {
+    if (tick.seconds >= 2 * kDay) {
+      expected.push_back(tick);
+    }
+  }
+  std::vector<Tick> actual;
+  for (const auto &tick : all_ticks(&late, /*batch_size=*/64)) {
+    if (tick.seconds >= 2 * kDay) {
+      actual.push_back(tick);
+    }
+  }
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t t = 0; t < expected.size(); t++) {
+    EXPECT_EQ(actual[t].seconds, expected[t].seconds) << t;
+    EXPECT_EQ(actual[t].value, expected[t].value) << t;
+    EXPECT_EQ(actual[t].flags, expected[t].flags) << t;
+  }
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
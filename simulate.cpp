@@ -2,6 +2,7 @@
 #include <time.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cmath>
@@ -25,16 +26,31 @@ public:
     M2_ += delta * delta2;
   }
 
-  int64_t count() { return count_; }
+  int64_t count() const { return count_; }
 
-  double mean() { return mean_; }
+  double mean() const { return mean_; }
 
-  double variance() { return M2_ / std::max(static_cast<int64_t>(1), count_); }
+  double variance() const {
+    return M2_ / std::max(static_cast<int64_t>(1), count_);
+  }
 
-  double sample_variance() {
+  double sample_variance() const {
     return M2_ / std::max(static_cast<int64_t>(1), count_ - 1);
   };
 
+  // Folds in statistics that were gathered separately. See Chan et al.,
+  // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+  void merge(const WelfordRunningStatistics &other) {
+    if (other.count_ == 0) {
+      return;
+    }
+    const int64_t count = count_ + other.count_;
+    const double delta = other.mean_ - mean_;
+    mean_ += delta * other.count_ / count;
+    M2_ += other.M2_ + delta * delta * count_ * other.count_ / count;
+    count_ = count;
+  }
+
 private:
   int64_t count_;
   double mean_;
@@ -136,7 +152,8 @@ protected:
       for (size_t i = 0; i < prices_.size(); i++) {
         prices_[i] =
             prices_[i] * exp((gbm_mu_ - gbm_sigma_ * gbm_sigma_ / 2) * gbm_dt_ +
-                             gbm_sigma_ * norm_dist_(generator_));
+                             gbm_sigma_ * gbm_sqrt_dt_ *
+                                 norm_dist_(generator_));
       }
     }
   }
@@ -191,6 +208,323 @@ protected:
   }
 };
 
+// Advances kBatch independent trials of BuyAndHold and one or more
+// WaveArbitrage threshold variants in lockstep. Each price and position is
+// stored as [stock][trial], so every inner loop runs over contiguous trials
+// and can be vectorized.
+//
+// Unpaired, the wave variants share one price path that is independent of
+// BuyAndHold's, just like two separate Flippers. Paired, every strategy in a
+// trial sees the same price path, so the difference between them only comes
+// from the strategies. That uses common random numbers to cut the variance
+// of the difference, and also halves the work spent on generating paths.
+template <int kBatch> class BatchedFlipper {
+  static_assert(kBatch % 2 == 0, "Normals are generated in pairs.");
+
+public:
+  BatchedFlipper(int num_stocks, std::vector<double> thresholds, bool paired,
+                 double gbm_dt, double gbm_sigma, uint64_t seed)
+      : num_stocks_(num_stocks), thresholds_(thresholds), paired_(paired),
+        step_scale_(gbm_sigma * sqrt(gbm_dt)),
+        bh_prices_(num_stocks * kBatch, 1.0),
+        wave_prices_(paired ? 0 : num_stocks * kBatch, 1.0),
+        wave_positions_(thresholds.size() * num_stocks * kBatch, 1.0),
+        wave_rebalances_(thresholds.size() * kBatch, 0) {
+    // Seed every lane with splitmix64 so that the lanes are independent.
+    for (int b = 0; b < kBatch; b++) {
+      rng_s0_[b] = splitmix64(&seed);
+      rng_s1_[b] = splitmix64(&seed);
+    }
+  }
+
+  void simulate(int flips) {
+    for (int i = 0; i < flips; i++) {
+      for (int s = 0; s < num_stocks_; s++) {
+        step_prices(&bh_prices_[s * kBatch]);
+        if (!paired_) {
+          step_prices(&wave_prices_[s * kBatch]);
+        }
+      }
+      for (size_t k = 0; k < thresholds_.size(); k++) {
+        rebalance(k);
+      }
+    }
+  }
+
+  size_t num_variants() const { return thresholds_.size(); }
+
+  // BuyAndHold holds one share of each stock.
+  double bh_value(int b) const {
+    double value = 0.0;
+    for (int s = 0; s < num_stocks_; s++) {
+      value += bh_prices_[s * kBatch + b];
+    }
+    return value;
+  }
+
+  double bh_g(int b) const { return g(bh_value(b), &bh_prices_[0], b); }
+
+  double wave_value(int b, size_t k = 0) const {
+    const double *positions = &wave_positions_[k * num_stocks_ * kBatch];
+    const double *prices = wave_prices();
+    double value = 0.0;
+    for (int s = 0; s < num_stocks_; s++) {
+      value += positions[s * kBatch + b] * prices[s * kBatch + b];
+    }
+    return value;
+  }
+
+  double wave_g(int b, size_t k = 0) const {
+    return g(wave_value(b, k), wave_prices(), b);
+  }
+
+  int wave_rebalances(int b, size_t k = 0) const {
+    return wave_rebalances_[k * kBatch + b];
+  }
+
+private:
+  const int num_stocks_;
+  const std::vector<double> thresholds_;
+  const bool paired_;
+  const double step_scale_;
+  std::vector<double> bh_prices_;
+  // Empty when paired.
+  std::vector<double> wave_prices_;
+  // Stored as [variant][stock][trial].
+  std::vector<double> wave_positions_;
+  std::vector<int> wave_rebalances_;
+
+  // One xoroshiro128+ generator per trial.
+  uint64_t rng_s0_[kBatch];
+  uint64_t rng_s1_[kBatch];
+  double normals_[kBatch];
+
+  const double *wave_prices() const {
+    return paired_ ? &bh_prices_[0] : &wave_prices_[0];
+  }
+
+  static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  // Fills normals_ with one standard normal per trial using Box-Muller.
+  void fill_normals() {
+    double uniforms[kBatch];
+    for (int b = 0; b < kBatch; b++) {
+      const uint64_t s0 = rng_s0_[b];
+      uint64_t s1 = rng_s1_[b];
+      const uint64_t result = s0 + s1;
+      s1 ^= s0;
+      rng_s0_[b] = rotl(s0, 24) ^ s1 ^ (s1 << 16);
+      rng_s1_[b] = rotl(s1, 37);
+      // Map to (0, 1] so that the log below is finite.
+      uniforms[b] = ((result >> 11) + 1) * 0x1.0p-53;
+    }
+
+    static constexpr int kHalf = kBatch / 2;
+    for (int b = 0; b < kHalf; b++) {
+      const double radius = sqrt(-2.0 * log(uniforms[b]));
+      const double theta = 2.0 * M_PI * uniforms[b + kHalf];
+      normals_[b] = radius * cos(theta);
+      normals_[b + kHalf] = radius * sin(theta);
+    }
+  }
+
+  // Matches the arithmetic branch of Flipper::adjust_prices().
+  void step_prices(double *prices) {
+    fill_normals();
+    for (int b = 0; b < kBatch; b++) {
+      prices[b] += prices[b] * (step_scale_ * normals_[b]);
+    }
+  }
+
+  // Matches WaveArbitrage::rebalance() for variant k, using masks instead of
+  // branches.
+  void rebalance(size_t k) {
+    double *all_positions = &wave_positions_[k * num_stocks_ * kBatch];
+    const double *all_prices = wave_prices();
+
+    double per_stock[kBatch];
+    for (int b = 0; b < kBatch; b++) {
+      per_stock[b] = 0.0;
+    }
+    for (int s = 0; s < num_stocks_; s++) {
+      const double *positions = &all_positions[s * kBatch];
+      const double *prices = &all_prices[s * kBatch];
+      for (int b = 0; b < kBatch; b++) {
+        per_stock[b] += positions[b] * prices[b];
+      }
+    }
+
+    const double inv_num_stocks = 1.0 / num_stocks_;
+    const double threshold = thresholds_[k];
+    int do_rebalance[kBatch];
+    for (int b = 0; b < kBatch; b++) {
+      per_stock[b] *= inv_num_stocks;
+      do_rebalance[b] = 0;
+    }
+
+    for (int s = 0; s < num_stocks_; s++) {
+      const double *positions = &all_positions[s * kBatch];
+      const double *prices = &all_prices[s * kBatch];
+      for (int b = 0; b < kBatch; b++) {
+        do_rebalance[b] |= positions[b] * prices[b] > per_stock[b] * threshold;
+      }
+    }
+
+    for (int s = 0; s < num_stocks_; s++) {
+      double *positions = &all_positions[s * kBatch];
+      const double *prices = &all_prices[s * kBatch];
+      for (int b = 0; b < kBatch; b++) {
+        positions[b] =
+            do_rebalance[b] ? per_stock[b] / prices[b] : positions[b];
+      }
+    }
+
+    int *rebalances = &wave_rebalances_[k * kBatch];
+    for (int b = 0; b < kBatch; b++) {
+      rebalances[b] += do_rebalance[b];
+    }
+  }
+
+  double g(double total, const double *prices, int b) const {
+    double prod = 1.0;
+    for (int s = 0; s < num_stocks_; s++) {
+      prod *= total / prices[s * kBatch + b];
+    }
+    return pow(prod, 1.0 / num_stocks_);
+  }
+};
+
+// Simulates BuyAndHold and WaveArbitrage on the same two-stock log-GBM path,
+// but only does work when WaveArbitrage rebalances. This gives the same
+// results as stepping both strategies through every flip, and is much faster
+// when the threshold is wide compared to a single step.
+//
+// Right after a rebalance both positions are worth the same, so the next
+// rebalance happens on the first step where the log price ratio has moved
+// more than log(threshold / (2 - threshold)) either way. With equal drifts
+// and volatilities, that ratio is a driftless random walk that is independent
+// of the sum of the log prices. simulate() samples the ratio at the end of
+// the trial and then fills in Brownian bridge midpoints only where the band
+// might have been crossed, which finds the first crossing step exactly. The
+// sum only needs to be sampled once per rebalance.
+class FirstPassageFlipper {
+public:
+  FirstPassageFlipper(double threshold, double gbm_mu, double gbm_dt,
+                      double gbm_sigma, uint64_t seed)
+      : band_(log(threshold / (2.0 - threshold))),
+        step_drift_((gbm_mu - gbm_sigma * gbm_sigma / 2) * gbm_dt),
+        step_variance_(gbm_sigma * gbm_sigma * gbm_dt), prices_{1.0, 1.0},
+        wave_positions_{1.0, 1.0}, norm_dist_(0.0, 1.0), generator_(seed) {
+    assert(threshold > 1.0 && threshold < 2.0);
+  }
+
+  void simulate(int flips) {
+    int remaining = flips;
+    while (remaining > 0) {
+      // The log price ratio relative to the last rebalance.
+      const double end =
+          sqrt(2 * step_variance_ * remaining) * norm_dist_(generator_);
+      double exit = 0.0;
+      const int steps = first_exit(0.0, end, remaining, &exit);
+      if (steps == 0) {
+        advance(remaining, end);
+        return;
+      }
+
+      advance(steps, exit);
+      const double dollars_per_stock = wave_value() / 2;
+      for (int i = 0; i < 2; i++) {
+        wave_positions_[i] = dollars_per_stock / prices_[i];
+      }
+      rebalances_++;
+      remaining -= steps;
+    }
+  }
+
+  // BuyAndHold holds one share of each stock.
+  double bh_value() const { return prices_[0] + prices_[1]; }
+
+  double bh_g() const { return g(bh_value()); }
+
+  double wave_value() const {
+    return wave_positions_[0] * prices_[0] + wave_positions_[1] * prices_[1];
+  }
+
+  double wave_g() const { return g(wave_value()); }
+
+  int wave_rebalances() const { return rebalances_; }
+
+private:
+  // Bridges whose chance of leaving the band is below this are skipped.
+  static constexpr double kSkipProbability = 1e-12;
+
+  const double band_;
+  const double step_drift_;
+  const double step_variance_;
+  double prices_[2];
+  double wave_positions_[2];
+  int rebalances_ = 0;
+  std::normal_distribution<double> norm_dist_;
+  std::mt19937_64 generator_;
+
+  // Returns the first step in (0, steps] where the random walk from start to
+  // end leaves the band and stores its value there in exit. Returns 0 if it
+  // never does.
+  int first_exit(double start, double end, int steps, double *exit) {
+    if (steps == 1) {
+      if (fabs(end) > band_) {
+        *exit = end;
+        return 1;
+      }
+      return 0;
+    }
+
+    // The chance that a Brownian bridge crosses either edge of the band. The
+    // random walk only visits the integer steps, so it can't leave the band
+    // unless the bridge does.
+    const double variance = 2 * step_variance_ * steps;
+    if (fabs(end) <= band_ &&
+        exp(-2 * (band_ - start) * (band_ - end) / variance) +
+                exp(-2 * (band_ + start) * (band_ + end) / variance) <
+            kSkipProbability) {
+      return 0;
+    }
+
+    const int half = steps / 2;
+    const double mid =
+        start + (end - start) * half / steps +
+        sqrt(2 * step_variance_ * half * (steps - half) / steps) *
+            norm_dist_(generator_);
+    int exit_step = first_exit(start, mid, half, exit);
+    if (exit_step > 0) {
+      return exit_step;
+    }
+    exit_step = first_exit(mid, end, steps - half, exit);
+    return exit_step > 0 ? half + exit_step : 0;
+  }
+
+  // Moves the prices forward by steps flips, during which the log price
+  // ratio changed by ratio.
+  void advance(int steps, double ratio) {
+    const double sum = 2 * step_drift_ * steps +
+                       sqrt(2 * step_variance_ * steps) *
+                           norm_dist_(generator_);
+    prices_[0] *= exp((sum + ratio) / 2);
+    prices_[1] *= exp((sum - ratio) / 2);
+  }
+
+  double g(double total) const {
+    return sqrt(total / prices_[0] * total / prices_[1]);
+  }
+};
+
 void run_experiment(int num_stocks, int flips, int num_trials, double gbm_mu,
                     double gbm_dt, double gbm_sigma) {
   const auto num_cpus = std::thread::hardware_concurrency();
@@ -281,6 +615,312 @@ void run_experiment(int num_stocks, int flips, int num_trials, double gbm_mu,
          wave_val_stats.sample_variance(), total_wave_rebalances);
 }
 
+// Ends an experiment early once the confidence interval on the mean of
+// WaveArbitrage minus BuyAndHold is narrow enough.
+struct StoppingRule {
+  // The full width of the confidence interval. 0.0 always runs every trial.
+  double ci_width = 0.0;
+  // Measure the difference in g instead of the difference in value.
+  bool use_g = false;
+  // 1.96 gives a 95% confidence interval.
+  double z = 1.96;
+  // Guards against stopping on a lucky early variance estimate.
+  int min_trials = 256;
+};
+
+// The full width of the confidence interval on the mean of wave minus bh,
+// where the two were measured on independent paths.
+double difference_ci_width(const WelfordRunningStatistics &bh,
+                           const WelfordRunningStatistics &wave, double z) {
+  return 2.0 * z *
+         sqrt(bh.sample_variance() / std::max<int64_t>(1, bh.count()) +
+              wave.sample_variance() / std::max<int64_t>(1, wave.count()));
+}
+
+// The full width of the confidence interval on the mean of per-trial
+// differences, where both strategies of a trial shared a price path.
+double paired_ci_width(const WelfordRunningStatistics &diff, double z) {
+  return 2.0 * z *
+         sqrt(diff.sample_variance() / std::max<int64_t>(1, diff.count()));
+}
+
+// The statistics of one WaveArbitrage threshold variant.
+struct VariantStats {
+  WelfordRunningStatistics g_stats;
+  WelfordRunningStatistics val_stats;
+  // Per-trial wave minus bh.
+  WelfordRunningStatistics g_diff_stats;
+  WelfordRunningStatistics val_diff_stats;
+  int64_t rebalances = 0;
+
+  void merge(const VariantStats &other) {
+    g_stats.merge(other.g_stats);
+    val_stats.merge(other.val_stats);
+    g_diff_stats.merge(other.g_diff_stats);
+    val_diff_stats.merge(other.val_diff_stats);
+    rebalances += other.rebalances;
+  }
+};
+
+// Same experiment as run_experiment(), but each worker advances kBatch trials
+// at a time with a BatchedFlipper. Workers fold each batch into the shared
+// statistics, and stop as soon as the stopping rule is met for the first
+// threshold or num_trials have run. When paired, every threshold variant runs
+// on BuyAndHold's price path and the stopping rule uses the paired
+// differences.
+void run_batched_experiment(int num_stocks, int flips, int num_trials,
+                            double gbm_dt, double gbm_sigma,
+                            StoppingRule rule = StoppingRule(),
+                            bool paired = false,
+                            std::vector<double> thresholds = {1.001}) {
+  static constexpr int kBatch = 64;
+  const auto num_cpus = std::thread::hardware_concurrency();
+  const uint64_t seed =
+      std::chrono::high_resolution_clock().now().time_since_epoch().count();
+
+  std::atomic<int> next_trial = 0;
+  std::atomic<bool> stop = false;
+  std::mutex mu;
+  WelfordRunningStatistics bh_g_stats;
+  WelfordRunningStatistics bh_val_stats;
+  std::vector<VariantStats> variants(thresholds.size());
+
+  auto ci_width = [&](const VariantStats &variant) {
+    if (paired) {
+      return paired_ci_width(
+          rule.use_g ? variant.g_diff_stats : variant.val_diff_stats, rule.z);
+    }
+    return rule.use_g
+               ? difference_ci_width(bh_g_stats, variant.g_stats, rule.z)
+               : difference_ci_width(bh_val_stats, variant.val_stats, rule.z);
+  };
+
+  std::thread threads[num_cpus];
+  for (size_t i = 0; i < num_cpus; i++) {
+    threads[i] = std::thread(
+        [&](int i) {
+          for (uint64_t batch_seed = seed + i;; batch_seed += num_cpus) {
+            if (stop.load(std::memory_order_relaxed)) {
+              break;
+            }
+            const int first = next_trial.fetch_add(kBatch);
+            if (first >= num_trials) {
+              break;
+            }
+            const int trials = std::min(kBatch, num_trials - first);
+
+            BatchedFlipper<kBatch> flipper(
+                /*num_stocks=*/num_stocks, /*thresholds=*/thresholds,
+                /*paired=*/paired, /*gbm_dt=*/gbm_dt,
+                /*gbm_sigma=*/gbm_sigma, /*seed=*/batch_seed);
+            flipper.simulate(flips);
+
+            WelfordRunningStatistics local_bh_g_stats;
+            WelfordRunningStatistics local_bh_val_stats;
+            std::vector<VariantStats> local_variants(thresholds.size());
+            for (int b = 0; b < trials; b++) {
+              const double bh_g = flipper.bh_g(b);
+              const double bh_value = flipper.bh_value(b);
+              local_bh_g_stats.update(bh_g);
+              local_bh_val_stats.update(bh_value);
+              for (size_t k = 0; k < thresholds.size(); k++) {
+                VariantStats &variant = local_variants[k];
+                const double wave_g = flipper.wave_g(b, k);
+                const double wave_value = flipper.wave_value(b, k);
+                variant.g_stats.update(wave_g);
+                variant.val_stats.update(wave_value);
+                variant.g_diff_stats.update(wave_g - bh_g);
+                variant.val_diff_stats.update(wave_value - bh_value);
+                variant.rebalances += flipper.wave_rebalances(b, k);
+              }
+            }
+
+            std::scoped_lock<std::mutex> lock(mu);
+            bh_g_stats.merge(local_bh_g_stats);
+            bh_val_stats.merge(local_bh_val_stats);
+            for (size_t k = 0; k < thresholds.size(); k++) {
+              variants[k].merge(local_variants[k]);
+            }
+
+            if (rule.ci_width > 0.0 && bh_g_stats.count() >= rule.min_trials &&
+                ci_width(variants[0]) <= rule.ci_width) {
+              stop.store(true, std::memory_order_relaxed);
+            }
+
+            printf("trials: %ld/%d\r", bh_g_stats.count(), num_trials);
+            fflush(stdout);
+          }
+        },
+        i);
+  }
+
+  for (size_t i = 0; i < num_cpus; i++) {
+    threads[i].join();
+  }
+
+  VariantStats &wave = variants[0];
+  printf("\n{\n"
+         "  \"stocks\": %d,\n"
+         "  \"flips_per_trial\": %d,\n"
+         "  \"trials\": %ld,\n"
+         "  \"max_trials\": %d,\n"
+         "  \"paired\": %s,\n"
+         "  \"bh_g\": %.10lf,\n"
+         "  \"bh_g_stddev\": %.10lf,\n"
+         "  \"bh_val\": %.10lf,\n"
+         "  \"bh_stddev\": %.10lf,\n"
+         "  \"wave_g\": %.10lf,\n"
+         "  \"wave_g_stddev\": %.10lf,\n"
+         "  \"wave_val\": %.10lf,\n"
+         "  \"wave_stddev\": %.10lf,\n"
+         "  \"wave_num_rebalances\": %ld,\n"
+         "  \"ci_metric\": \"%s\",\n"
+         "  \"ci_z\": %.4lf,\n"
+         "  \"ci_target_width\": %.10lf,\n"
+         "  \"ci_width\": %.10lf,\n"
+         "  \"stopped_early\": %s,\n"
+         "  \"variants\": [\n",
+         num_stocks, flips, bh_g_stats.count(), num_trials,
+         paired ? "true" : "false", bh_g_stats.mean(),
+         bh_g_stats.sample_variance(), bh_val_stats.mean(),
+         bh_val_stats.sample_variance(), wave.g_stats.mean(),
+         wave.g_stats.sample_variance(), wave.val_stats.mean(),
+         wave.val_stats.sample_variance(), wave.rebalances,
+         rule.use_g ? "g" : "value", rule.z, rule.ci_width, ci_width(wave),
+         stop.load() ? "true" : "false");
+  for (size_t k = 0; k < thresholds.size(); k++) {
+    VariantStats &variant = variants[k];
+    printf("    {\n"
+           "      \"threshold\": %.6lf,\n"
+           "      \"wave_g\": %.10lf,\n"
+           "      \"wave_val\": %.10lf,\n"
+           "      \"g_diff\": %.10lf,\n"
+           "      \"g_diff_stddev\": %.10lf,\n"
+           "      \"val_diff\": %.10lf,\n"
+           "      \"val_diff_stddev\": %.10lf,\n"
+           "      \"ci_width\": %.10lf,\n"
+           "      \"wave_num_rebalances\": %ld,\n"
+           "    },\n",
+           thresholds[k], variant.g_stats.mean(), variant.val_stats.mean(),
+           variant.g_diff_stats.mean(), variant.g_diff_stats.sample_variance(),
+           variant.val_diff_stats.mean(),
+           variant.val_diff_stats.sample_variance(), ci_width(variant),
+           variant.rebalances);
+  }
+  printf("  ],\n"
+         "}\n");
+}
+
+// Runs the two-stock experiment with FirstPassageFlipper. Both strategies
+// share each trial's path, so the stopping rule uses the paired difference.
+void run_first_passage_experiment(int flips, int num_trials, double threshold,
+                                  double gbm_mu, double gbm_dt,
+                                  double gbm_sigma,
+                                  StoppingRule rule = StoppingRule()) {
+  static constexpr int kTrialsPerLock = 64;
+  const auto num_cpus = std::thread::hardware_concurrency();
+  const uint64_t seed =
+      std::chrono::high_resolution_clock().now().time_since_epoch().count();
+
+  std::atomic<int> next_trial = 0;
+  std::atomic<bool> stop = false;
+  std::mutex mu;
+  WelfordRunningStatistics bh_g_stats;
+  WelfordRunningStatistics bh_val_stats;
+  VariantStats wave;
+
+  auto ci_width = [&]() {
+    return paired_ci_width(rule.use_g ? wave.g_diff_stats : wave.val_diff_stats,
+                           rule.z);
+  };
+
+  std::thread threads[num_cpus];
+  for (size_t i = 0; i < num_cpus; i++) {
+    threads[i] = std::thread(
+        [&](int i) {
+          for (uint64_t trial_seed = seed + i;;) {
+            if (stop.load(std::memory_order_relaxed)) {
+              break;
+            }
+            const int first = next_trial.fetch_add(kTrialsPerLock);
+            if (first >= num_trials) {
+              break;
+            }
+            const int trials = std::min(kTrialsPerLock, num_trials - first);
+
+            WelfordRunningStatistics local_bh_g_stats;
+            WelfordRunningStatistics local_bh_val_stats;
+            VariantStats local_wave;
+            for (int t = 0; t < trials; t++, trial_seed += num_cpus) {
+              FirstPassageFlipper flipper(
+                  /*threshold=*/threshold, /*gbm_mu=*/gbm_mu,
+                  /*gbm_dt=*/gbm_dt, /*gbm_sigma=*/gbm_sigma,
+                  /*seed=*/trial_seed);
+              flipper.simulate(flips);
+
+              local_bh_g_stats.update(flipper.bh_g());
+              local_bh_val_stats.update(flipper.bh_value());
+              local_wave.g_stats.update(flipper.wave_g());
+              local_wave.val_stats.update(flipper.wave_value());
+              local_wave.g_diff_stats.update(flipper.wave_g() -
+                                             flipper.bh_g());
+              local_wave.val_diff_stats.update(flipper.wave_value() -
+                                               flipper.bh_value());
+              local_wave.rebalances += flipper.wave_rebalances();
+            }
+
+            std::scoped_lock<std::mutex> lock(mu);
+            bh_g_stats.merge(local_bh_g_stats);
+            bh_val_stats.merge(local_bh_val_stats);
+            wave.merge(local_wave);
+
+            if (rule.ci_width > 0.0 && bh_g_stats.count() >= rule.min_trials &&
+                ci_width() <= rule.ci_width) {
+              stop.store(true, std::memory_order_relaxed);
+            }
+
+            printf("trials: %ld/%d\r", bh_g_stats.count(), num_trials);
+            fflush(stdout);
+          }
+        },
+        i);
+  }
+
+  for (size_t i = 0; i < num_cpus; i++) {
+    threads[i].join();
+  }
+
+  printf("\n{\n"
+         "  \"stocks\": 2,\n"
+         "  \"flips_per_trial\": %d,\n"
+         "  \"trials\": %ld,\n"
+         "  \"max_trials\": %d,\n"
+         "  \"threshold\": %.6lf,\n"
+         "  \"bh_g\": %.10lf,\n"
+         "  \"bh_g_stddev\": %.10lf,\n"
+         "  \"bh_val\": %.10lf,\n"
+         "  \"bh_stddev\": %.10lf,\n"
+         "  \"wave_g\": %.10lf,\n"
+         "  \"wave_g_stddev\": %.10lf,\n"
+         "  \"wave_val\": %.10lf,\n"
+         "  \"wave_stddev\": %.10lf,\n"
+         "  \"wave_num_rebalances\": %ld,\n"
+         "  \"g_diff\": %.10lf,\n"
+         "  \"val_diff\": %.10lf,\n"
+         "  \"ci_metric\": \"%s\",\n"
+         "  \"ci_width\": %.10lf,\n"
+         "  \"stopped_early\": %s,\n"
+         "}\n",
+         flips, bh_g_stats.count(), num_trials, threshold, bh_g_stats.mean(),
+         bh_g_stats.sample_variance(), bh_val_stats.mean(),
+         bh_val_stats.sample_variance(), wave.g_stats.mean(),
+         wave.g_stats.sample_variance(), wave.val_stats.mean(),
+         wave.val_stats.sample_variance(), wave.rebalances,
+         wave.g_diff_stats.mean(), wave.val_diff_stats.mean(),
+         rule.use_g ? "g" : "value", ci_width(),
+         stop.load() ? "true" : "false");
+}
+
 int main() {
   srand(time(NULL));
   setbuf(stdout, NULL);
@@ -288,6 +928,21 @@ int main() {
   static constexpr double sigma = 1.0 / 20;
   static constexpr double dt = 1.0 / 252;
 
-  run_experiment(/*num_stocks=*/2, /*flips=*/100000, /*num_trials=*/1000,
-                 /*gbm_mu=*/0.0, /*gbm_dt=*/dt, /*gbm_sigma=*/sigma);
+  if (false) {
+    // Only does work at rebalances, so it suits wide thresholds.
+    run_first_passage_experiment(/*flips=*/100000, /*num_trials=*/1000,
+                                 /*threshold=*/1.001, /*gbm_mu=*/0.0,
+                                 /*gbm_dt=*/dt, /*gbm_sigma=*/sigma);
+  } else if (true) {
+    // Set ci_width to stop as soon as the difference is resolved.
+    StoppingRule rule;
+    rule.ci_width = 0.0;
+    run_batched_experiment(/*num_stocks=*/2, /*flips=*/100000,
+                           /*num_trials=*/1000, /*gbm_dt=*/dt,
+                           /*gbm_sigma=*/sigma, /*rule=*/rule,
+                           /*paired=*/false, /*thresholds=*/{1.001});
+  } else {
+    run_experiment(/*num_stocks=*/2, /*flips=*/100000, /*num_trials=*/1000,
+                   /*gbm_mu=*/0.0, /*gbm_dt=*/dt, /*gbm_sigma=*/sigma);
+  }
 }
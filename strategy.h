@@ -9,8 +9,18 @@ using std::string;
 
 class Strategy {
 public:
-  Strategy(double cash, std::vector<string> symbols)
-      : rebalance_cash_(symbols.size() * 0.01), folio_(cash, symbols) {}
+  // The type of the prices given to price_event(). See fixed_point.h.
+  typedef double Price;
+
+  // The fill listener, if any, is attached before anything is bought, so it
+  // hears about the opening fills too.
+  Strategy(double cash, std::vector<SymbolId> symbol_ids,
+           FillListener *fill_listener = nullptr)
+      : rebalance_cash_(symbol_ids.size() * 0.01), folio_(cash, symbol_ids) {
+    folio_.set_fill_listener(fill_listener);
+  }
+
+  static Price from_feed_price(double price) { return price; }
 
   string to_string(const std::vector<double> &prices, int indent = 0) const {
     string top_indent = "";
@@ -37,8 +47,20 @@ public:
 
   virtual bool price_event(const std::vector<double> &prices) = 0;
 
+  // Returns true if price_event() can't trade as long as every price stays
+  // between low and high, inclusive. The prices of the last price event must
+  // be inside the range too.
+  virtual bool idle_within(const std::vector<double> &low,
+                           const std::vector<double> &high) const {
+    return false;
+  }
+
   const Portfolio &portfolio() const { return folio_; }
 
+  void set_fill_listener(FillListener *listener) {
+    folio_.set_fill_listener(listener);
+  }
+
   void rebalance(const std::vector<double> &prices) {
     // This mostly ignores fees. However, the difference between the
     // positions should diminish as the portfolio continually rebalances.
@@ -68,12 +90,12 @@ public:
     num_rebalances_++;
   }
 
-  void pay_dividend(string symbol, double per_share) {
+  void pay_dividend(SymbolId symbol, double per_share) {
     folio_.pay_dividend(portfolio().index(symbol), per_share);
     num_dividends_ += 1;
   }
 
-  void stock_split(string symbol, double ratio) {
+  void stock_split(SymbolId symbol, double ratio) {
     folio_.stock_split(portfolio().index(symbol), ratio);
     num_splits_ += 1;
   }
@@ -88,9 +110,10 @@ protected:
 
 class BuyAndHold : public Strategy {
 public:
-  BuyAndHold(double cash, std::vector<string> symbols,
-             const std::vector<double> &prices)
-      : Strategy(cash, std::move(symbols)) {
+  BuyAndHold(double cash, std::vector<SymbolId> symbol_ids,
+             const std::vector<double> &prices,
+             FillListener *fill_listener = nullptr)
+      : Strategy(cash, std::move(symbol_ids), fill_listener) {
     rebalance(prices);
   }
 
@@ -107,13 +130,19 @@ public:
     }
     return true;
   }
+
+  bool idle_within(const std::vector<double> &low,
+                   const std::vector<double> &high) const override {
+    return portfolio().cash() < rebalance_cash_;
+  }
 };
 
 class WaveArbitrage : public Strategy {
 public:
-  WaveArbitrage(double cash, std::vector<string> symbols,
-                const std::vector<double> &prices, double rebalance_threshold)
-      : Strategy(cash, std::move(symbols)),
+  WaveArbitrage(double cash, std::vector<SymbolId> symbol_ids,
+                const std::vector<double> &prices, double rebalance_threshold,
+                FillListener *fill_listener = nullptr)
+      : Strategy(cash, std::move(symbol_ids), fill_listener),
         rebalance_threshold_(rebalance_threshold) {
     rebalance_down_.resize(2);
     rebalance_up_.resize(2);
@@ -166,6 +195,39 @@ public:
     return do_rebalance;;
   }
 
+  bool idle_within(const std::vector<double> &low,
+                   const std::vector<double> &high) const override {
+    if (portfolio().cash() > rebalance_cash_) {
+      return false;
+    }
+
+    // The thresholds from the last price event.
+    for (size_t i = 0; i < low.size(); i++) {
+      if (low[i] < rebalance_down_[i] || high[i] > rebalance_up_[i]) {
+        return false;
+      }
+    }
+
+    // The thresholds that any later price event inside the range could set.
+    // These are computed the same way as in price_event() so that rounding
+    // can't make them disagree.
+    const double low_total =
+        portfolio().shares(0) * low[0] + portfolio().shares(1) * low[1];
+    const double high_total =
+        portfolio().shares(0) * high[0] + portfolio().shares(1) * high[1];
+    for (size_t i = 0; i < low.size(); i++) {
+      if (low[i] < (high_total / 2.0) / rebalance_threshold_ /
+                           portfolio().shares(i) -
+                       0.01 ||
+          high[i] > (low_total / 2.0) * rebalance_threshold_ /
+                            portfolio().shares(i) +
+                        0.01) {
+        return false;
+      }
+    }
+    return true;
+  }
+
 protected:
   const double rebalance_threshold_;
 
@@ -3,9 +3,12 @@
 #include "gtest/gtest.h"
 #include "strategy.h"
 
+const SymbolId kFoo = SymbolTable::intern("FOO");
+const SymbolId kBar = SymbolTable::intern("BAR");
+
 TEST(StrategyTest, BuyAndHold) {
   std::vector<double> prices = {10.0, 5.0};
-  BuyAndHold bh(1000, {"FOO", "BAR"}, prices);
+  BuyAndHold bh(1000, {kFoo, kBar}, prices);
   EXPECT_EQ(bh.portfolio().value(prices), 1000);
   EXPECT_EQ(bh.portfolio().shares(0), 50);
   EXPECT_EQ(bh.portfolio().shares(1), 100);
@@ -14,21 +17,21 @@ TEST(StrategyTest, BuyAndHold) {
 }
 
 TEST(StrategyTest, WaveArbitrage) {
-  WaveArbitrage wave(1000, {"FOO", "BAR"}, {10.0, 5.0}, 1.0);
+  WaveArbitrage wave(1000, {kFoo, kBar}, {10.0, 5.0}, 1.0);
   EXPECT_TRUE(wave.price_event({5.0, 10.0}));
 }
 
 TEST(StrategyTest, Dividend) {
   std::vector<double> prices = {10.0, 5.0};
-  BuyAndHold bh(1000, {"FOO", "BAR"}, prices);
-  bh.pay_dividend("FOO", 0.01);
+  BuyAndHold bh(1000, {kFoo, kBar}, prices);
+  bh.pay_dividend(kFoo, 0.01);
   EXPECT_EQ(bh.portfolio().cash(), 0.5);
 }
 
 TEST(StrategyTest, Split) {
   std::vector<double> prices = {10.0, 5.0};
-  BuyAndHold bh(1000, {"FOO", "BAR"}, prices);
-  bh.stock_split("FOO", 2.0);
+  BuyAndHold bh(1000, {kFoo, kBar}, prices);
+  bh.stock_split(kFoo, 2.0);
   EXPECT_EQ(bh.portfolio().shares(0), 100);
 }
 
@@ -0,0 +1,122 @@
+#ifndef WAVE_ARBITRAGE_SWEEP_H
+#define WAVE_ARBITRAGE_SWEEP_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "feed.h"
+#include "fixed_point.h"
+#include "job.h"
+#include "journal.h"
+#include "range_index.h"
+#include "shared_segment.h"
+#include "strategy.h"
+#include "symbols.h"
+#include "trace.h"
+#include "util.h"
+
+// Called by the worker that finished the pair (i, j), with the number of
+// pairs that were finished before it.
+typedef std::function<void(int completed, size_t i, size_t j)> PairCallback;
+
+// The default sweep of backtest. Runs every pair of the symbols with one
+// worker thread per CPU, which take the pairs in order off a shared queue.
+// The pairs are replayed from the segment if there is one, and from the day
+// files otherwise. Returns the delta return of each pair.
+inline PairMatrix<double>
+pair_sweep(const std::vector<string> &symbols,
+           const SharedTradeSegment *segment, bool skip_idle_ranges,
+           bool fixed_point, double cash, double rebalance_threshold,
+           WelfordRunningStatistics *bh_stats,
+           WelfordRunningStatistics *wave_stats, DynamicHistogram *bh_hist,
+           DynamicHistogram *wave_hist, JournalWriter *journal_writer,
+           const std::vector<IntervalHorizon> &bh_horizons,
+           const std::vector<IntervalHorizon> &wave_horizons,
+           PairCallback on_pair = nullptr) {
+  const auto num_cpus = std::thread::hardware_concurrency();
+  std::vector<std::thread> threads(num_cpus);
+  std::atomic<int> jobs_completed = 0;
+
+  std::mutex indeces_mu;
+  size_t first_stock_idx = 0;
+  size_t second_stock_idx = first_stock_idx;
+  bool is_running = true;
+  auto get_next = [&]() -> std::tuple<size_t, size_t, bool> {
+    TracedLock<std::mutex> lock(indeces_mu, "wait for indeces_mu");
+
+    if (second_stock_idx + 1 >= symbols.size()) {
+      first_stock_idx += 1;
+      second_stock_idx = first_stock_idx + 1;
+
+      if (second_stock_idx >= symbols.size()) {
+        is_running = false;
+      }
+    } else {
+      second_stock_idx += 1;
+    }
+    return std::make_tuple(first_stock_idx, second_stock_idx, is_running);
+  };
+
+  // Indexed by the pair's positions in symbols. Each pair is written by a
+  // single worker, so there's nothing to lock.
+  PairMatrix<double> pair_deltas(symbols.size());
+
+  for (unsigned tx = 0; tx < num_cpus; tx++) {
+    threads[tx] = std::thread([&, tx]() {
+      Tracer::set_thread_name("worker " + std::to_string(tx));
+      while (true) {
+        auto idxs = get_next();
+        if (!std::get<2>(idxs)) {
+          return;
+        }
+        size_t i = std::get<0>(idxs);
+        size_t j = std::get<1>(idxs);
+
+        std::unique_ptr<Feed> feed;
+        if (segment) {
+          feed = std::make_unique<SharedIEXFeed>(
+              /*symbols=*/std::vector<string>{symbols[i], symbols[j]},
+              /*segment=*/segment);
+        } else {
+          feed = std::make_unique<IEXFeed>(
+              /*symbols=*/std::vector<string>{symbols[i], symbols[j]});
+        }
+        if (skip_idle_ranges) {
+          feed = std::make_unique<RangeSkipFeed>(
+              std::move(feed), /*sample_interval_seconds=*/60);
+        }
+        auto run_job = fixed_point ? job<FixedBuyAndHold, FixedWaveArbitrage>
+                                   : job<BuyAndHold, WaveArbitrage>;
+        auto returns = run_job(/*feed=*/std::move(feed), /*cash=*/cash,
+                               /*rebalance_threshold=*/rebalance_threshold,
+                               /*bh_stats=*/bh_stats,
+                               /*wave_stats=*/wave_stats,
+                               /*bh_hist=*/bh_hist, /*wave_hist=*/wave_hist,
+                               /*journal_writer=*/journal_writer,
+                               /*bh_horizons=*/bh_horizons,
+                               /*wave_horizons=*/wave_horizons);
+
+        pair_deltas.at(i, j) =
+            (std::get<0>(returns) - std::get<1>(returns)) / cash;
+
+        int completed = jobs_completed.fetch_add(1, std::memory_order_acq_rel);
+        if (on_pair) {
+          on_pair(completed, i, j);
+        }
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return pair_deltas;
+}
+
+#endif // WAVE_ARBITRAGE_SWEEP_H
@@ -0,0 +1,100 @@
+#ifndef WAVE_ARBITRAGE_SYMBOLS_H
+#define WAVE_ARBITRAGE_SYMBOLS_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+using std::string;
+
+typedef uint32_t SymbolId;
+
+// Hands out a dense id, counting up from 0, for every symbol name the process
+// sees. Feeds, portfolios and strategies refer to symbols by id, and names
+// are only looked up again for output.
+class SymbolTable {
+public:
+  static SymbolId intern(const string &name) {
+    std::scoped_lock<std::mutex> lock(mu());
+    auto found = ids().find(name);
+    if (found != ids().end()) {
+      return found->second;
+    }
+    const SymbolId id = names().size();
+    names().push_back(name);
+    ids().emplace(name, id);
+    return id;
+  }
+
+  static std::vector<SymbolId> intern_all(const std::vector<string> &names) {
+    std::vector<SymbolId> symbol_ids;
+    for (const auto &name : names) {
+      symbol_ids.push_back(intern(name));
+    }
+    return symbol_ids;
+  }
+
+  // Names stay put once interned, so the reference stays valid.
+  static const string &name(SymbolId id) {
+    std::scoped_lock<std::mutex> lock(mu());
+    CHECK_LT(id, names().size());
+    return names()[id];
+  }
+
+  static size_t size() {
+    std::scoped_lock<std::mutex> lock(mu());
+    return names().size();
+  }
+
+private:
+  static std::mutex &mu() {
+    static std::mutex mu;
+    return mu;
+  }
+
+  static std::deque<string> &names() {
+    static std::deque<string> names;
+    return names;
+  }
+
+  static std::unordered_map<string, SymbolId> &ids() {
+    static std::unordered_map<string, SymbolId> ids;
+    return ids;
+  }
+};
+
+// One value for every unordered pair of n items, stored densely. The pair
+// (i, j) and the pair (j, i) are the same entry, and i can't equal j.
+template <typename T> class PairMatrix {
+public:
+  PairMatrix(size_t n, const T &initial = T())
+      : n_(n), values_(n < 2 ? 0 : n * (n - 1) / 2, initial) {}
+
+  size_t n() const { return n_; }
+
+  T &at(size_t i, size_t j) { return values_[offset(i, j)]; }
+
+  const T &at(size_t i, size_t j) const { return values_[offset(i, j)]; }
+
+private:
+  size_t offset(size_t i, size_t j) const {
+    if (i > j) {
+      std::swap(i, j);
+    }
+    DCHECK_LT(i, j);
+    DCHECK_LT(j, n_);
+    // Rows 0 through i - 1 hold n - 1, n - 2, ..., n - i entries.
+    return i * (2 * n_ - i - 1) / 2 + (j - i - 1);
+  }
+
+  const size_t n_;
+  std::vector<T> values_;
+};
+
+#endif // WAVE_ARBITRAGE_SYMBOLS_H
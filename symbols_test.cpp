@@ -0,0 +1,81 @@
+#include <set>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "symbols.h"
+
+TEST(SymbolsTest, Intern) {
+  const SymbolId foo = SymbolTable::intern("FOO");
+  const SymbolId bar = SymbolTable::intern("BAR");
+  EXPECT_NE(foo, bar);
+  EXPECT_EQ(SymbolTable::intern("FOO"), foo);
+  EXPECT_EQ(SymbolTable::name(foo), "FOO");
+  EXPECT_EQ(SymbolTable::name(bar), "BAR");
+  EXPECT_EQ(SymbolTable::intern_all({"BAR", "FOO"}),
+            (std::vector<SymbolId>{bar, foo}));
+  EXPECT_LT(foo, SymbolTable::size());
+  EXPECT_LT(bar, SymbolTable::size());
+}
+
+TEST(SymbolsTest, ConcurrentIntern) {
+  // Every thread interns the same names in a different order, and they all
+  // have to agree on the ids, which have to be dense.
+  const size_t first_size = SymbolTable::size();
+  static constexpr int kNumThreads = 4;
+  static constexpr int kNumNames = 500;
+  std::vector<std::vector<SymbolId>> ids(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int tx = 0; tx < kNumThreads; tx++) {
+    threads.push_back(std::thread([tx, &ids]() {
+      ids[tx].resize(kNumNames);
+      for (int n = 0; n < kNumNames; n++) {
+        const int name = tx % 2 ? n : kNumNames - 1 - n;
+        ids[tx][name] =
+            SymbolTable::intern("CONCURRENT" + std::to_string(name));
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (int tx = 1; tx < kNumThreads; tx++) {
+    EXPECT_EQ(ids[tx], ids[0]);
+  }
+  const std::set<SymbolId> unique(ids[0].begin(), ids[0].end());
+  EXPECT_EQ(unique.size(), kNumNames);
+  EXPECT_EQ(SymbolTable::size(), first_size + kNumNames);
+  EXPECT_EQ(*unique.begin(), first_size);
+  EXPECT_EQ(SymbolTable::name(ids[0][7]), "CONCURRENT7");
+}
+
+TEST(SymbolsTest, PairMatrix) {
+  static constexpr size_t kNumItems = 7;
+  PairMatrix<int> matrix(kNumItems, /*initial=*/-1);
+  EXPECT_EQ(matrix.n(), kNumItems);
+  for (size_t i = 0; i < kNumItems; i++) {
+    for (size_t j = i + 1; j < kNumItems; j++) {
+      EXPECT_EQ(matrix.at(i, j), -1);
+      matrix.at(i, j) = 100 * i + j;
+    }
+  }
+  // Every pair has its own entry, in either order.
+  for (size_t i = 0; i < kNumItems; i++) {
+    for (size_t j = i + 1; j < kNumItems; j++) {
+      EXPECT_EQ(matrix.at(i, j), 100 * i + j);
+      EXPECT_EQ(matrix.at(j, i), 100 * i + j);
+    }
+  }
+
+  PairMatrix<int> empty(1);
+  EXPECT_EQ(empty.n(), 1);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
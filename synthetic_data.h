@@ -0,0 +1,157 @@
+#ifndef WAVE_ARBITRAGE_SYNTHETIC_DATA_H
+#define WAVE_ARBITRAGE_SYNTHETIC_DATA_H
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "market_data.pb.h"
+
+using std::string;
+
+// Describes a made-up market for write_synthetic_iex().
+struct SyntheticIEXConfig {
+  int num_symbols = 20;
+  // Trading days, starting on start_date and skipping weekends.
+  int num_days = 20;
+  // Midnight UTC of the first day.
+  int64_t start_date = 1514851200; // 2018-01-02
+  // The average number of trades per symbol per day. Each symbol is busier or
+  // quieter than this by a random factor.
+  double trades_per_day = 2000.0;
+  // Quote updates per trade. The feed skips them, but they make up most of a
+  // real day file.
+  double quotes_per_trade = 3.0;
+  // The daily volatility of the log price.
+  double daily_sigma = 0.02;
+  // The chance that a symbol goes ex-dividend on any given day, and that it
+  // splits 2-for-1.
+  double dividend_probability = 0.02;
+  double split_probability = 0.002;
+  uint64_t seed = 1;
+};
+
+// Writes root/processed/<SYMBOL>_<YYYYMMDD> day files and root/dividends/
+// <SYMBOL>.csv files laid out like the ones the scraper produces. Prices
+// follow a random walk at trade times inside the 9:30 to 16:00 session, and
+// drop by half on the day of a split. The same config always gives the same
+// files. Returns the symbols.
+inline std::vector<string> write_synthetic_iex(
+    const string &root, const SyntheticIEXConfig &config) {
+  static constexpr int64_t kDay = 24 * 60 * 60;
+  static constexpr int64_t kOpen = (14 * 60 + 30) * 60;
+  static constexpr int64_t kClose = 21 * 60 * 60;
+
+  std::filesystem::create_directories(root + "/processed");
+  std::filesystem::create_directories(root + "/dividends");
+
+  std::vector<int64_t> days;
+  for (int64_t date = config.start_date;
+       static_cast<int>(days.size()) < config.num_days; date += kDay) {
+    // 1970-01-01 was a Thursday.
+    const int64_t weekday = (date / kDay + 4) % 7;
+    if (weekday != 0 && weekday != 6) {
+      days.push_back(date);
+    }
+  }
+
+  auto date_string = [](int64_t date, bool dashes) {
+    const time_t t = date;
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[16];
+    strftime(buf, sizeof(buf), dashes ? "%Y-%m-%d" : "%Y%m%d", &tm);
+    return string(buf);
+  };
+
+  std::vector<string> symbols;
+  for (int s = 0; s < config.num_symbols; s++) {
+    // SYAA, SYAB, ..., which don't clash with real tickers.
+    string symbol = "SY";
+    symbol += static_cast<char>('A' + s / 26 % 26);
+    symbol += static_cast<char>('A' + s % 26);
+    if (s >= 26 * 26) {
+      symbol += std::to_string(s / (26 * 26));
+    }
+    symbols.push_back(symbol);
+
+    std::mt19937_64 generator(config.seed * 1000003 + s);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    double log_price = std::log(20.0 + 180.0 * uniform(generator));
+    const double activity = std::exp(0.5 * normal(generator));
+    const double trades_per_day = config.trades_per_day * activity;
+
+    std::ofstream csv(root + "/dividends/" + symbol + ".csv");
+    for (const int64_t date : days) {
+      if (uniform(generator) < config.split_probability) {
+        log_price -= std::log(2.0);
+        csv << date_string(date, true) << ",SPLIT,0.5\n";
+      }
+      if (uniform(generator) < config.dividend_probability) {
+        const double per_share = std::round(std::exp(log_price) * 0.5) / 100;
+        csv << date_string(date, true) << ",DIVIDEND," << per_share << "\n";
+      }
+
+      std::poisson_distribution<int> num_trades_dist(trades_per_day);
+      const int num_trades = num_trades_dist(generator);
+      std::vector<int64_t> trade_nanos;
+      for (int t = 0; t < num_trades; t++) {
+        trade_nanos.push_back((kOpen + uniform(generator) * (kClose - kOpen)) *
+                              1e9);
+      }
+      std::sort(trade_nanos.begin(), trade_nanos.end());
+
+      market_data::Events events;
+      auto *directory = events.add_events()->mutable_security_directory();
+      directory->set_symbol(symbol);
+      directory->mutable_timestamp()->set_seconds(date + kOpen - 3600);
+      directory->set_round_lot(100);
+
+      // Spreads the day's variance over its trades.
+      const double step_sigma =
+          config.daily_sigma / std::sqrt(std::max(1, num_trades));
+      std::poisson_distribution<int> num_quotes_dist(config.quotes_per_trade);
+      for (const int64_t nanos : trade_nanos) {
+        log_price += step_sigma * normal(generator);
+        // Whole cents, in ten-thousandths of a dollar.
+        const int32_t price = std::llround(std::exp(log_price) * 100) * 100;
+
+        google::protobuf::Timestamp timestamp;
+        timestamp.set_seconds(date + nanos / 1000000000);
+        timestamp.set_nanos(nanos % 1000000000);
+        for (int q = num_quotes_dist(generator); q > 0; q--) {
+          auto *quote = events.add_events()->mutable_quote_update();
+          quote->set_symbol(symbol);
+          *quote->mutable_timestamp() = timestamp;
+          quote->set_bid_size(100);
+          quote->set_bid_price(price - 100);
+          quote->set_ask_size(100);
+          quote->set_ask_price(price + 100);
+        }
+
+        auto *trade = events.add_events()->mutable_trade();
+        trade->set_symbol(symbol);
+        *trade->mutable_timestamp() = timestamp;
+        trade->set_shares(100);
+        trade->set_price(price);
+      }
+
+      std::ofstream out(root + "/processed/" + symbol + "_" +
+                            date_string(date, false),
+                        std::ios::out | std::ios::binary);
+      CHECK(events.SerializeToOstream(&out)) << symbol;
+    }
+  }
+  return symbols;
+}
+
+#endif // WAVE_ARBITRAGE_SYNTHETIC_DATA_H
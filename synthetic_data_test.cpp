@@ -0,0 +1,118 @@
+#include <filesystem>
+#include <fstream>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+#include "gtest/gtest.h"
+#include "synthetic_data.h"
+
+string read_file(const string &filename) {
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  return string{std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>()};
+}
+
+SyntheticIEXConfig small_config() {
+  SyntheticIEXConfig config;
+  config.num_symbols = 3;
+  config.num_days = 6;
+  config.trades_per_day = 50.0;
+  config.dividend_probability = 0.3;
+  config.split_probability = 0.3;
+  return config;
+}
+
+TEST(SyntheticDataTest, Layout) {
+  const string root = ::testing::TempDir() + "/synthetic_layout";
+  std::filesystem::remove_all(root);
+  const auto symbols = write_synthetic_iex(root, small_config());
+  EXPECT_EQ(symbols, (std::vector<string>{"SYAA", "SYAB", "SYAC"}));
+
+  // 2018-01-02 was a Tuesday, so the weekend is skipped.
+  for (const string day : {"20180102", "20180105", "20180108", "20180109"}) {
+    EXPECT_TRUE(std::filesystem::exists(root + "/processed/SYAB_" + day))
+        << day;
+  }
+  EXPECT_FALSE(std::filesystem::exists(root + "/processed/SYAB_20180106"));
+
+  market_data::Events events;
+  ASSERT_TRUE(events.ParseFromString(
+      read_file(root + "/processed/SYAA_20180103")));
+  ASSERT_GT(events.events_size(), 1);
+  EXPECT_EQ(events.events(0).security_directory().symbol(), "SYAA");
+  int64_t last_nanos = 0;
+  for (const auto &event : events.events()) {
+    if (event.has_trade()) {
+      const auto &ts = event.trade().timestamp();
+      const int64_t nanos = ts.seconds() * 1000000000 + ts.nanos();
+      EXPECT_GE(nanos, last_nanos);
+      last_nanos = nanos;
+      EXPECT_EQ(event.trade().price() % 100, 0);
+    }
+  }
+
+  // Every line parses the way load_price_actions() expects.
+  for (const string &symbol : symbols) {
+    std::ifstream csv(root + "/dividends/" + symbol + ".csv");
+    string line;
+    while (std::getline(csv, line)) {
+      EXPECT_EQ(line.substr(4, 1), "-") << line;
+      EXPECT_TRUE(line.find(",SPLIT,0.5") != string::npos ||
+                  line.find(",DIVIDEND,") != string::npos)
+          << line;
+    }
+  }
+}
+
+TEST(SyntheticDataTest, Deterministic) {
+  const string first = ::testing::TempDir() + "/synthetic_first";
+  const string second = ::testing::TempDir() + "/synthetic_second";
+  std::filesystem::remove_all(first);
+  std::filesystem::remove_all(second);
+  write_synthetic_iex(first, small_config());
+  write_synthetic_iex(second, small_config());
+  for (const string file :
+       {"/processed/SYAC_20180109", "/dividends/SYAC.csv"}) {
+    EXPECT_EQ(read_file(first + file), read_file(second + file)) << file;
+  }
+
+  SyntheticIEXConfig config = small_config();
+  config.seed = 2;
+  const string third = ::testing::TempDir() + "/synthetic_third";
+  std::filesystem::remove_all(third);
+  write_synthetic_iex(third, config);
+  EXPECT_NE(read_file(first + "/processed/SYAC_20180109"),
+            read_file(third + "/processed/SYAC_20180109"));
+}
+
+TEST(SyntheticDataTest, Feed) {
+  const string root = ::testing::TempDir() + "/synthetic_feed";
+  std::filesystem::remove_all(root);
+  write_synthetic_iex(root, small_config());
+  set_iex_data_root(root);
+  EXPECT_EQ(get_available_symbols(),
+            (std::vector<string>{"SYAA", "SYAB", "SYAC"}));
+
+  IEXFeed feed({"SYAA", "SYAB"});
+  std::vector<Tick> batch(64);
+  size_t ticks = 0;
+  int64_t last_nanos = 0;
+  size_t n;
+  while ((n = feed.next_batch(batch.data(), batch.size())) > 0) {
+    for (size_t t = 0; t < n; t++) {
+      const int64_t nanos = batch[t].seconds * 1000000000 + batch[t].nanos;
+      EXPECT_GE(nanos, last_nanos);
+      last_nanos = nanos;
+    }
+    ticks += n;
+  }
+  EXPECT_GT(ticks, 2 * 6 * 10);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,42 @@
+#ifndef WAVE_ARBITRAGE_SYNTHETIC_DATA_TESTING_H
+#define WAVE_ARBITRAGE_SYNTHETIC_DATA_TESTING_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "feed.h"
+#include "gtest/gtest.h"
+#include "synthetic_data.h"
+
+using std::string;
+
+// Helpers for tests that replay synthetic IEX data.
+
+// Where write_test_data() puts the data for root_name.
+inline string test_data_root(const string &root_name) {
+  return ::testing::TempDir() + "/" + root_name;
+}
+
+// Writes synthetic data to test_data_root(root_name), replacing whatever an
+// earlier run left there, and points the feeds at it. Returns the symbols.
+inline std::vector<string> write_test_data(const string &root_name,
+                                           const SyntheticIEXConfig &config) {
+  const string root = test_data_root(root_name);
+  std::filesystem::remove_all(root);
+  const auto symbols = write_synthetic_iex(root, config);
+  set_iex_data_root(root);
+  return symbols;
+}
+
+// Returns every tick the feed hands out, batch_size at a time.
+inline std::vector<Tick> all_ticks(Feed *feed, size_t batch_size = 4096) {
+  std::vector<Tick> ticks;
+  std::vector<Tick> batch(batch_size);
+  while (const size_t n = feed->next_batch(batch.data(), batch.size())) {
+    ticks.insert(ticks.end(), batch.begin(), batch.begin() + n);
+  }
+  return ticks;
+}
+
+#endif // WAVE_ARBITRAGE_SYNTHETIC_DATA_TESTING_H
@@ -0,0 +1,227 @@
+#ifndef WAVE_ARBITRAGE_TRACE_H
+#define WAVE_ARBITRAGE_TRACE_H
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+using std::string;
+
+// Records timed spans from any thread and writes them out in the Chrome trace
+// event format, which chrome://tracing and ui.perfetto.dev can open. Tracing
+// is off until enable() is called, and until then a span costs one relaxed
+// load.
+//
+// Each thread appends to its own buffer, a list of fixed-size chunks that is
+// only ever written by that thread, so recording never takes a lock. Span
+// names must be string literals, since only the pointer is kept.
+class Tracer {
+public:
+  static void enable() {
+    epoch();
+    enabled_flag().store(true, std::memory_order_relaxed);
+  }
+
+  static void disable() {
+    enabled_flag().store(false, std::memory_order_relaxed);
+  }
+
+  static bool enabled() {
+    return enabled_flag().load(std::memory_order_relaxed);
+  }
+
+  // Nanoseconds since tracing was first enabled.
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch())
+        .count();
+  }
+
+  static void record(const char *name, int64_t start, int64_t end) {
+    thread_buffer()->append(Event{name, start, end});
+  }
+
+  // Names the calling thread in the trace.
+  static void set_thread_name(const string &name) {
+    if (enabled()) {
+      thread_buffer()->name = name;
+    }
+  }
+
+  // Writes every span recorded so far. Spans that are being recorded while
+  // this runs may or may not be included.
+  static void write(const string &filename) {
+    std::ofstream out(filename, std::ios::out | std::ios::trunc);
+    CHECK(out.good()) << filename;
+    const int pid = getpid();
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto separate = [&]() {
+      if (!first) {
+        out << ",\n";
+      }
+      first = false;
+    };
+
+    std::scoped_lock<std::mutex> lock(registry_mu());
+    for (const auto &buffer : registry()) {
+      if (!buffer->name.empty()) {
+        separate();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+            << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":\""
+            << buffer->name << "\"}}";
+      }
+      for (const Chunk *chunk = &buffer->head; chunk;
+           chunk = chunk->next.load(std::memory_order_acquire)) {
+        const size_t size = chunk->size.load(std::memory_order_acquire);
+        for (size_t e = 0; e < size; e++) {
+          const Event &event = chunk->events[e];
+          separate();
+          // Trace event times are in microseconds.
+          out << "{\"name\":\"" << event.name
+              << "\",\"ph\":\"X\",\"pid\":" << pid
+              << ",\"tid\":" << buffer->tid
+              << ",\"ts\":" << event.start / 1000.0
+              << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+        }
+      }
+    }
+    out << "\n]}\n";
+  }
+
+private:
+  struct Event {
+    const char *name;
+    int64_t start;
+    int64_t end;
+  };
+
+  struct Chunk {
+    static constexpr size_t kNumEvents = 4096;
+
+    Event events[kNumEvents];
+    std::atomic<size_t> size = 0;
+    std::atomic<Chunk *> next = nullptr;
+  };
+
+  struct ThreadBuffer {
+    ThreadBuffer(int tid) : tid(tid), tail(&head) {}
+
+    ~ThreadBuffer() {
+      Chunk *chunk = head.next.load();
+      while (chunk) {
+        Chunk *next = chunk->next.load();
+        delete chunk;
+        chunk = next;
+      }
+    }
+
+    void append(const Event &event) {
+      size_t size = tail->size.load(std::memory_order_relaxed);
+      if (size == Chunk::kNumEvents) {
+        Chunk *chunk = new Chunk();
+        tail->next.store(chunk, std::memory_order_release);
+        tail = chunk;
+        size = 0;
+      }
+      tail->events[size] = event;
+      tail->size.store(size + 1, std::memory_order_release);
+    }
+
+    const int tid;
+    string name;
+    Chunk head;
+    Chunk *tail;
+  };
+
+  static std::atomic<bool> &enabled_flag() {
+    static std::atomic<bool> enabled = false;
+    return enabled;
+  }
+
+  static std::chrono::steady_clock::time_point epoch() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return epoch;
+  }
+
+  static std::mutex &registry_mu() {
+    static std::mutex mu;
+    return mu;
+  }
+
+  // Buffers outlive their threads, so that spans from threads that have
+  // finished still get written.
+  static std::vector<std::unique_ptr<ThreadBuffer>> &registry() {
+    static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    return buffers;
+  }
+
+  static ThreadBuffer *thread_buffer() {
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer) {
+      std::scoped_lock<std::mutex> lock(registry_mu());
+      registry().push_back(std::make_unique<ThreadBuffer>(registry().size()));
+      buffer = registry().back().get();
+    }
+    return buffer;
+  }
+};
+
+// Records the time from construction until end() or destruction, if tracing
+// is enabled when it is constructed. Spans shorter than min_nanos are
+// dropped, which keeps calls that are usually fast out of the trace.
+class TraceSpan {
+public:
+  TraceSpan(const char *name, int64_t min_nanos = 0)
+      : name_(name), min_nanos_(min_nanos),
+        start_(Tracer::enabled() ? Tracer::now() : -1) {}
+
+  ~TraceSpan() { end(); }
+
+  void end() {
+    if (start_ >= 0) {
+      const int64_t end = Tracer::now();
+      if (end - start_ >= min_nanos_) {
+        Tracer::record(name_, start_, end);
+      }
+      start_ = -1;
+    }
+  }
+
+private:
+  const char *name_;
+  const int64_t min_nanos_;
+  int64_t start_;
+};
+
+// Locks a mutex like std::scoped_lock, and records a span for the wait if the
+// mutex was already held by somebody else.
+template <typename Mutex> class TracedLock {
+public:
+  TracedLock(Mutex &mu, const char *wait_name) : mu_(mu) {
+    if (!Tracer::enabled()) {
+      mu_.lock();
+    } else if (!mu_.try_lock()) {
+      TraceSpan span(wait_name);
+      mu_.lock();
+    }
+  }
+
+  ~TracedLock() { mu_.unlock(); }
+
+  TracedLock(const TracedLock &) = delete;
+  TracedLock &operator=(const TracedLock &) = delete;
+
+private:
+  Mutex &mu_;
+};
+
+#endif // WAVE_ARBITRAGE_TRACE_H
@@ -0,0 +1,94 @@
+#include <fstream>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "trace.h"
+
+string read_trace() {
+  const string filename = ::testing::TempDir() + "/trace_test.json";
+  Tracer::write(filename);
+  std::ifstream in(filename);
+  return string{std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>()};
+}
+
+size_t count(const string &haystack, const string &needle) {
+  size_t n = 0;
+  for (size_t pos = haystack.find(needle); pos != string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    n++;
+  }
+  return n;
+}
+
+// The tests share the global tracer, so they run in order.
+TEST(TraceTest, Tracing) {
+  // Nothing is recorded while disabled.
+  {
+    TraceSpan span("disabled");
+  }
+  EXPECT_EQ(count(read_trace(), "disabled"), 0);
+
+  Tracer::enable();
+  Tracer::set_thread_name("test");
+
+  // Spans from threads that have finished are kept, including ones that
+  // spill into a second chunk.
+  std::vector<std::thread> threads;
+  for (int tx = 0; tx < 3; tx++) {
+    threads.push_back(std::thread([tx]() {
+      Tracer::set_thread_name("worker " + std::to_string(tx));
+      for (int n = 0; n < 5000; n++) {
+        TraceSpan span("work");
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  {
+    TraceSpan span("short", /*min_nanos=*/1000000000);
+  }
+  {
+    TraceSpan span("ended");
+    span.end();
+    // Ending twice records once.
+    span.end();
+  }
+
+  std::mutex mu;
+  {
+    TracedLock<std::mutex> lock(mu, "uncontended");
+  }
+  mu.lock();
+  std::thread waiter([&]() { TracedLock<std::mutex> lock(mu, "contended"); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  mu.unlock();
+  waiter.join();
+
+  const string trace = read_trace();
+  EXPECT_EQ(trace.substr(0, 15), "{\"traceEvents\":");
+  EXPECT_EQ(count(trace, "\"name\":\"work\""), 15000);
+  EXPECT_EQ(count(trace, "\"name\":\"short\""), 0);
+  EXPECT_EQ(count(trace, "\"name\":\"ended\""), 1);
+  EXPECT_EQ(count(trace, "\"name\":\"uncontended\""), 0);
+  EXPECT_EQ(count(trace, "\"name\":\"contended\""), 1);
+  EXPECT_EQ(count(trace, "\"name\":\"worker 2\""), 1);
+  EXPECT_EQ(count(trace, "\"name\":\"test\""), 1);
+
+  Tracer::disable();
+  {
+    TraceSpan span("after");
+  }
+  EXPECT_EQ(count(read_trace(), "after"), 0);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,414 @@
+#ifndef WAVE_ARBITRAGE_UNIVERSE_H
+#define WAVE_ARBITRAGE_UNIVERSE_H
+
+#include <functional>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "feed.h"
+#include "strategy.h"
+#include "util.h"
+
+// Hands out the trades of many symbols in time order. Unlike an IEXFeed over
+// the same symbols, each symbol moves on to its next day file on its own, so
+// every trade says which of its symbol's days it came from and whether it was
+// the last trade of that day.
+class UniverseTradeStream {
+public:
+  struct Trade {
+    int64_t seconds;
+    int32_t nanos;
+    uint32_t symbol;
+    // Only counts the symbol's day files that have trades, since IEXFeed
+    // skips the others.
+    uint32_t day;
+    double price;
+    bool last_of_day;
+  };
+
+  // Reads the start of every day file, like IEXFeed::plan_days().
+  UniverseTradeStream(std::vector<string> symbols,
+                      const IEXManifest *manifest = nullptr)
+      : symbols_(std::move(symbols)),
+        symbol_ids_(SymbolTable::intern_all(symbols_)) {
+    TradeReader reader;
+    for (const auto &symbol : symbols_) {
+      const auto &files =
+          manifest ? manifest->files.at(symbol) : get_iex_files()[symbol];
+      std::vector<string> days;
+      std::vector<Timestamp> day_starts;
+      for (const auto &file : files) {
+        reader.open(file);
+        reader.skip_event();
+        if (!reader.next_trade()) {
+          continue;
+        }
+        if (days.empty()) {
+          first_prices_.push_back(reader.trade().price() / 10000.0);
+        }
+        days.push_back(file);
+        day_starts.push_back(reader.trade().timestamp());
+      }
+      CHECK(!days.empty()) << "No trades for " << symbol;
+      day_files_.push_back(std::move(days));
+      day_starts_.push_back(std::move(day_starts));
+      price_actions_.push_back(manifest ? manifest->price_actions.at(symbol)
+                                        : load_price_actions(symbol));
+    }
+
+    heads_.resize(symbols_.size());
+    for (size_t s = 0; s < symbols_.size(); s++) {
+      readers_.push_back(std::make_unique<TradeReader>());
+      open_day(s, 0);
+    }
+  }
+
+  const std::vector<string> &symbols() const { return symbols_; }
+
+  const std::vector<SymbolId> &symbol_ids() const { return symbol_ids_; }
+
+  // The price of each symbol's first trade.
+  const std::vector<double> &first_prices() const { return first_prices_; }
+
+  // The time of the first trade of each of the symbol's days.
+  const std::vector<Timestamp> &day_starts(size_t symbol) const {
+    return day_starts_[symbol];
+  }
+
+  const std::vector<PriceAction> &price_actions(size_t symbol) const {
+    return price_actions_[symbol];
+  }
+
+  // Replaces the contents of batch with up to capacity trades. Trades at the
+  // same time come out in symbol order. Returns false once every symbol has
+  // run out.
+  bool next_batch(std::vector<Trade> *batch, size_t capacity) {
+    batch->clear();
+    while (batch->size() < capacity && !heap_.empty()) {
+      const uint32_t s = std::get<2>(heap_.top());
+      heap_.pop();
+      const Trade &trade = heads_[s];
+      batch->push_back(trade);
+      if (!trade.last_of_day) {
+        load_head(s, trade.day);
+      } else if (trade.day + 1 < day_files_[s].size()) {
+        open_day(s, trade.day + 1);
+      }
+    }
+    return !batch->empty();
+  }
+
+private:
+  std::vector<string> symbols_;
+  std::vector<SymbolId> symbol_ids_;
+  std::vector<double> first_prices_;
+  std::vector<std::vector<string>> day_files_;
+  std::vector<std::vector<Timestamp>> day_starts_;
+  std::vector<std::vector<PriceAction>> price_actions_;
+
+  std::vector<std::unique_ptr<TradeReader>> readers_;
+  // The next trade of each symbol. Its reader is already one trade ahead, to
+  // know whether this one is the last of the day.
+  std::vector<Trade> heads_;
+  std::priority_queue<std::tuple<int64_t, int32_t, uint32_t>,
+                      std::vector<std::tuple<int64_t, int32_t, uint32_t>>,
+                      std::greater<>>
+      heap_;
+
+  void open_day(uint32_t s, uint32_t day) {
+    readers_[s]->open(day_files_[s][day]);
+    readers_[s]->skip_event();
+    CHECK(readers_[s]->next_trade()) << day_files_[s][day];
+    load_head(s, day);
+  }
+
+  void load_head(uint32_t s, uint32_t day) {
+    const auto &trade = readers_[s]->trade();
+    heads_[s] = Trade{trade.timestamp().seconds(), trade.timestamp().nanos(),
+                      s, day, trade.price() / 10000.0, false};
+    heads_[s].last_of_day = !readers_[s]->next_trade();
+    heap_.push(std::make_tuple(heads_[s].seconds, heads_[s].nanos, s));
+  }
+};
+
+// Replays many symbols in one pass and evaluates every requested pair of them
+// along the way, so each symbol's days are decoded once instead of once per
+// pair. Each pair moves through its days the way an IEXFeed over just that
+// pair would: when either symbol runs out of trades for its day, both move on
+// to their next day, and the pair stops once either has no days left. That
+// makes each pair's values the same as job() on that IEXFeed, as long as the
+// trades in each day file are in time order.
+class UniverseReplay {
+public:
+  struct PairResult {
+    size_t first;
+    size_t second;
+    double bh_value;
+    double wave_value;
+  };
+
+  // The first symbol of each pair has to come before the second in the
+  // stream, as it would in the pair's own feed.
+  UniverseReplay(std::unique_ptr<UniverseTradeStream> trades, double cash,
+                 double rebalance_threshold,
+                 const std::vector<std::tuple<size_t, size_t>> &pairs,
+                 size_t num_shards, WelfordRunningStatistics *bh_stats,
+                 WelfordRunningStatistics *wave_stats,
+                 DynamicHistogram *bh_hist, DynamicHistogram *wave_hist)
+      : trades_(std::move(trades)), num_pairs_(pairs.size()),
+        shards_(std::max(static_cast<size_t>(1), num_shards)) {
+    Duration dur;
+    dur.set_seconds(365 * 24 * 60 * 60);
+    Duration cooldown;
+    cooldown.set_seconds(60);
+
+    const size_t num_symbols = trades_->symbols().size();
+    for (auto &shard : shards_) {
+      shard.by_symbol.resize(num_symbols);
+      shard.pairs.reserve(pairs.size() / shards_.size() + 1);
+    }
+
+    for (size_t p = 0; p < pairs.size(); p++) {
+      const size_t i = std::get<0>(pairs[p]);
+      const size_t j = std::get<1>(pairs[p]);
+      CHECK_LT(i, j);
+      CHECK_LT(j, num_symbols);
+
+      // Pairs are dealt out round-robin so that every shard sees roughly the
+      // same number of pairs per symbol.
+      Shard &shard = shards_[p % shards_.size()];
+      const uint32_t local_idx = shard.pairs.size();
+      shard.pairs.emplace_back(*trades_, i, j, cash, rebalance_threshold, dur,
+                               cooldown, bh_stats, wave_stats, bh_hist,
+                               wave_hist);
+      shard.by_symbol[i].push_back(local_idx);
+      shard.by_symbol[j].push_back(local_idx);
+    }
+  }
+
+  // A rough upper bound on the memory one pair takes, which is mostly the
+  // year of per-minute samples that each of its two strategies keeps for its
+  // interval statistics.
+  static size_t bytes_per_pair() {
+    static constexpr size_t kSamplesPerYear = 252 * 390;
+    static constexpr size_t kBytesPerSample = sizeof(int64_t) + sizeof(double);
+    return sizeof(PairState) + 2 * kSamplesPerYear * kBytesPerSample;
+  }
+
+  // Replays every trade. This may only be called once.
+  void run() {
+    Barrier barrier(shards_.size() + 1);
+
+    std::vector<std::thread> threads;
+    for (auto &shard : shards_) {
+      threads.push_back(std::thread([&]() {
+        while (true) {
+          barrier.wait();
+          if (done_) {
+            return;
+          }
+          process_batch(batches_[current_batch_], &shard);
+          barrier.wait();
+        }
+      }));
+    }
+
+    // The main thread decodes the next batch while the shards work through
+    // the current one.
+    size_t idx = 0;
+    trades_->next_batch(&batches_[idx], kBatchSize);
+    while (true) {
+      current_batch_ = idx;
+      done_ = batches_[idx].empty();
+      barrier.wait();
+      if (done_) {
+        break;
+      }
+      trades_->next_batch(&batches_[1 - idx], kBatchSize);
+      barrier.wait();
+      idx = 1 - idx;
+    }
+
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::vector<PairResult> results() const {
+    std::vector<PairResult> res;
+    res.reserve(num_pairs_);
+    for (const auto &shard : shards_) {
+      for (const auto &state : shard.pairs) {
+        res.push_back(PairResult{state.first, state.second,
+                                 state.bh.portfolio().value(state.prices),
+                                 state.wave.portfolio().value(state.prices)});
+      }
+    }
+    return res;
+  }
+
+private:
+  static constexpr size_t kBatchSize = 1 << 14;
+  typedef UniverseTradeStream::Trade Trade;
+
+  struct PairState {
+    PairState(const UniverseTradeStream &trades, size_t first, size_t second,
+              double cash, double rebalance_threshold, const Duration &dur,
+              const Duration &cooldown, WelfordRunningStatistics *bh_stats,
+              WelfordRunningStatistics *wave_stats, DynamicHistogram *bh_hist,
+              DynamicHistogram *wave_hist)
+        : first(first), second(second),
+          prices({trades.first_prices()[first], trades.first_prices()[second]}),
+          bh(cash, {trades.symbol_ids()[first], trades.symbol_ids()[second]},
+             prices),
+          wave(cash, {trades.symbol_ids()[first], trades.symbol_ids()[second]},
+               prices, rebalance_threshold),
+          bh_si_stats({{dur, bh_stats, bh_hist}}, cooldown),
+          wave_si_stats({{dur, wave_stats, wave_hist}}, cooldown) {
+      // A new feed starts at the later of the two first trades.
+      timestamp = trades.day_starts(first)[0];
+      if (before(timestamp, trades.day_starts(second)[0])) {
+        timestamp = trades.day_starts(second)[0];
+      }
+    }
+
+    size_t first;
+    size_t second;
+    std::vector<double> prices;
+    BuyAndHold bh;
+    WaveArbitrage wave;
+    MultiIntervalStatistics bh_si_stats;
+    MultiIntervalStatistics wave_si_stats;
+    // The day each symbol is on, and the time of the last tick, as the pair's
+    // own feed would have them.
+    uint32_t days[2] = {0, 0};
+    Timestamp timestamp;
+    int64_t last_hist_seconds = 0;
+    bool active = true;
+
+    size_t symbol(size_t slot) const { return slot == 0 ? first : second; }
+  };
+
+  struct Shard {
+    std::vector<PairState> pairs;
+    // Maps a symbol index to the local indexes of the pairs that hold it.
+    std::vector<std::vector<uint32_t>> by_symbol;
+  };
+
+  std::unique_ptr<UniverseTradeStream> trades_;
+  const size_t num_pairs_;
+  std::vector<Shard> shards_;
+  std::vector<Trade> batches_[2];
+  size_t current_batch_ = 0;
+  bool done_ = false;
+
+  void process_batch(const std::vector<Trade> &batch, Shard *shard) {
+    for (size_t t = 0; t < batch.size(); t++) {
+      const Trade &trade = batch[t];
+      if (t + 1 < batch.size()) {
+        const auto &next = shard->by_symbol[batch[t + 1].symbol];
+        if (!next.empty()) {
+          __builtin_prefetch(&shard->pairs[next.front()]);
+        }
+      }
+
+      for (uint32_t local_idx : shard->by_symbol[trade.symbol]) {
+        PairState &state = shard->pairs[local_idx];
+        const size_t slot = trade.symbol == state.first ? 0 : 1;
+        // The rest of a day that the other symbol already ended.
+        if (!state.active || trade.day != state.days[slot]) {
+          continue;
+        }
+
+        state.prices[slot] = trade.price;
+        if (trade.last_of_day) {
+          change_day(*trades_, &state);
+        } else {
+          state.timestamp.set_seconds(trade.seconds);
+          state.timestamp.set_nanos(trade.nanos);
+          evaluate(&state);
+        }
+      }
+    }
+  }
+
+  // Mirrors IEXFeed::adjust_prices() once the trade that ends a day has been
+  // applied: both symbols move to their next day, and the corporate actions
+  // in between are paid out before the pair is evaluated.
+  static void change_day(const UniverseTradeStream &trades, PairState *state) {
+    Timestamp next_timestamp;
+    for (size_t slot = 0; slot < 2; slot++) {
+      const auto &day_starts = trades.day_starts(state->symbol(slot));
+      if (state->days[slot] + 1 >= day_starts.size()) {
+        state->active = false;
+        return;
+      }
+      const Timestamp &start = day_starts[state->days[slot] + 1];
+      if (slot == 0 || before(start, next_timestamp)) {
+        next_timestamp = start;
+      }
+    }
+
+    double dividends[2] = {0.0, 0.0};
+    double splits[2] = {0.0, 0.0};
+    for (size_t slot = 0; slot < 2; slot++) {
+      state->days[slot]++;
+      for (const auto &price_action :
+           trades.price_actions(state->symbol(slot))) {
+        if (before(state->timestamp, price_action.timestamp) &&
+            before(price_action.timestamp, next_timestamp)) {
+          (price_action.is_dividend ? dividends : splits)[slot] =
+              price_action.ratio;
+        }
+      }
+    }
+
+    const std::vector<SymbolId> &symbol_ids = trades.symbol_ids();
+    for (size_t slot = 0; slot < 2; slot++) {
+      if (dividends[slot] != 0.0) {
+        const SymbolId symbol = symbol_ids[state->symbol(slot)];
+        state->bh.pay_dividend(symbol, dividends[slot]);
+        state->wave.pay_dividend(symbol, dividends[slot]);
+      }
+    }
+    for (size_t slot = 0; slot < 2; slot++) {
+      if (splits[slot] != 0.0) {
+        const SymbolId symbol = symbol_ids[state->symbol(slot)];
+        state->bh.stock_split(symbol, 1.0 / splits[slot]);
+        state->wave.stock_split(symbol, 1.0 / splits[slot]);
+      }
+    }
+
+    state->timestamp = next_timestamp;
+    evaluate(state);
+  }
+
+  // Mirrors the body of the loop in job() for a single pair.
+  static void evaluate(PairState *state) {
+    for (auto price : state->prices) {
+      if (price < 5.0) {
+        state->active = false;
+        return;
+      }
+    }
+
+    state->bh.price_event(state->prices);
+    state->wave.price_event(state->prices);
+
+    const int64_t seconds = state->timestamp.seconds();
+    if (seconds - 60 > state->last_hist_seconds) {
+      state->last_hist_seconds = seconds;
+      state->bh_si_stats.update(state->bh.portfolio().value(state->prices),
+                                state->timestamp);
+      state->wave_si_stats.update(state->wave.portfolio().value(state->prices),
+                                  state->timestamp);
+    }
+  }
+};
+
+#endif // WAVE_ARBITRAGE_UNIVERSE_H
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <filesystem>
+#include <map>
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+#include "job.h"
+#include "synthetic_data_testing.h"
+#include "universe.h"
+
+// A bit over a year of data for four symbols that don't all trade on the same
+// days, so that pairs cut their days differently from one another.
+const std::vector<string> &test_symbols() {
+  static const std::vector<string> symbols = []() {
+    SyntheticIEXConfig config;
+    config.num_symbols = 4;
+    config.num_days = 300;
+    config.trades_per_day = 60.0;
+    config.dividend_probability = 0.05;
+    config.split_probability = 0.01;
+    const auto symbols = write_test_data("universe", config);
+
+    std::vector<std::filesystem::path> files;
+    for (const auto &f : std::filesystem::directory_iterator(
+             test_data_root("universe") + "/processed")) {
+      files.push_back(f.path());
+    }
+    std::sort(files.begin(), files.end());
+    std::map<string, int> day;
+    for (const auto &file : files) {
+      const string name = file.filename();
+      const string symbol = name.substr(0, name.find('_'));
+      const int d = day[symbol]++;
+      // The second symbol misses a few days, the third starts late and the
+      // first stops early.
+      if ((symbol == symbols[1] && d % 50 == 7) ||
+          (symbol == symbols[2] && d < 5) ||
+          (symbol == symbols[0] && d >= 290)) {
+        std::filesystem::remove(file);
+      }
+    }
+    return symbols;
+  }();
+  return symbols;
+}
+
+TEST(UniverseTest, TradeStream) {
+  const std::vector<string> &symbols = test_symbols();
+  UniverseTradeStream trades(symbols);
+  EXPECT_EQ(trades.day_starts(0).size(), 290);
+  EXPECT_EQ(trades.day_starts(1).size(), 294);
+  EXPECT_EQ(trades.day_starts(2).size(), 295);
+
+  std::vector<UniverseTradeStream::Trade> batch;
+  std::vector<uint32_t> num_days(symbols.size(), 0);
+  std::vector<bool> seen(symbols.size(), false);
+  UniverseTradeStream::Trade last{};
+  while (trades.next_batch(&batch, /*capacity=*/1000)) {
+    for (const auto &trade : batch) {
+      EXPECT_TRUE(last.seconds < trade.seconds ||
+                  (last.seconds == trade.seconds &&
+                   (last.nanos < trade.nanos ||
+                    (last.nanos == trade.nanos &&
+                     last.symbol <= trade.symbol))));
+      last = trade;
+
+      if (!seen[trade.symbol]) {
+        seen[trade.symbol] = true;
+        EXPECT_EQ(trade.price, trades.first_prices()[trade.symbol]);
+      }
+      EXPECT_EQ(trade.day, num_days[trade.symbol]);
+      if (trade.last_of_day) {
+        num_days[trade.symbol]++;
+      }
+    }
+  }
+  for (size_t s = 0; s < symbols.size(); s++) {
+    EXPECT_EQ(num_days[s], trades.day_starts(s).size());
+  }
+}
+
+TEST(UniverseTest, MatchesJob) {
+  const std::vector<string> &symbols = test_symbols();
+  std::vector<std::tuple<size_t, size_t>> pairs;
+  for (size_t i = 0; i < symbols.size(); i++) {
+    for (size_t j = i + 1; j < symbols.size(); j++) {
+      pairs.push_back(std::make_tuple(i, j));
+    }
+  }
+
+  WelfordRunningStatistics bh_stats;
+  WelfordRunningStatistics wave_stats;
+  DynamicHistogram bh_hist(10);
+  DynamicHistogram wave_hist(10);
+  UniverseReplay replay(std::make_unique<UniverseTradeStream>(symbols),
+                        /*cash=*/100000.0, /*rebalance_threshold=*/1.001,
+                        pairs, /*num_shards=*/2, &bh_stats, &wave_stats,
+                        &bh_hist, &wave_hist);
+  replay.run();
+  const auto results = replay.results();
+  ASSERT_EQ(results.size(), pairs.size());
+
+  WelfordRunningStatistics job_bh_stats;
+  WelfordRunningStatistics job_wave_stats;
+  DynamicHistogram job_bh_hist(10);
+  DynamicHistogram job_wave_hist(10);
+  for (const auto &result : results) {
+    const auto [bh_value, wave_value] =
+        job(/*feed=*/std::make_unique<IEXFeed>(std::vector<string>{
+                symbols[result.first], symbols[result.second]}),
+            /*cash=*/100000.0, /*rebalance_threshold=*/1.001,
+            /*bh_stats=*/&job_bh_stats, /*wave_stats=*/&job_wave_stats,
+            /*bh_hist=*/&job_bh_hist, /*wave_hist=*/&job_wave_hist);
+    EXPECT_EQ(result.bh_value, bh_value)
+        << symbols[result.first] << " " << symbols[result.second];
+    EXPECT_EQ(result.wave_value, wave_value)
+        << symbols[result.first] << " " << symbols[result.second];
+  }
+
+  // The pairs are interleaved differently, so only the sums are the same.
+  ASSERT_GT(job_bh_stats.count(), 0);
+  EXPECT_EQ(bh_stats.count(), job_bh_stats.count());
+  EXPECT_EQ(wave_stats.count(), job_wave_stats.count());
+  EXPECT_NEAR(bh_stats.mean(), job_bh_stats.mean(), 1e-9);
+  EXPECT_NEAR(wave_stats.mean(), job_wave_stats.mean(), 1e-9);
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InstallFailureSignalHandler();
+  return RUN_ALL_TESTS();
+}
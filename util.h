@@ -2,10 +2,13 @@
 #define WAVE_ARBITRAGE_UTIL_H
 
 #include <algorithm>
+#include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <vector>
 #include <google/protobuf/util/time_util.h>
 #include "external/dynamic_histogram/cpp/DynamicHistogram.h"
+#include "trace.h"
 
 
 using ::google::protobuf::Duration;
@@ -19,7 +22,7 @@ public:
       : count_(0), mean_(0.0), M2_(0.0) {}
 
   void update(double new_value) {
-    std::scoped_lock<std::mutex> lock(mu_);
+    TracedLock<std::mutex> lock(mu_, "wait for stats");
 
     count_++;
     double delta = new_value - mean_;
@@ -40,6 +43,24 @@ public:
     return M2_ / std::max(static_cast<int64_t>(1), count_ - 1);
   };
 
+  // The sum of squared differences from the mean. Together with count() and
+  // mean() this is enough to merge() the statistics somewhere else.
+  double m2() const { return M2_; }
+
+  // Folds in statistics that were gathered separately. See Chan et al.,
+  // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+  void merge(int64_t count, double mean, double m2) {
+    std::scoped_lock<std::mutex> lock(mu_);
+    if (count == 0) {
+      return;
+    }
+    const int64_t total = count_ + count;
+    const double delta = mean - mean_;
+    mean_ += delta * count / total;
+    M2_ += m2 + delta * delta * count_ * count / total;
+    count_ = total;
+  }
+
 private:
   std::mutex mu_;
   int64_t count_;
@@ -47,6 +68,59 @@ private:
   double M2_;
 };
 
+// DynamicHistogram can't be merged directly, so histograms are merged by
+// adding this many evenly spaced quantiles of one to the other.
+static constexpr size_t kNumMergeQuantiles = 256;
+
+inline std::vector<double> histogram_quantiles(DynamicHistogram *hist) {
+  std::vector<double> quantiles;
+  for (size_t q = 0; q < kNumMergeQuantiles; q++) {
+    quantiles.push_back(
+        hist->getQuantileEstimate((q + 0.5) / kNumMergeQuantiles));
+  }
+  return quantiles;
+}
+
+// Adds count values to the histogram that follow the given quantiles.
+inline void add_quantiles(const std::vector<double> &quantiles, int64_t count,
+                          DynamicHistogram *hist) {
+  for (size_t q = 0; q < quantiles.size(); q++) {
+    const int64_t repeats = count * static_cast<int64_t>(q + 1) /
+                                static_cast<int64_t>(quantiles.size()) -
+                            count * static_cast<int64_t>(q) /
+                                static_cast<int64_t>(quantiles.size());
+    for (int64_t r = 0; r < repeats; r++) {
+      hist->addValue(quantiles[q]);
+    }
+  }
+}
+
+// A reusable thread barrier. Each call to wait() blocks until num_threads
+// callers have arrived, after which the barrier resets for the next round.
+class Barrier {
+public:
+  Barrier(size_t num_threads) : num_threads_(num_threads) {}
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mu_);
+    const size_t generation = generation_;
+    if (++arrived_ == num_threads_) {
+      arrived_ = 0;
+      generation_++;
+      cv_.notify_all();
+      return;
+    }
+    cv_.wait(lock, [&]() { return generation != generation_; });
+  }
+
+private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  const size_t num_threads_;
+  size_t arrived_ = 0;
+  size_t generation_ = 0;
+};
+
 void get_duration(const Timestamp &start, const Timestamp &end,
                   Duration *duration) {
   duration->set_seconds(end.seconds() - start.seconds());
@@ -102,6 +176,8 @@ public:
 
     const double stat = val / old_val;
     stats_->update(stat);
+    // The histogram locks internally, so only a slow add shows up.
+    TraceSpan span("slow histogram add", /*min_nanos=*/1000);
     hist_->addValue(stat);
   }
 
@@ -115,4 +191,91 @@ private:
   Timestamp last_stat_time_;
 };
 
+// A window length, and where the returns over windows of that length go.
+struct IntervalHorizon {
+  Duration duration;
+  WelfordRunningStatistics *stats;
+  DynamicHistogram *hist;
+};
+
+// The returns of one strategy, or of one horizon. Neither member can be
+// moved, so lists of these go in a std::deque, which leaves its elements
+// where they are as it grows.
+struct ReturnStats {
+  explicit ReturnStats(size_t max_num_buckets) : hist(max_num_buckets) {}
+
+  WelfordRunningStatistics stats;
+  DynamicHistogram hist;
+};
+
+// Works like one StreamIntervalStatistics per horizon, and gives the same
+// results, but keeps a single buffer of samples that is as long as the
+// longest window. Each horizon only tracks where its window starts.
+class MultiIntervalStatistics {
+public:
+  MultiIntervalStatistics(const std::vector<IntervalHorizon> &horizons,
+                          const Duration &cooldown)
+      : cooldown_nanos_(to_nanos(cooldown)) {
+    for (const auto &horizon : horizons) {
+      horizons_.push_back(HorizonState{to_nanos(horizon.duration),
+                                       horizon.stats, horizon.hist});
+    }
+  }
+
+  void update(double val, const Timestamp &timestamp) {
+    const int64_t nanos =
+        timestamp.seconds() * kNanosPerSecond + timestamp.nanos();
+    samples_.push_back(Sample{nanos, val});
+
+    size_t first_needed = first_index_ + samples_.size();
+    for (auto &horizon : horizons_) {
+      const Sample &oldest = samples_[horizon.start - first_index_];
+      if (nanos - oldest.nanos >= horizon.duration_nanos) {
+        horizon.start++;
+        if (nanos - horizon.last_stat_nanos >= cooldown_nanos_) {
+          horizon.last_stat_nanos = timestamp.seconds() * kNanosPerSecond;
+
+          const double stat = val / oldest.val;
+          horizon.stats->update(stat);
+          TraceSpan span("slow histogram add", /*min_nanos=*/1000);
+          horizon.hist->addValue(stat);
+        }
+      }
+      first_needed = std::min(first_needed, horizon.start);
+    }
+
+    while (first_index_ < first_needed) {
+      samples_.pop_front();
+      first_index_++;
+    }
+  }
+
+private:
+  static constexpr int64_t kNanosPerSecond = 1000000000;
+
+  struct Sample {
+    int64_t nanos;
+    double val;
+  };
+
+  struct HorizonState {
+    int64_t duration_nanos;
+    WelfordRunningStatistics *stats;
+    DynamicHistogram *hist;
+    // The index of the oldest sample in the window.
+    size_t start = 0;
+    int64_t last_stat_nanos = 0;
+  };
+
+  static int64_t to_nanos(const Duration &duration) {
+    return duration.seconds() * kNanosPerSecond + duration.nanos();
+  }
+
+  const int64_t cooldown_nanos_;
+  std::vector<HorizonState> horizons_;
+  std::deque<Sample> samples_;
+  // The index of samples_.front() among every sample so far.
+  size_t first_index_ = 0;
+};
+
 #endif // WAVE_ARBITRAGE_UTIL_H
@@ -34,16 +34,71 @@ TEST(UtilTest, StreamInterval) {
   dur.set_seconds(36000);
   dur.set_nanos(500000);
 
-  StreamIntervalStatistics si_stats(dur);
+  Duration cooldown;
+  cooldown.set_seconds(60);
+  WelfordRunningStatistics stats;
+  DynamicHistogram hist(/*max_num_buckets=*/200);
+  StreamIntervalStatistics si_stats(dur, cooldown, &stats, &hist);
 
   for (int i = 0; i < 100000; i++) {
     double val = norm_dist(generator);
     timestamp.set_seconds(timestamp.seconds() + 360 +
                           10 * norm_dist(generator));
-    si_stats.update(val, std::make_shared<Timestamp>(timestamp));
+    si_stats.update(val, timestamp);
   }
 
-  EXPECT_NEAR(si_stats.hist()->getQuantileEstimate(0.5), 1.0, 0.1);
+  EXPECT_NEAR(hist.getQuantileEstimate(0.5), 1.0, 0.1);
+}
+
+TEST(UtilTest, MultiInterval) {
+  std::default_random_engine generator;
+  std::normal_distribution<double> norm_dist(10.0, 1.0);
+  std::uniform_int_distribution<int> gap_dist(1, 600);
+
+  Duration cooldown;
+  cooldown.set_seconds(60);
+
+  // Each horizon should match a StreamIntervalStatistics of its own.
+  static constexpr int kNumHorizons = 4;
+  const int64_t horizon_seconds[kNumHorizons] = {0, 3600, 86400, 864000};
+  std::vector<std::unique_ptr<WelfordRunningStatistics>> expected_stats;
+  std::vector<std::unique_ptr<WelfordRunningStatistics>> actual_stats;
+  std::vector<std::unique_ptr<DynamicHistogram>> hists;
+  std::vector<std::unique_ptr<StreamIntervalStatistics>> singles;
+  std::vector<IntervalHorizon> horizons;
+  for (int h = 0; h < kNumHorizons; h++) {
+    Duration dur;
+    dur.set_seconds(horizon_seconds[h]);
+    dur.set_nanos(h * 1000);
+    expected_stats.push_back(std::make_unique<WelfordRunningStatistics>());
+    actual_stats.push_back(std::make_unique<WelfordRunningStatistics>());
+    hists.push_back(std::make_unique<DynamicHistogram>(200));
+    hists.push_back(std::make_unique<DynamicHistogram>(200));
+    singles.push_back(std::make_unique<StreamIntervalStatistics>(
+        dur, cooldown, expected_stats.back().get(),
+        hists[hists.size() - 2].get()));
+    horizons.push_back(
+        IntervalHorizon{dur, actual_stats.back().get(), hists.back().get()});
+  }
+  MultiIntervalStatistics multi(horizons, cooldown);
+
+  Timestamp timestamp;
+  for (int i = 0; i < 20000; i++) {
+    const double val = norm_dist(generator);
+    timestamp.set_seconds(timestamp.seconds() + gap_dist(generator));
+    timestamp.set_nanos(gap_dist(generator) * 1000);
+    for (auto &single : singles) {
+      single->update(val, timestamp);
+    }
+    multi.update(val, timestamp);
+  }
+
+  for (int h = 0; h < kNumHorizons; h++) {
+    EXPECT_GT(expected_stats[h]->count(), 0) << h;
+    EXPECT_EQ(actual_stats[h]->count(), expected_stats[h]->count()) << h;
+    EXPECT_EQ(actual_stats[h]->mean(), expected_stats[h]->mean()) << h;
+    EXPECT_EQ(actual_stats[h]->m2(), expected_stats[h]->m2()) << h;
+  }
 }
 
 int main(int argc, char **argv) {